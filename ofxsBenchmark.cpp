@@ -0,0 +1,1058 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/NatronGitHub/openfx-supportext>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Microbenchmarks for the supportext kernels, running on the mock host of ofxsMockHost.h.
+ *
+ * Each kernel is run for each bit depth, number of components and image size, with 1 to N threads,
+ * and the throughput (in megapixels per second) and the speedup over one thread are printed.
+ * The latency of the plugin-side multithread suite is measured too.
+ *
+ * This is a standalone program, which is not part of any plugin. To build it, compile together:
+ * - ofxsBenchmark.cpp, ofxsMockHost.cpp, ofxsThreadSuite.cpp, tinythread.cpp, ofxsLut.cpp, ofxsLut3D.cpp,
+ *   ofxsColorTransform.cpp, ofxsMipmap.cpp and ofxsPixelProcessorStats.cpp from this directory;
+ * - the sources of the OpenFX Support library (the .cpp files in openfx/Support/Library);
+ * with the include paths openfx/include, openfx/Support/include, openfx/Support/Plugins/include
+ * and this directory, e.g.:
+ *
+ *   SUPPORT=../openfx/Support/Library
+ *   c++ -O3 -DNDEBUG -I../openfx/include -I../openfx/Support/include -I../openfx/Support/Plugins/include -I. \
+ *       ofxsBenchmark.cpp ofxsMockHost.cpp ofxsThreadSuite.cpp tinythread.cpp ofxsLut.cpp ofxsLut3D.cpp \
+ *       ofxsColorTransform.cpp ofxsMipmap.cpp ofxsPixelProcessorStats.cpp $SUPPORT/ofxs*.cpp \
+ *       -o ofxsBenchmark -lpthread
+ *
+ * Run "ofxsBenchmark -h" for the options.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ofxsImageEffect.h"
+#include "ofxsMultiThread.h"
+#include "ofxsThreadSuite.h"
+#include "ofxsMockHost.h"
+#include "ofxsPixelProcessor.h"
+#include "ofxsPixelProcessorStats.h"
+#include "ofxsCopier.h"
+#include "ofxsTransform3x3Processor.h"
+#include "ofxsImageBlenderMasked.h"
+#include "ofxsMerging.h"
+#include "ofxsMipmap.h"
+#include "ofxsCoords.h"
+#include "ofxsLut.h"
+#include "ofxsLut3D.h"
+#include "ofxsColorTransform.h"
+
+// the benchmark is not a plugin, but the Support library needs this
+void
+OFX::Plugin::getPluginIDs(OFX::PluginFactoryArray & /*ids*/)
+{
+}
+
+using namespace OFX;
+
+namespace {
+////////////////////////////////////////////////////////////////////////////////
+// images
+
+// a deterministic pseudo-random generator, so that all runs process the same data
+class Random
+{
+    unsigned int _state;
+
+public:
+    Random(unsigned int seed)
+        : _state(seed)
+    {
+    }
+
+    // a number in [0,1)
+    float next()
+    {
+        _state = _state * 1664525u + 1013904223u;
+
+        return (_state >> 8) * (1.f / 16777216.f);
+    }
+};
+
+template <class PIX, int maxValue>
+void
+fillImageForDepth(Image* img,
+                  unsigned int seed)
+{
+    const OfxRectI& bounds = img->getBounds();
+    const int nComponents = img->getPixelComponentCount();
+    Random random(seed);
+
+    for (int y = bounds.y1; y < bounds.y2; ++y) {
+        PIX* pix = (PIX*)img->getPixelAddress(bounds.x1, y);
+        for (int x = bounds.x1; x < bounds.x2; ++x, pix += nComponents) {
+            // premultiplied values
+            const float a = (nComponents == 4) ? random.next() : 1.f;
+            for (int c = 0; c < nComponents; ++c) {
+                const float v = (c == 3) ? a : random.next() * a;
+                pix[c] = (maxValue == 1) ? PIX(v) : PIX(v * maxValue + 0.5f);
+            }
+        }
+    }
+}
+
+void
+fillImage(Image* img,
+          unsigned int seed)
+{
+    switch ( img->getPixelDepth() ) {
+    case eBitDepthUByte:
+        fillImageForDepth<unsigned char, 255>(img, seed);
+        break;
+    case eBitDepthUShort:
+        fillImageForDepth<unsigned short, 65535>(img, seed);
+        break;
+    case eBitDepthFloat:
+        fillImageForDepth<float, 1>(img, seed);
+        break;
+    default:
+        throwSuiteStatusException(kOfxStatErrFormat);
+    }
+}
+
+int
+getComponentCount(PixelComponentEnum pixelComponents)
+{
+    return (pixelComponents == ePixelComponentRGBA) ? 4 : (pixelComponents == ePixelComponentRGB) ? 3 : 1;
+}
+
+PixelComponentEnum
+getPixelComponents(int nComponents)
+{
+    return (nComponents == 4) ? ePixelComponentRGBA : (nComponents == 3) ? ePixelComponentRGB : ePixelComponentAlpha;
+}
+
+const char*
+getBitDepthName(BitDepthEnum bitDepth)
+{
+    switch (bitDepth) {
+    case eBitDepthUByte:
+
+        return "8u";
+    case eBitDepthUShort:
+
+        return "16u";
+    case eBitDepthHalf:
+
+        return "16f";
+    case eBitDepthFloat:
+
+        return "32f";
+    default:
+        break;
+    }
+
+    return "?";
+}
+
+// The images of a benchmark configuration, all with the same bounds.
+// They are created and filled on first use, and shared by all kernels.
+class BenchImages
+{
+public:
+    enum RoleEnum
+    {
+        eRoleSrc = 0,
+        eRoleSrc2,
+        eRoleMask,
+        eRoleDst
+    };
+
+private:
+    OfxRectI _bounds;
+    std::map<int, Image*> _images;
+
+public:
+    BenchImages(const OfxRectI& bounds)
+        : _bounds(bounds)
+        , _images()
+    {
+    }
+
+    ~BenchImages()
+    {
+        for (std::map<int, Image*>::iterator it = _images.begin(); it != _images.end(); ++it) {
+            delete it->second;
+        }
+    }
+
+    const OfxRectI& getBounds() const
+    {
+        return _bounds;
+    }
+
+    Image* get(RoleEnum role,
+               BitDepthEnum bitDepth,
+               PixelComponentEnum pixelComponents)
+    {
+        const int key = ( (int)role * 16 + (int)bitDepth ) * 16 + (int)pixelComponents;
+        std::map<int, Image*>::iterator it = _images.find(key);
+
+        if ( it != _images.end() ) {
+            return it->second;
+        }
+        Image* img = MockHost::createImage(_bounds, pixelComponents, bitDepth);
+        try {
+            fillImage(img, key);
+        } catch (...) {
+            delete img;
+            throw;
+        }
+        _images[key] = img;
+
+        return img;
+    }
+
+private:
+    BenchImages &operator= (const BenchImages &);
+    BenchImages(const BenchImages &);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// kernels
+
+// runs a kernel once over the render window
+typedef void (*KernelFunction)(ImageEffect& effect, BenchImages& images, BitDepthEnum bitDepth, PixelComponentEnum pixelComponents, const OfxRectI& renderWindow);
+
+// returns the kernel function for a bit depth and a number of components, or NULL if it is not supported
+typedef KernelFunction (*KernelSelector)(BitDepthEnum bitDepth, int nComponents);
+
+template <template <class PIX, int nComponents, int maxValue> class KERNEL, class PIX, int maxValue>
+KernelFunction
+selectKernelForDepth(int nComponents)
+{
+    switch (nComponents) {
+    case 1:
+
+        return &KERNEL<PIX, 1, maxValue>::run;
+    case 3:
+
+        return &KERNEL<PIX, 3, maxValue>::run;
+    case 4:
+
+        return &KERNEL<PIX, 4, maxValue>::run;
+    default:
+        break;
+    }
+
+    return NULL;
+}
+
+template <template <class PIX, int nComponents, int maxValue> class KERNEL>
+KernelFunction
+selectKernel(BitDepthEnum bitDepth,
+             int nComponents)
+{
+    switch (bitDepth) {
+    case eBitDepthUByte:
+
+        return selectKernelForDepth<KERNEL, unsigned char, 255>(nComponents);
+    case eBitDepthUShort:
+
+        return selectKernelForDepth<KERNEL, unsigned short, 65535>(nComponents);
+    case eBitDepthFloat:
+
+        return selectKernelForDepth<KERNEL, float, 1>(nComponents);
+    default:
+        break;
+    }
+
+    return NULL;
+}
+
+template <template <class PIX, int nComponents, int maxValue> class KERNEL>
+KernelFunction
+selectRGBKernel(BitDepthEnum bitDepth,
+                int nComponents)
+{
+    return (nComponents >= 3) ? selectKernel<KERNEL>(bitDepth, nComponents) : NULL;
+}
+
+template <template <class PIX, int nComponents, int maxValue> class KERNEL>
+KernelFunction
+selectFloatKernel(BitDepthEnum bitDepth,
+                  int nComponents)
+{
+    return (bitDepth == eBitDepthFloat) ? selectKernelForDepth<KERNEL, float, 1>(nComponents) : NULL;
+}
+
+const OfxPointD kRenderScaleOne = { 1., 1. };
+
+// OFX::PixelCopier
+template <class PIX, int nComponents, int maxValue>
+struct PixelCopierKernel
+{
+    static void run(ImageEffect& effect,
+                    BenchImages& images,
+                    BitDepthEnum bitDepth,
+                    PixelComponentEnum pixelComponents,
+                    const OfxRectI& renderWindow)
+    {
+        PixelCopier<PIX, nComponents> processor(effect);
+
+        processor.setDstImg( images.get(BenchImages::eRoleDst, bitDepth, pixelComponents) );
+        processor.setSrcImg( images.get(BenchImages::eRoleSrc, bitDepth, pixelComponents) );
+        processor.setRenderWindow(renderWindow, kRenderScaleOne);
+        processor.process();
+    }
+};
+
+// OFX::PixelCopierMaskMix, with a mask and mix
+template <class PIX, int nComponents, int maxValue>
+struct PixelCopierMaskMixKernel
+{
+    static void run(ImageEffect& effect,
+                    BenchImages& images,
+                    BitDepthEnum bitDepth,
+                    PixelComponentEnum pixelComponents,
+                    const OfxRectI& renderWindow)
+    {
+        PixelCopierMaskMix<PIX, nComponents, maxValue, true> processor(effect);
+
+        processor.setDstImg( images.get(BenchImages::eRoleDst, bitDepth, pixelComponents) );
+        processor.setSrcImg( images.get(BenchImages::eRoleSrc, bitDepth, pixelComponents) );
+        processor.setOrigImg( images.get(BenchImages::eRoleSrc2, bitDepth, pixelComponents) );
+        processor.setMaskImg(images.get(BenchImages::eRoleMask, bitDepth, ePixelComponentAlpha), false);
+        processor.doMasking(true);
+        processor.setPremultMaskMix(false, 3, 0.5);
+        processor.setRenderWindow(renderWindow, kRenderScaleOne);
+        processor.process();
+    }
+};
+
+// OFX::Transform3x3Processor, with a rotation and the cubic filter
+template <class PIX, int nComponents, int maxValue>
+struct Transform3x3Kernel
+{
+    static void run(ImageEffect& effect,
+                    BenchImages& images,
+                    BitDepthEnum bitDepth,
+                    PixelComponentEnum pixelComponents,
+                    const OfxRectI& renderWindow)
+    {
+        Transform3x3Processor<PIX, nComponents, maxValue, false, eFilterCubic, false> processor(effect);
+        const OfxRectI& bounds = images.getBounds();
+        Matrix3x3 invtransform = ofxsMatRotationAroundPoint(0.1, (bounds.x1 + bounds.x2) / 2., (bounds.y1 + bounds.y2) / 2.);
+
+        processor.setDstImg( images.get(BenchImages::eRoleDst, bitDepth, pixelComponents) );
+        processor.setSrcImg( images.get(BenchImages::eRoleSrc, bitDepth, pixelComponents) );
+        processor.setValues(&invtransform, NULL, 1, false, 0., 1.);
+        processor.setRenderWindow(renderWindow, kRenderScaleOne);
+        processor.process();
+    }
+};
+
+// OFX::Transform3x3Processor, with motion blur over a rotation
+template <class PIX, int nComponents, int maxValue>
+struct Transform3x3MotionBlurKernel
+{
+    static void run(ImageEffect& effect,
+                    BenchImages& images,
+                    BitDepthEnum bitDepth,
+                    PixelComponentEnum pixelComponents,
+                    const OfxRectI& renderWindow)
+    {
+        Transform3x3Processor<PIX, nComponents, maxValue, false, eFilterCubic, false> processor(effect);
+        const OfxRectI& bounds = images.getBounds();
+        const size_t nTransforms = 10;
+        Matrix3x3 invtransform[nTransforms];
+
+        for (size_t i = 0; i < nTransforms; ++i) {
+            invtransform[i] = ofxsMatRotationAroundPoint(0.01 * i, (bounds.x1 + bounds.x2) / 2., (bounds.y1 + bounds.y2) / 2.);
+        }
+        processor.setDstImg( images.get(BenchImages::eRoleDst, bitDepth, pixelComponents) );
+        processor.setSrcImg( images.get(BenchImages::eRoleSrc, bitDepth, pixelComponents) );
+        processor.setValues(invtransform, NULL, nTransforms, false, 0.25, 1.);
+        processor.setRenderWindow(renderWindow, kRenderScaleOne);
+        processor.process();
+    }
+};
+
+// OFX::ImageBlenderMasked, with a mask
+template <class PIX, int nComponents, int maxValue>
+struct ImageBlenderMaskedKernel
+{
+    static void run(ImageEffect& effect,
+                    BenchImages& images,
+                    BitDepthEnum bitDepth,
+                    PixelComponentEnum pixelComponents,
+                    const OfxRectI& renderWindow)
+    {
+        ImageBlenderMasked<PIX, nComponents, maxValue, true> processor(effect);
+
+        processor.setDstImg( images.get(BenchImages::eRoleDst, bitDepth, pixelComponents) );
+        processor.setFromImg( images.get(BenchImages::eRoleSrc, bitDepth, pixelComponents) );
+        processor.setToImg( images.get(BenchImages::eRoleSrc2, bitDepth, pixelComponents) );
+        processor.setMaskImg(images.get(BenchImages::eRoleMask, bitDepth, ePixelComponentAlpha), false);
+        processor.doMasking(true);
+        processor.setBlend(0.3f);
+        processor.setRenderWindow(renderWindow, kRenderScaleOne);
+        processor.process();
+    }
+};
+
+// MergeImages2D::mergePixel over two images, in a PixelProcessor.
+// As in the Merge plugins, only float images are supported (some merging functions do not compile for integer types).
+template <MergeImages2D::MergingFunctionEnum f, class PIX, int nComponents, int maxValue>
+class MergePixelProcessor
+    : public PixelProcessor
+{
+    const Image* _srcA;
+    const Image* _srcB;
+
+public:
+    MergePixelProcessor(ImageEffect& effect)
+        : PixelProcessor(effect)
+        , _srcA(NULL)
+        , _srcB(NULL)
+    {
+    }
+
+    void setSrcImgs(const Image* srcA,
+                    const Image* srcB)
+    {
+        _srcA = srcA;
+        _srcB = srcB;
+    }
+
+private:
+    void multiThreadProcessImages(const OfxRectI& procWindow, const OfxPointD& /*rs*/)
+    {
+        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
+            const PIX* A = (const PIX*)_srcA->getPixelAddress(procWindow.x1, y);
+            const PIX* B = (const PIX*)_srcB->getPixelAddress(procWindow.x1, y);
+            PIX* dstPix = (PIX*)getDstPixelAddress(procWindow.x1, y);
+            for (int x = procWindow.x1; x < procWindow.x2; ++x) {
+                const PIX a = (nComponents == 4) ? A[3] : (nComponents == 1) ? A[0] : PIX(maxValue);
+                const PIX b = (nComponents == 4) ? B[3] : (nComponents == 1) ? B[0] : PIX(maxValue);
+                MergeImages2D::mergePixel<f, PIX, nComponents, maxValue>(false, A, a, B, b, dstPix);
+                A += nComponents;
+                B += nComponents;
+                dstPix += nComponents;
+            }
+        }
+    }
+};
+
+template <MergeImages2D::MergingFunctionEnum f>
+struct MergePixelKernel
+{
+    template <class PIX, int nComponents, int maxValue>
+    struct Kernel
+    {
+        static void run(ImageEffect& effect,
+                        BenchImages& images,
+                        BitDepthEnum bitDepth,
+                        PixelComponentEnum pixelComponents,
+                        const OfxRectI& renderWindow)
+        {
+            MergePixelProcessor<f, PIX, nComponents, maxValue> processor(effect);
+
+            processor.setDstImg( images.get(BenchImages::eRoleDst, bitDepth, pixelComponents) );
+            processor.setSrcImgs( images.get(BenchImages::eRoleSrc, bitDepth, pixelComponents),
+                                  images.get(BenchImages::eRoleSrc2, bitDepth, pixelComponents) );
+            processor.setRenderWindow(renderWindow, kRenderScaleOne);
+            processor.process();
+        }
+    };
+};
+
+// ofxsBuildMipMaps, 4 levels
+template <class PIX, int nComponents, int maxValue>
+struct BuildMipMapsKernel
+{
+    static void run(ImageEffect& effect,
+                    BenchImages& images,
+                    BitDepthEnum bitDepth,
+                    PixelComponentEnum pixelComponents,
+                    const OfxRectI& renderWindow)
+    {
+        const unsigned int maxLevel = 4;
+        const Image* src = images.get(BenchImages::eRoleSrc, bitDepth, pixelComponents);
+        MipMapsVector mipmaps(maxLevel);
+
+        ofxsBuildMipMaps(&effect, renderWindow, src->getPixelData(), pixelComponents, bitDepth,
+                         src->getBounds(), src->getRowBytes(), maxLevel, mipmaps);
+    }
+};
+
+// ofxsScalePixelData
+template <unsigned int levels>
+struct ScalePixelDataKernel
+{
+    template <class PIX, int nComponents, int maxValue>
+    struct Kernel
+    {
+        static void run(ImageEffect& effect,
+                        BenchImages& images,
+                        BitDepthEnum bitDepth,
+                        PixelComponentEnum pixelComponents,
+                        const OfxRectI& renderWindow)
+        {
+            const Image* src = images.get(BenchImages::eRoleSrc, bitDepth, pixelComponents);
+            Image* dst = images.get(BenchImages::eRoleDst, bitDepth, pixelComponents);
+            const OfxRectI dstWindow = Coords::downscalePowerOfTwoSmallestEnclosing(renderWindow, levels);
+            // the downscaled image is stored in the top-left corner of dst, with the same row bytes
+            OfxRectI dstBounds = dst->getBounds();
+
+            dstBounds.x1 = dstWindow.x1;
+            dstBounds.y1 = dstWindow.y1;
+            dstBounds.x2 = dstWindow.x1 + (dstBounds.x2 - dstBounds.x1);
+            dstBounds.y2 = dstWindow.y2;
+            ofxsScalePixelData(&effect, dstWindow, renderWindow, levels,
+                               src->getPixelData(), pixelComponents, bitDepth, src->getBounds(), src->getRowBytes(),
+                               dst->getPixelData(), pixelComponents, bitDepth, dstBounds, dst->getRowBytes());
+        }
+    };
+};
+
+// the Lut conversions all have the same signature
+typedef void (Color::Lut::*LutConversion)(const void* pixelData,
+                                          const OfxRectI & bounds,
+                                          PixelComponentEnum pixelComponents,
+                                          int pixelComponentCount,
+                                          BitDepthEnum bitDepth,
+                                          int rowBytes,
+                                          const OfxRectI & renderWindow,
+                                          void* dstPixelData,
+                                          const OfxRectI & dstBounds,
+                                          PixelComponentEnum dstPixelComponents,
+                                          int dstPixelComponentCount,
+                                          BitDepthEnum dstBitDepth,
+                                          int dstRowBytes) const;
+
+Color::LutManager<MultiThread::Mutex>&
+getBenchLutManager()
+{
+    static Color::LutManager<MultiThread::Mutex> lutManager;
+
+    return lutManager;
+}
+
+const Color::Lut*
+getBenchLut()
+{
+    return getBenchLutManager().sRGBLut();
+}
+
+// a Lut conversion with the sRGB Lut, between float and the integer bit depth of the configuration
+template <LutConversion conversion, bool toFloat>
+struct LutKernel
+{
+    static void run(ImageEffect& /*effect*/,
+                    BenchImages& images,
+                    BitDepthEnum bitDepth,
+                    PixelComponentEnum pixelComponents,
+                    const OfxRectI& renderWindow)
+    {
+        const Image* src = images.get(BenchImages::eRoleSrc, toFloat ? bitDepth : eBitDepthFloat, pixelComponents);
+        Image* dst = images.get(BenchImages::eRoleDst, toFloat ? eBitDepthFloat : bitDepth, pixelComponents);
+
+        ( getBenchLut()->*conversion )(src->getPixelData(), src->getBounds(), pixelComponents, src->getPixelComponentCount(),
+                                      src->getPixelDepth(), src->getRowBytes(),
+                                      renderWindow,
+                                      dst->getPixelData(), dst->getBounds(), pixelComponents, dst->getPixelComponentCount(),
+                                      dst->getPixelDepth(), dst->getRowBytes());
+    }
+};
+
+template <BitDepthEnum intBitDepth, LutConversion conversion, bool toFloat, bool rgbOnly>
+KernelFunction
+selectLutKernel(BitDepthEnum bitDepth,
+                int nComponents)
+{
+    if ( (bitDepth != intBitDepth) || (rgbOnly && (nComponents < 3)) ) {
+        return NULL;
+    }
+
+    return &LutKernel<conversion, toFloat>::run;
+}
+
+// the look transform of the benchmark Lut3D: a desaturation
+void
+benchLookTransform(float r,
+                   float g,
+                   float b,
+                   float *rOut,
+                   float *gOut,
+                   float *bOut)
+{
+    float h, s, v;
+
+    Color::rgb_to_hsv(r, g, b, &h, &s, &v);
+    Color::hsv_to_rgb(h, s * 0.8f, v, rOut, gOut, bOut);
+}
+
+// the look transform, baked in a 33^3 cube, with the sRGB Lut as a shaper
+const Color::Lut3D*
+getBenchLut3D()
+{
+    static Color::Lut3DManager<MultiThread::Mutex> lut3DManager;
+
+    return lut3DManager.getLut3D("BenchLook", 33, benchLookTransform, getBenchLut());
+}
+
+// OFX::Color::Lut3DProcessor
+template <Color::Lut3DInterpolationEnum interpolation>
+struct Lut3DKernel
+{
+    template <class PIX, int nComponents, int maxValue>
+    struct Kernel
+    {
+        static void run(ImageEffect& effect,
+                        BenchImages& images,
+                        BitDepthEnum bitDepth,
+                        PixelComponentEnum pixelComponents,
+                        const OfxRectI& renderWindow)
+        {
+            Color::Lut3DProcessor<PIX, nComponents, maxValue> processor(effect);
+
+            processor.setDstImg( images.get(BenchImages::eRoleDst, bitDepth, pixelComponents) );
+            processor.setSrcImg( images.get(BenchImages::eRoleSrc, bitDepth, pixelComponents) );
+            processor.setValues(getBenchLut3D(), interpolation);
+            processor.setRenderWindow(renderWindow, kRenderScaleOne);
+            processor.process();
+        }
+    };
+};
+
+// a camera to display conversion: SLog3 to Rec.2020 primaries, Rec.709 encoded
+const Color::ColorTransformChain&
+getBenchColorTransformChain()
+{
+    static Color::ColorTransformChain chain;
+
+    if ( chain.isIdentity() ) {
+        chain.appendFromColorSpace( getBenchLutManager().SLog3Lut() );
+        chain.appendLinearTransform( Color::rgb709_to_xyz<float> );
+        chain.appendLinearTransform( Color::xyz_to_rgb2020<float> );
+        chain.appendToColorSpace( getBenchLutManager().Rec709Lut() );
+    }
+
+    return chain;
+}
+
+// OFX::Color::ColorTransformProcessor
+template <class PIX, int nComponents, int maxValue>
+struct ColorTransformKernel
+{
+    static void run(ImageEffect& effect,
+                    BenchImages& images,
+                    BitDepthEnum bitDepth,
+                    PixelComponentEnum pixelComponents,
+                    const OfxRectI& renderWindow)
+    {
+        Color::ColorTransformProcessor<PIX, nComponents, maxValue> processor(effect);
+
+        processor.setDstImg( images.get(BenchImages::eRoleDst, bitDepth, pixelComponents) );
+        processor.setSrcImg( images.get(BenchImages::eRoleSrc, bitDepth, pixelComponents) );
+        processor.setValues( &getBenchColorTransformChain() );
+        processor.setRenderWindow(renderWindow, kRenderScaleOne);
+        processor.process();
+    }
+};
+
+struct Kernel
+{
+    const char* name;
+    KernelSelector select;
+};
+
+const Kernel kKernels[] = {
+    { "PixelCopier", &selectKernel<PixelCopierKernel> },
+    { "PixelCopierMaskMix", &selectKernel<PixelCopierMaskMixKernel> },
+    { "Transform3x3", &selectKernel<Transform3x3Kernel> },
+    { "Transform3x3MotionBlur", &selectKernel<Transform3x3MotionBlurKernel> },
+    { "ImageBlenderMasked", &selectKernel<ImageBlenderMaskedKernel> },
+    { "mergePixel<Over>", &selectFloatKernel<MergePixelKernel<MergeImages2D::eMergeOver>::Kernel> },
+    { "mergePixel<Multiply>", &selectFloatKernel<MergePixelKernel<MergeImages2D::eMergeMultiply>::Kernel> },
+    { "mergePixel<Hue>", &selectFloatKernel<MergePixelKernel<MergeImages2D::eMergeHue>::Kernel> },
+    { "ofxsBuildMipMaps", &selectKernel<BuildMipMapsKernel> },
+    { "ofxsScalePixelData<1>", &selectKernel<ScalePixelDataKernel<1>::Kernel> },
+    { "ofxsScalePixelData<2>", &selectKernel<ScalePixelDataKernel<2>::Kernel> },
+    { "ofxsScalePixelData<4>", &selectKernel<ScalePixelDataKernel<4>::Kernel> },
+    { "Lut::to_byte_packed_nodither", &selectLutKernel<eBitDepthUByte, &Color::Lut::to_byte_packed_nodither, false, false> },
+    { "Lut::to_byte_packed_dither", &selectLutKernel<eBitDepthUByte, &Color::Lut::to_byte_packed_dither, false, true> },
+    { "Lut::from_byte_packed", &selectLutKernel<eBitDepthUByte, &Color::Lut::from_byte_packed, true, false> },
+    { "Lut::to_short_packed", &selectLutKernel<eBitDepthUShort, &Color::Lut::to_short_packed, false, false> },
+    { "Lut::from_short_packed", &selectLutKernel<eBitDepthUShort, &Color::Lut::from_short_packed, true, false> },
+    { "Lut3DProcessor<Trilinear>", &selectRGBKernel<Lut3DKernel<Color::eLut3DInterpolationTrilinear>::Kernel> },
+    { "Lut3DProcessor<Tetrahedral>", &selectRGBKernel<Lut3DKernel<Color::eLut3DInterpolationTetrahedral>::Kernel> },
+    { "ColorTransformProcessor", &selectRGBKernel<ColorTransformKernel> },
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// measurements
+
+// the time of one run of the kernel, in seconds: the kernel is run at least once after a warm-up run,
+// and until minTime is elapsed
+double
+timeKernel(KernelFunction kernel,
+           ImageEffect& effect,
+           BenchImages& images,
+           BitDepthEnum bitDepth,
+           PixelComponentEnum pixelComponents,
+           double minTime)
+{
+    const OfxRectI& renderWindow = images.getBounds();
+
+    kernel(effect, images, bitDepth, pixelComponents, renderWindow);
+    int runs = 0;
+    double t0 = getPixelProcessorTime();
+    double elapsed = 0.;
+    do {
+        kernel(effect, images, bitDepth, pixelComponents, renderWindow);
+        ++runs;
+        elapsed = getPixelProcessorTime() - t0;
+    } while (elapsed < minTime);
+
+    return elapsed / runs;
+}
+
+// the multithread suite: the cost of an empty multiThread() call, and of multiThreadIndex() + multiThreadIsSpawnedThread()
+struct ThreadSuiteBench
+{
+    static const int kQueries = 1000000;
+
+    std::vector<double> queryTime;
+    double sink;
+
+    static void emptyFunction(unsigned int /*threadIndex*/,
+                              unsigned int /*threadMax*/,
+                              void * /*customArg*/)
+    {
+    }
+
+    static void queryFunction(unsigned int threadIndex,
+                              unsigned int /*threadMax*/,
+                              void *customArg)
+    {
+        ThreadSuiteBench* self = (ThreadSuiteBench*)customArg;
+        unsigned int sum = 0;
+        double t0 = getPixelProcessorTime();
+
+        for (int i = 0; i < kQueries; ++i) {
+            sum += MultiThread::getThreadIndex() + (MultiThread::isSpawnedThread() ? 1 : 0);
+        }
+        self->queryTime[threadIndex] = getPixelProcessorTime() - t0;
+        if (sum == 0) {
+            self->sink += 1.; // keep the loop
+        }
+    }
+
+    // the time of an empty multiThread() call, in seconds
+    static double dispatchTime(unsigned int nThreads,
+                               double minTime)
+    {
+        int runs = 0;
+        double t0 = getPixelProcessorTime();
+        double elapsed = 0.;
+
+        do {
+            MultiThread::multiThread(emptyFunction, nThreads, NULL);
+            ++runs;
+            elapsed = getPixelProcessorTime() - t0;
+        } while (elapsed < minTime);
+
+        return elapsed / runs;
+    }
+
+    // the time of a multiThreadIndex() and multiThreadIsSpawnedThread() query, in seconds,
+    // while nThreads threads do the same
+    double queryPairTime(unsigned int nThreads)
+    {
+        queryTime.assign(nThreads, 0.);
+        MultiThread::multiThread(queryFunction, nThreads, this);
+        double maxTime = 0.;
+        for (size_t i = 0; i < queryTime.size(); ++i) {
+            maxTime = (std::max)(maxTime, queryTime[i]);
+        }
+
+        return maxTime / kQueries;
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// command line
+
+struct Options
+{
+    unsigned int maxThreads;
+    std::vector<OfxRectI> sizes;
+    std::vector<std::string> kernels;
+    std::vector<BitDepthEnum> bitDepths;
+    std::vector<int> components;
+    double minTime;
+    std::string statsFile;
+    bool threadSuite;
+
+    Options()
+        : maxThreads(0)
+        , sizes()
+        , kernels()
+        , bitDepths()
+        , components()
+        , minTime(0.2)
+        , statsFile()
+        , threadSuite(true)
+    {
+    }
+};
+
+void
+usage(const char* argv0)
+{
+    std::printf("usage: %s [options]\n"
+                "  -t N      maximum number of threads (default: all CPUs)\n"
+                "  -s WxH    image size (may be repeated, default: 640x480 and 2048x1556)\n"
+                "  -k NAME   only run the kernels whose name contains NAME (may be repeated)\n"
+                "  -d DEPTH  only run for bit depth 8u, 16u or 32f (may be repeated)\n"
+                "  -c N      only run for N components: 1, 3 or 4 (may be repeated)\n"
+                "  -m SEC    minimum time of each measurement, in seconds (default: 0.2)\n"
+                "  -j FILE   write the PixelProcessor statistics to FILE, as JSON\n"
+                "  -n        do not benchmark the multithread suite\n"
+                "  -h        print this help\n",
+                argv0);
+}
+
+bool
+parseOptions(int argc,
+             char** argv,
+             Options* options)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = (i + 1 < argc);
+        if (arg == "-h") {
+            return false;
+        } else if (arg == "-n") {
+            options->threadSuite = false;
+        } else if (!hasValue) {
+            std::fprintf(stderr, "missing value for option %s\n", arg.c_str());
+
+            return false;
+        } else if (arg == "-t") {
+            options->maxThreads = (unsigned int)std::atoi(argv[++i]);
+        } else if (arg == "-s") {
+            int w = 0, h = 0;
+            if ( (std::sscanf(argv[++i], "%dx%d", &w, &h) != 2) || (w <= 0) || (h <= 0) ) {
+                std::fprintf(stderr, "invalid size %s\n", argv[i]);
+
+                return false;
+            }
+            OfxRectI size = { 0, 0, w, h };
+            options->sizes.push_back(size);
+        } else if (arg == "-k") {
+            options->kernels.push_back(argv[++i]);
+        } else if (arg == "-d") {
+            const std::string depth = argv[++i];
+            if (depth == "8u") {
+                options->bitDepths.push_back(eBitDepthUByte);
+            } else if (depth == "16u") {
+                options->bitDepths.push_back(eBitDepthUShort);
+            } else if (depth == "32f") {
+                options->bitDepths.push_back(eBitDepthFloat);
+            } else {
+                std::fprintf(stderr, "invalid bit depth %s\n", depth.c_str());
+
+                return false;
+            }
+        } else if (arg == "-c") {
+            const int n = std::atoi(argv[++i]);
+            if ( (n != 1) && (n != 3) && (n != 4) ) {
+                std::fprintf(stderr, "invalid number of components %s\n", argv[i]);
+
+                return false;
+            }
+            options->components.push_back(n);
+        } else if (arg == "-m") {
+            options->minTime = std::atof(argv[++i]);
+        } else if (arg == "-j") {
+            options->statsFile = argv[++i];
+        } else {
+            std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+
+            return false;
+        }
+    }
+    if ( options->sizes.empty() ) {
+        OfxRectI sd = { 0, 0, 640, 480 };
+        OfxRectI film2k = { 0, 0, 2048, 1556 };
+        options->sizes.push_back(sd);
+        options->sizes.push_back(film2k);
+    }
+    if ( options->bitDepths.empty() ) {
+        options->bitDepths.push_back(eBitDepthUByte);
+        options->bitDepths.push_back(eBitDepthUShort);
+        options->bitDepths.push_back(eBitDepthFloat);
+    }
+    if ( options->components.empty() ) {
+        options->components.push_back(1);
+        options->components.push_back(3);
+        options->components.push_back(4);
+    }
+
+    return true;
+}
+
+bool
+kernelSelected(const Options& options,
+               const char* name)
+{
+    if ( options.kernels.empty() ) {
+        return true;
+    }
+    for (size_t i = 0; i < options.kernels.size(); ++i) {
+        if ( std::strstr( name, options.kernels[i].c_str() ) ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// 1, 2, 4, ... up to maxThreads, and maxThreads
+std::vector<unsigned int>
+getThreadCounts(unsigned int maxThreads)
+{
+    std::vector<unsigned int> counts;
+
+    for (unsigned int n = 1; n < maxThreads; n *= 2) {
+        counts.push_back(n);
+    }
+    counts.push_back(maxThreads);
+
+    return counts;
+}
+
+void
+runKernels(const Options& options,
+           ImageEffect& effect,
+           const std::vector<unsigned int>& threadCounts)
+{
+    std::printf("%-30s %5s %5s %11s %7s %10s %8s\n", "# kernel", "depth", "comps", "size", "threads", "Mpix/s", "speedup");
+    for (size_t s = 0; s < options.sizes.size(); ++s) {
+        const OfxRectI& bounds = options.sizes[s];
+        const double pixels = (double)(bounds.x2 - bounds.x1) * (bounds.y2 - bounds.y1);
+        char size[32];
+        std::sprintf(size, "%dx%d", bounds.x2 - bounds.x1, bounds.y2 - bounds.y1);
+        BenchImages images(bounds);
+        for (size_t d = 0; d < options.bitDepths.size(); ++d) {
+            const BitDepthEnum bitDepth = options.bitDepths[d];
+            for (size_t c = 0; c < options.components.size(); ++c) {
+                const PixelComponentEnum pixelComponents = getPixelComponents(options.components[c]);
+                for (size_t k = 0; k < sizeof(kKernels) / sizeof(kKernels[0]); ++k) {
+                    if ( !kernelSelected(options, kKernels[k].name) ) {
+                        continue;
+                    }
+                    KernelFunction kernel = kKernels[k].select( bitDepth, getComponentCount(pixelComponents) );
+                    if (!kernel) {
+                        continue;
+                    }
+                    double singleThreadTime = 0.;
+                    for (size_t t = 0; t < threadCounts.size(); ++t) {
+                        MockHost::setMaxThreads(threadCounts[t]);
+                        const double time = timeKernel(kernel, effect, images, bitDepth, pixelComponents, options.minTime);
+                        if (t == 0) {
+                            singleThreadTime = time;
+                        }
+                        std::printf("%-30s %5s %5d %11s %7u %10.1f %8.2f\n",
+                                    kKernels[k].name, getBitDepthName(bitDepth), getComponentCount(pixelComponents), size,
+                                    threadCounts[t], pixels / time * 1e-6, singleThreadTime / time);
+                        std::fflush(stdout);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void
+runThreadSuite(const Options& options,
+               const std::vector<unsigned int>& threadCounts)
+{
+    ThreadSuiteBench bench;
+
+    bench.sink = 0.;
+    MockHost::setMaxThreads(0);
+    std::printf("\n%-30s %7s %16s %16s\n", "# multithread suite", "threads", "multiThread (us)", "index+spawn (ns)");
+    for (size_t t = 0; t < threadCounts.size(); ++t) {
+        const double dispatch = ThreadSuiteBench::dispatchTime(threadCounts[t], options.minTime);
+        const double query = bench.queryPairTime(threadCounts[t]);
+        std::printf("%-30s %7u %16.2f %16.2f\n", "ofxsThreadSuite", threadCounts[t], dispatch * 1e6, query * 1e9);
+        std::fflush(stdout);
+    }
+}
+} // anonymous namespace
+
+int
+main(int argc,
+     char** argv)
+{
+    Options options;
+
+    if ( !parseOptions(argc, argv, &options) ) {
+        usage(argv[0]);
+
+        return 1;
+    }
+    MockHost::install();
+    if (options.maxThreads == 0) {
+        options.maxThreads = MockHost::getNumCPUs();
+    }
+    if ( !options.statsFile.empty() ) {
+        setPixelProcessorStatsSink( &PixelProcessorStatsRegistry::instance() );
+    }
+    const std::vector<unsigned int> threadCounts = getThreadCounts(options.maxThreads);
+    ImageEffect* effect = NULL;
+    int ret = 0;
+    try {
+        effect = MockHost::createEffect();
+        runKernels(options, *effect, threadCounts);
+        if (options.threadSuite) {
+            runThreadSuite(options, threadCounts);
+        }
+    } catch (const std::exception& e) {
+        std::fprintf( stderr, "error: %s\n", e.what() );
+        ret = 1;
+    }
+    MockHost::destroyEffect(effect);
+    ofxsThreadSuiteShutdown();
+    if ( !options.statsFile.empty() ) {
+        setPixelProcessorStatsSink(NULL);
+        if ( !PixelProcessorStatsRegistry::instance().writeJSON(options.statsFile) ) {
+            std::fprintf( stderr, "error: could not write %s\n", options.statsFile.c_str() );
+            ret = 1;
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,219 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/NatronGitHub/openfx-supportext>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * OFX composite color transforms: chains of 1D curves and 3x3 matrices, applied in a single pass.
+ */
+
+#include "ofxsColorTransform.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace OFX {
+namespace Color {
+namespace {
+// the coefficients of the matrices of ofxsLut.h have 7 significant digits, so that a conversion followed
+// by its inverse is only the identity up to about that precision
+const double kIdentityTolerance = 1e-6;
+
+bool
+isIdentityMatrix(const double m[3][3])
+{
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            if (std::fabs(m[i][j] - (i == j ? 1. : 0.)) > kIdentityTolerance) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+} // anon namespace
+
+void
+ColorTransformChain::appendCurve(StepTypeEnum type,
+                                 const Lut* lut)
+{
+    assert(lut && type != eStepMatrix);
+    if (!lut) {
+        return;
+    }
+    if ( !_steps.empty() && (_steps.back().lut == lut) && (_steps.back().type != type) ) {
+        // the curve cancels the previous one
+        _steps.pop_back();
+
+        return;
+    }
+    Step step;
+    step.type = type;
+    step.lut = lut;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            step.matrix[i][j] = (i == j) ? 1. : 0.;
+        }
+    }
+    _steps.push_back(step);
+}
+
+void
+ColorTransformChain::appendMatrix(const double matrix[3][3])
+{
+    if ( !_steps.empty() && (_steps.back().type == eStepMatrix) ) {
+        // fold it into the previous matrix
+        Step& last = _steps.back();
+        double product[3][3];
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                product[i][j] = matrix[i][0] * last.matrix[0][j] + matrix[i][1] * last.matrix[1][j] + matrix[i][2] * last.matrix[2][j];
+            }
+        }
+        if ( isIdentityMatrix(product) ) {
+            _steps.pop_back();
+        } else {
+            std::copy(&product[0][0], &product[0][0] + 9, &last.matrix[0][0]);
+        }
+
+        return;
+    }
+    if ( isIdentityMatrix(matrix) ) {
+        return;
+    }
+    Step step;
+    step.type = eStepMatrix;
+    step.lut = NULL;
+    std::copy(&matrix[0][0], &matrix[0][0] + 9, &step.matrix[0][0]);
+    _steps.push_back(step);
+}
+
+void
+ColorTransformChain::appendLinearTransform(colorTransformFunctionV1 func)
+{
+    assert(func);
+    if (!func) {
+        return;
+    }
+    double matrix[3][3];
+    for (int j = 0; j < 3; ++j) {
+        // column j is the transform of the unit vector j
+        float out[3];
+        func(j == 0 ? 1.f : 0.f, j == 1 ? 1.f : 0.f, j == 2 ? 1.f : 0.f, &out[0], &out[1], &out[2]);
+        for (int i = 0; i < 3; ++i) {
+            matrix[i][j] = out[i];
+        }
+    }
+    appendMatrix(matrix);
+}
+
+void
+ColorTransformChain::append(const ColorTransformChain& other)
+{
+    // copy the steps first, in case other is this chain
+    const std::vector<Step> steps = other._steps;
+
+    for (std::vector<Step>::const_iterator it = steps.begin(); it != steps.end(); ++it) {
+        if (it->type == eStepMatrix) {
+            appendMatrix(it->matrix);
+        } else {
+            appendCurve(it->type, it->lut);
+        }
+    }
+}
+
+void
+ColorTransformChain::apply(float r,
+                           float g,
+                           float b,
+                           float *rOut,
+                           float *gOut,
+                           float *bOut) const
+{
+    float rgb[3] = { r, g, b };
+
+    // same as the array version
+    apply(rgb, rgb, 1, 3);
+    *rOut = rgb[0];
+    *gOut = rgb[1];
+    *bOut = rgb[2];
+}
+
+void
+ColorTransformChain::apply(const float* src,
+                           float* dst,
+                           int n,
+                           int nComponents) const
+{
+    assert(nComponents == 3 || nComponents == 4);
+    // All the steps are applied to a block of pixels, which is stored in planar form (all the reds, then all
+    // the greens, then all the blues) in a buffer that stays in the L1 cache: a curve is a single batch conversion
+    // of the block, and the loops of the matrices are vectorized by the compiler.
+    const int kBlockSize = 256;
+    float planes[3 * kBlockSize];
+
+    for (int start = 0; start < n; start += kBlockSize) {
+        const int count = (std::min)(kBlockSize, n - start);
+        const float* blockSrc = src + (size_t)start * nComponents;
+        float* blockDst = dst + (size_t)start * nComponents;
+        float* R = planes;
+        float* G = planes + count;
+        float* B = planes + 2 * count;
+        for (int i = 0; i < count; ++i) {
+            R[i] = blockSrc[i * nComponents];
+            G[i] = blockSrc[i * nComponents + 1];
+            B[i] = blockSrc[i * nComponents + 2];
+        }
+        for (std::vector<Step>::const_iterator it = _steps.begin(); it != _steps.end(); ++it) {
+            switch (it->type) {
+            case eStepFromColorSpace:
+                it->lut->fromColorSpaceFloatToLinearFloatFast(planes, planes, 3 * count);
+                break;
+            case eStepToColorSpace:
+                it->lut->toColorSpaceFloatFromLinearFloatFast(planes, planes, 3 * count);
+                break;
+            case eStepMatrix: {
+                const float m00 = (float)it->matrix[0][0], m01 = (float)it->matrix[0][1], m02 = (float)it->matrix[0][2];
+                const float m10 = (float)it->matrix[1][0], m11 = (float)it->matrix[1][1], m12 = (float)it->matrix[1][2];
+                const float m20 = (float)it->matrix[2][0], m21 = (float)it->matrix[2][1], m22 = (float)it->matrix[2][2];
+                for (int i = 0; i < count; ++i) {
+                    const float r = R[i];
+                    const float g = G[i];
+                    const float b = B[i];
+                    R[i] = m00 * r + m01 * g + m02 * b;
+                    G[i] = m10 * r + m11 * g + m12 * b;
+                    B[i] = m20 * r + m21 * g + m22 * b;
+                }
+                break;
+            }
+            }
+        }
+        // the alpha channel of blockSrc is not modified when src and dst are the same
+        for (int i = 0; i < count; ++i) {
+            blockDst[i * nComponents] = R[i];
+            blockDst[i * nComponents + 1] = G[i];
+            blockDst[i * nComponents + 2] = B[i];
+            if ( (nComponents == 4) && (blockDst != blockSrc) ) {
+                blockDst[i * 4 + 3] = blockSrc[i * 4 + 3];
+            }
+        }
+    }
+} // ColorTransformChain::apply
+}         //namespace Color
+}     //namespace OFX
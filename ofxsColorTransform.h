@@ -0,0 +1,182 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/NatronGitHub/openfx-supportext>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * OFX composite color transforms: chains of 1D curves and 3x3 matrices, applied in a single pass.
+ */
+
+#ifndef openfx_supportext_ofxsColorTransform_h
+#define openfx_supportext_ofxsColorTransform_h
+
+#include <vector>
+#include <cassert>
+
+#include "ofxsImageEffect.h"
+#include "ofxsMacros.h"
+#include "ofxsPixelProcessor.h"
+#include "ofxsRGBRowTransformProcessor.h"
+#include "ofxsLut.h"
+
+namespace OFX {
+namespace Color {
+/**
+ * @brief A color transform made of a chain of steps, each of which is either a 1D curve (the conversion
+ * from or to the color-space of a Lut, applied to r, g and b) or a 3x3 matrix (e.g. a primaries conversion).
+ * For example, "SLog3 to Rec.2020 Rec709-encoded" is:
+ *   chain.appendFromColorSpace( lutManager.SLog3Lut() );
+ *   chain.appendLinearTransform( rgb709_to_xyz<float> );
+ *   chain.appendLinearTransform( xyz_to_rgb2020<float> );
+ *   chain.appendToColorSpace( lutManager.Rec709Lut() );
+ *
+ * The chain is simplified as it is built: consecutive matrices are folded into a single matrix (computed in
+ * double precision), matrices which are the identity are removed, and a curve followed by its inverse (the same
+ * Lut in the other direction) is removed.
+ * apply() runs all the steps on blocks of pixels which stay in the L1 cache, so that each pixel is read and
+ * written once, instead of once per step. The curves use the fast (interpolated) Lut conversions.
+ *
+ * The Luts are not owned by the chain, and must outlive it.
+ **/
+class ColorTransformChain
+{
+public:
+    enum StepTypeEnum
+    {
+        eStepFromColorSpace = 0, // lut->fromColorSpaceFloatToLinearFloatFast()
+        eStepToColorSpace,       // lut->toColorSpaceFloatFromLinearFloatFast()
+        eStepMatrix              // out = matrix * (r, g, b)
+    };
+
+    struct Step
+    {
+        StepTypeEnum type;
+        const Lut* lut;          // the curve, or NULL for a matrix
+        double matrix[3][3];     // row-major: out[i] = sum_j matrix[i][j] * in[j]
+    };
+
+    ColorTransformChain()
+        : _steps()
+    {
+    }
+
+    /// appends the conversion from the color-space of lut to linear
+    void appendFromColorSpace(const Lut* lut)
+    {
+        appendCurve(eStepFromColorSpace, lut);
+    }
+
+    /// appends the conversion from linear to the color-space of lut
+    void appendToColorSpace(const Lut* lut)
+    {
+        appendCurve(eStepToColorSpace, lut);
+    }
+
+    /// appends a 3x3 matrix, in row-major order
+    void appendMatrix(const double matrix[3][3]);
+
+    /**
+     * @brief Appends a linear color transform, such as the primaries conversions of ofxsLut.h
+     * (e.g. xyz_to_rgb2020<float>), as a matrix. The matrix is obtained by transforming the unit
+     * vectors, so the transform must be linear.
+     **/
+    void appendLinearTransform(colorTransformFunctionV1 func);
+
+    /// appends all the steps of another chain
+    void append(const ColorTransformChain& other);
+
+    void clear()
+    {
+        _steps.clear();
+    }
+
+    /// true if the chain is the identity (after simplification)
+    bool isIdentity() const
+    {
+        return _steps.empty();
+    }
+
+    /// the simplified steps
+    const std::vector<Step>& getSteps() const
+    {
+        return _steps;
+    }
+
+    /* @brief Transforms a color.
+     * This function is not fast, use the array version for images.
+     */
+    void apply(float r,
+               float g,
+               float b,
+               float *rOut,
+               float *gOut,
+               float *bOut) const;
+
+    /* @brief Transforms n packed RGB (nComponents = 3) or RGBA (nComponents = 4) pixels.
+     * The alpha channel is copied. src and dst may be the same buffer.
+     */
+    void apply(const float* src,
+               float* dst,
+               int n,
+               int nComponents) const;
+
+private:
+    void appendCurve(StepTypeEnum type, const Lut* lut);
+
+    std::vector<Step> _steps;
+};
+
+/**
+ * @brief Applies a ColorTransformChain to an RGB or RGBA image. The alpha channel is copied.
+ * Integer images are converted to floats in [0, 1] before the transform, and the result is clamped.
+ **/
+template <class PIX, int nComponents, int maxValue>
+class ColorTransformProcessor
+    : public OFX::RGBRowTransformProcessor<PIX, nComponents, maxValue, ColorTransformProcessor<PIX, nComponents, maxValue> >
+{
+    friend class OFX::RGBRowTransformProcessor<PIX, nComponents, maxValue, ColorTransformProcessor>;
+
+    const ColorTransformChain* _chain;
+
+public:
+    ColorTransformProcessor(OFX::ImageEffect &instance)
+        : OFX::RGBRowTransformProcessor<PIX, nComponents, maxValue, ColorTransformProcessor>(instance)
+        , _chain(NULL)
+    {
+    }
+
+    /// the chain must not be modified while the processor runs
+    void setValues(const ColorTransformChain* chain)
+    {
+        _chain = chain;
+    }
+
+private:
+    void apply(const float* src,
+               float* dst,
+               int n,
+               int nComps) const
+    {
+        assert(_chain);
+        _chain->apply(src, dst, n, nComps);
+    }
+};
+}         //namespace Color
+}     //namespace OFX
+
+#endif // ifndef openfx_supportext_ofxsColorTransform_h
@@ -65,8 +65,6 @@ public:
             procWindow.y2 = _dstBounds.y2;
         }
 
-        int rowBytes = sizeof(PIX) * nComponents * (procWindow.x2 - procWindow.x1);
-
         for (int dsty = procWindow.y1; dsty < procWindow.y2; ++dsty) {
             if ( _effect.abort() ) {
                 break;
@@ -79,139 +77,37 @@ public:
                 continue;
             }
 
-            int srcy = dsty;
-
-            if (_srcBoundary == 1) {
-                if (_srcBounds.y2 <= srcy) {
-                    srcy = _srcBounds.y2 - 1;
-                }
-                if (srcy < _srcBounds.y1) {
-                    srcy = _srcBounds.y1;
-                }
-            } else if (_srcBoundary == 2) {
-                if ( (srcy < _srcBounds.y1) || (_srcBounds.y2 <= srcy) ) {
-                    srcy = _srcBounds.y1 + positive_modulo(srcy - _srcBounds.y1, _srcBounds.y2 - _srcBounds.y1);
-                }
-            }
-
-            if ( (srcy < _srcBounds.y1) || (_srcBounds.y2 <= srcy) || (_srcBounds.y2 <= _srcBounds.y1) ) {
-                assert(_srcBoundary == 0);
-                std::memset(dstPix, 0, rowBytes);
-            } else {
-                int x1 = (std::max)(_srcBounds.x1, procWindow.x1);
-                int x2 = (std::min)(_srcBounds.x2, procWindow.x2);
-                // start of line may be black
-                if (procWindow.x1 < x1) {
-                    if ( (_srcBoundary != 1) && (_srcBoundary != 2) ) {
-                        std::memset( dstPix, 0, sizeof(PIX) * nComponents * (x1 - procWindow.x1) );
-                        dstPix += nComponents * (x1 - procWindow.x1);
-                    } else if (_srcBoundary == 1) {
-                        const PIX *srcPix = (const PIX *) getSrcPixelAddress(x1, srcy);
-                        assert(srcPix);
-                        if (!srcPix) {
-                            std::memset( dstPix, 0, sizeof(PIX) * nComponents * (x1 - procWindow.x1) );
-                            dstPix += nComponents * (x1 - procWindow.x1);
-                        } else {
-#                        ifdef DEBUG
-                            for (int c = 0; c < nComponents; ++c) {
-                                assert( !OFX::IsNaN(srcPix[c]) ); // check for NaN
-                            }
-#                        endif
-                            for (int x = procWindow.x1; x < x1; ++x) {
-                                std::copy(srcPix, srcPix + nComponents, dstPix);
-                                dstPix += nComponents;
-                            }
-                        }
-                    } else if (_srcBoundary == 2) {
-                        int srcx = procWindow.x1;
-                        if ( (srcx < _srcBounds.x1) || (_srcBounds.x2 <= srcx) ) {
-                            srcx = _srcBounds.x1 + positive_modulo(srcx - _srcBounds.x1, _srcBounds.x2 - _srcBounds.x1);
-                        }
+            const OFX::PixelRowSpan<PIX> srcRow = getSrcRowSpan<PIX>(dsty);
 
-                        const PIX *srcPix = (const PIX *) getSrcPixelAddress(srcx, srcy);
-                        assert(srcPix);
-                        if (!srcPix) {
-                            std::memset( dstPix, 0, sizeof(PIX) * nComponents * (x1 - procWindow.x1) );
-                            dstPix += nComponents * (x1 - procWindow.x1);
-                        } else {
-                            for (int x = procWindow.x1; x < x1; ++x) {
-#                             ifdef DEBUG
-                                for (int c = 0; c < nComponents; ++c) {
-                                    assert( !OFX::IsNaN(srcPix[c]) ); // check for NaN
-                                }
-#                             endif
-                                std::copy(srcPix, srcPix + nComponents, dstPix);
-                                dstPix += nComponents;
-                                ++srcx;
-                                if (_srcBounds.x2 <= srcx) {
-                                    srcx -= (_srcBounds.x2 - _srcBounds.x1);
-                                    srcPix -= (_srcBounds.x2 - _srcBounds.x1) * nComponents;
-                                }
-                            }
-                        }
+            for (int x = procWindow.x1; x < procWindow.x2; ) {
+                const PIX *srcPix;
+                int srcStride;
+                const int xEnd = srcRow.getSegment(x, procWindow.x2, &srcPix, &srcStride);
+                const int n = xEnd - x;
+                if (!srcPix) {
+                    // no src pixel here, be black and transparent
+                    std::memset( dstPix, 0, sizeof(PIX) * nComponents * n );
+                } else if (srcStride == nComponents) {
+#                 ifdef DEBUG
+                    for (int c = 0; c < nComponents * n; ++c) {
+                        assert( !OFX::IsNaN(srcPix[c]) ); // check for NaN
                     }
-                }
-                // then, copy the relevant fraction of src
-                if ( (x1 < x2) && (procWindow.x1 <= x1) && (x2 <= procWindow.x2) ) {
-                    const PIX *srcPix = (const PIX *) getSrcPixelAddress(x1, srcy);
-                    assert(srcPix);
-                    if (!srcPix) {
-                        std::memset( dstPix, 0, sizeof(PIX) * nComponents * (x2 - x1) );
-                    } else {
+#                 endif
+                    std::memcpy( dstPix, srcPix, sizeof(PIX) * nComponents * n );
+                } else {
+                    // repeated pixel (nearest boundary condition), or src with a different number of components
+                    PIX *dst = dstPix;
+                    for (int i = 0; i < n; ++i, srcPix += srcStride, dst += nComponents) {
 #                     ifdef DEBUG
-                        for (int c = 0; c < nComponents * (x2 - x1); ++c) {
+                        for (int c = 0; c < nComponents; ++c) {
                             assert( !OFX::IsNaN(srcPix[c]) ); // check for NaN
                         }
 #                     endif
-                        std::memcpy( dstPix, srcPix, sizeof(PIX) * nComponents * (x2 - x1) );
-                    }
-                    dstPix += nComponents * (x2 - x1);
-                }
-                // end of line may be black
-                if (x2 < procWindow.x2) {
-                    if ( (_srcBoundary != 1) && (_srcBoundary != 2) ) {
-                        std::memset( dstPix, 0, sizeof(PIX) * nComponents * (procWindow.x2 - x2) );
-                        dstPix += nComponents * (procWindow.x2 - x2);
-                    } else if (_srcBoundary == 1) {
-                        const PIX *srcPix = (const PIX *) getSrcPixelAddress(x2 - 1, srcy);
-                        assert(srcPix);
-                        if (!srcPix) {
-                            std::memset( dstPix, 0, sizeof(PIX) * nComponents * (procWindow.x2 - x2) );
-                        } else {
-                            for (int x = x2; x < procWindow.x2; ++x) {
-                                std::memcpy( dstPix, srcPix, sizeof(PIX) * nComponents );
-                                dstPix += nComponents;
-                            }
-                        }
-                    } else if (_srcBoundary == 2) {
-                        int srcx = x2;
-                        while (_srcBounds.x2 <= srcx) {
-                            srcx -= (_srcBounds.x2 - _srcBounds.x1);
-                        }
-
-                        const PIX *srcPix = (const PIX *) getSrcPixelAddress(srcx, srcy);
-                        assert(srcPix);
-                        if (!srcPix) {
-                            std::memset( dstPix, 0, sizeof(PIX) * nComponents * (procWindow.x2 - x2) );
-                            dstPix += nComponents * (procWindow.x2 - x2);
-                        } else {
-                            for (int x = x2; x < procWindow.x2; ++x) {
-#                             ifdef DEBUG
-                                for (int c = 0; c < nComponents; ++c) {
-                                    assert( !OFX::IsNaN(srcPix[c]) ); // check for NaN
-                                }
-#                             endif
-                                std::copy(srcPix, srcPix + nComponents, dstPix);
-                                dstPix += nComponents;
-                                ++srcx;
-                                if (_srcBounds.x2 <= srcx) {
-                                    srcx -= (_srcBounds.x2 - _srcBounds.x1);
-                                    srcPix -= (_srcBounds.x2 - _srcBounds.x1) * nComponents;
-                                }
-                            }
-                        }
+                        std::copy(srcPix, srcPix + nComponents, dst);
                     }
                 }
+                dstPix += nComponents * n;
+                x = xEnd;
             }
         }
     } // multiThreadProcessImages
@@ -257,21 +153,6 @@ public:
                 break;
             }
 
-            int srcy = dsty;
-
-            if (_srcBoundary == 1) {
-                if (_srcBounds.y2 <= srcy) {
-                    srcy = _srcBounds.y2 - 1;
-                }
-                if (srcy < _srcBounds.y1) {
-                    srcy = _srcBounds.y1;
-                }
-            } else if (_srcBoundary == 2) {
-                if ( (srcy < _srcBounds.y1) || (_srcBounds.y2 <= srcy) ) {
-                    srcy = _srcBounds.y1 + positive_modulo(srcy - _srcBounds.y1, _srcBounds.y2 - _srcBounds.y1);
-                }
-            }
-
             PIX *dstPix = (PIX *) getDstPixelAddress(procWindow.x1, dsty);
             assert(dstPix);
             if (!dstPix) {
@@ -279,32 +160,26 @@ public:
                 continue;
             }
 
-            for (int dstx = procWindow.x1; dstx < procWindow.x2; ++dstx) {
-                int srcx = dstx;
+            const OFX::PixelRowSpan<PIX> srcRow = getSrcRowSpan<PIX>(dsty);
 
-                if (_srcBoundary == 1) {
-                    if (_srcBounds.x2 <= srcx) {
-                        srcx = _srcBounds.x2 - 1;
-                    }
-                    if (srcx < _srcBounds.x1) {
-                        srcx = _srcBounds.x1;
-                    }
-                } else if (_srcBoundary == 2) {
-                    if ( (srcx < _srcBounds.x1) || (_srcBounds.x2 <= srcx) ) {
-                        srcx = _srcBounds.x1 + positive_modulo(srcx - _srcBounds.x1, _srcBounds.x2 - _srcBounds.x1);
-                    }
+            for (int x = procWindow.x1; x < procWindow.x2; ) {
+                const PIX *srcPix;
+                int srcStride;
+                const int xEnd = srcRow.getSegment(x, procWindow.x2, &srcPix, &srcStride);
+                if (!srcPix) {
+                    // no src pixel here, be black and transparent
+                    std::fill( dstPix, dstPix + nComponents * (xEnd - x), PIX() );
+                    dstPix += nComponents * (xEnd - x);
+                    x = xEnd;
+                    continue;
                 }
-
-                // origPix is at dstx,dsty
-                const PIX *srcPix = (const PIX *) getSrcPixelAddress(srcx, srcy);
-                if (srcPix) {
+                for (; x < xEnd; ++x) {
                     std::copy(srcPix, srcPix + nComponents - 1, dstPix);
                     dstPix[nComponents - 1] = maxValue;
-                } else {
-                  std::fill( dstPix, dstPix + nComponents, PIX() ); // no src pixel here, be black and transparent
+                    srcPix += srcStride;
+                    // increment the dst pixel
+                    dstPix += nComponents;
                 }
-                // increment the dst pixel
-                dstPix += nComponents;
             }
         }
     } // multiThreadProcessImages
@@ -348,21 +223,6 @@ public:
                 break;
             }
 
-            int srcy = dsty;
-
-            if (_srcBoundary == 1) {
-                if (_srcBounds.y2 <= srcy) {
-                    srcy = _srcBounds.y2 - 1;
-                }
-                if (srcy < _srcBounds.y1) {
-                    srcy = _srcBounds.y1;
-                }
-            } else if (_srcBoundary == 2) {
-                if ( (srcy < _srcBounds.y1) || (_srcBounds.y2 <= srcy) ) {
-                    srcy = _srcBounds.y1 + positive_modulo(srcy - _srcBounds.y1, _srcBounds.y2 - _srcBounds.y1);
-                }
-            }
-
             PIX *dstPix = (PIX *) getDstPixelAddress(procWindow.x1, dsty);
             assert(dstPix);
             if (!dstPix) {
@@ -370,34 +230,30 @@ public:
                 continue;
             }
 
-            for (int dstx = procWindow.x1; dstx < procWindow.x2; ++dstx) {
-                int srcx = dstx;
-
-                if (_srcBoundary == 1) {
-                    if (_srcBounds.x2 <= srcx) {
-                        srcx = _srcBounds.x2 - 1;
-                    }
-                    if (srcx < _srcBounds.x1) {
-                        srcx = _srcBounds.x1;
-                    }
-                } else if (_srcBoundary == 2) {
-                    if ( (srcx < _srcBounds.x1) || (_srcBounds.x2 <= srcx) ) {
-                        srcx = _srcBounds.x1 + positive_modulo(srcx - _srcBounds.x1, _srcBounds.x2 - _srcBounds.x1);
+            const OFX::PixelRowSpan<PIX> srcRow = getSrcRowSpan<PIX>(dsty);
+            // dstx,dsty are the orig and mask image coordinates (no boundary conditions)
+            const OFX::PixelRowSpan<PIX> origRow(_origImg, dsty);
+            const OFX::PixelRowSpan<PIX> maskRow( (masked && _doMasking) ? _maskImg : NULL, dsty );
+
+            for (int dstx = procWindow.x1; dstx < procWindow.x2; ) {
+                const PIX *srcPix, *origPix, *maskPix;
+                int srcStride, origStride, maskStride;
+                int xEnd = srcRow.getSegment(dstx, procWindow.x2, &srcPix, &srcStride);
+                xEnd = origRow.getSegment(dstx, xEnd, &origPix, &origStride);
+                xEnd = maskRow.getSegment(dstx, xEnd, &maskPix, &maskStride);
+                for (; dstx < xEnd; ++dstx) {
+                    if (srcPix) {
+                        std::copy(srcPix, srcPix + nComponents, tmpPix);
+                    } else {
+                        std::fill(tmpPix, tmpPix + nComponents, 0.f); // no src pixel here, be black and transparent
                     }
+                    ofxsMaskMixPixWithMask<PIX, nComponents, maxValue, masked>(tmpPix, maskPix, origPix, _doMasking, (float)_mix, _maskInvert, dstPix);
+                    srcPix += srcStride;
+                    origPix += origStride;
+                    maskPix += maskStride;
+                    // increment the dst pixel
+                    dstPix += nComponents;
                 }
-
-                // origPix is at dstx,dsty
-                const PIX *origPix = (const PIX *)  (_origImg ? _origImg->getPixelAddress(dstx, dsty) : 0);
-                const PIX *srcPix = (const PIX *) getSrcPixelAddress(srcx, srcy);
-                if (srcPix) {
-                    std::copy(srcPix, srcPix + nComponents, tmpPix);
-                } else {
-                    std::fill(tmpPix, tmpPix + nComponents, 0.f); // no src pixel here, be black and transparent
-                }
-                // dstx,dsty are the mask image coordinates (no boundary conditions)
-                ofxsMaskMixPix<PIX, nComponents, maxValue, masked>(tmpPix, dstx, dsty, origPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
-                // increment the dst pixel
-                dstPix += nComponents;
             }
         }
     } // multiThreadProcessImages
@@ -441,59 +297,36 @@ public:
                 break;
             }
 
-            int srcy = dsty;
-
-            if (_srcBoundary == 1) {
-                if (_srcBounds.y2 <= srcy) {
-                    srcy = _srcBounds.y2 - 1;
-                }
-                if (srcy < _srcBounds.y1) {
-                    srcy = _srcBounds.y1;
-                }
-            } else if (_srcBoundary == 2) {
-                if ( (srcy < _srcBounds.y1) || (_srcBounds.y2 <= srcy) ) {
-                    srcy = _srcBounds.y1 + positive_modulo(srcy - _srcBounds.y1, _srcBounds.y2 - _srcBounds.y1);
-                }
-            }
-
             DSTPIX *dstPix = (DSTPIX *) getDstPixelAddress(procWindow.x1, dsty);
             assert(dstPix);
             if (!dstPix) {
                 // coverity[dead_error_line]
                 continue;
             }
-            
-            for (int dstx = procWindow.x1; dstx < procWindow.x2; ++dstx) {
-                int srcx = dstx;
 
-                if (_srcBoundary == 1) {
-                    if (_srcBounds.x2 <= srcx) {
-                        srcx = _srcBounds.x2 - 1;
-                    }
-                    if (srcx < _srcBounds.x1) {
-                        srcx = _srcBounds.x1;
-                    }
-                } else if (_srcBoundary == 2) {
-                    if ( (srcx < _srcBounds.x1) || (_srcBounds.x2 <= srcx) ) {
-                        srcx = _srcBounds.x1 + positive_modulo(srcx - _srcBounds.x1, _srcBounds.x2 - _srcBounds.x1);
-                    }
-                }
+            const OFX::PixelRowSpan<SRCPIX> srcRow = getSrcRowSpan<SRCPIX>(dsty);
 
-                const SRCPIX *srcPix = (const SRCPIX *) getSrcPixelAddress(srcx, srcy);
+            for (int x = procWindow.x1; x < procWindow.x2; ) {
+                const SRCPIX *srcPix;
+                int srcStride;
+                const int xEnd = srcRow.getSegment(x, procWindow.x2, &srcPix, &srcStride);
                 if (!srcPix) {
                     // no source, be black and transparent
-                    for (int c = 0; c < dstNComponents; ++c) {
-                        dstPix[c] = DSTPIX();
-                    }
-                } else {
+                    std::fill( dstPix, dstPix + dstNComponents * (xEnd - x), DSTPIX() );
+                    dstPix += dstNComponents * (xEnd - x);
+                    x = xEnd;
+                    continue;
+                }
+                for (; x < xEnd; ++x) {
                     ofxsUnPremult<SRCPIX, srcNComponents, srcMaxValue>(srcPix, unpPix, _premult, _premultChannel);
                     for (int c = 0; c < dstNComponents; ++c) {
                         float v = unpPix[c] * dstMaxValue;
                         dstPix[c] = ofxsClampIfInt<DSTPIX, dstMaxValue>(v, 0, dstMaxValue);
                     }
+                    srcPix += srcStride;
+                    // increment the dst pixel
+                    dstPix += dstNComponents;
                 }
-                // increment the dst pixel
-                dstPix += dstNComponents;
             }
         }
     } // multiThreadProcessImages
@@ -536,21 +369,6 @@ public:
                 break;
             }
 
-            int srcy = dsty;
-
-            if (_srcBoundary == 1) {
-                if (_srcBounds.y2 <= srcy) {
-                    srcy = _srcBounds.y2 - 1;
-                }
-                if (srcy < _srcBounds.y1) {
-                    srcy = _srcBounds.y1;
-                }
-            } else if (_srcBoundary == 2) {
-                if ( (srcy < _srcBounds.y1) || (_srcBounds.y2 <= srcy) ) {
-                    srcy = _srcBounds.y1 + positive_modulo(srcy - _srcBounds.y1, _srcBounds.y2 - _srcBounds.y1);
-                }
-            }
-
             DSTPIX *dstPix = (DSTPIX *) getDstPixelAddress(procWindow.x1, dsty);
             assert(dstPix);
             if (!dstPix) {
@@ -558,29 +376,20 @@ public:
                 continue;
             }
 
-            for (int dstx = procWindow.x1; dstx < procWindow.x2; ++dstx) {
-                int srcx = dstx;
-
-                if (_srcBoundary == 1) {
-                    if (_srcBounds.x2 <= srcx) {
-                        srcx = _srcBounds.x2 - 1;
-                    }
-                    if (srcx < _srcBounds.x1) {
-                        srcx = _srcBounds.x1;
-                    }
-                } else if (_srcBoundary == 2) {
-                    if ( (srcx < _srcBounds.x1) || (_srcBounds.x2 <= srcx) ) {
-                        srcx = _srcBounds.x1 + positive_modulo(srcx - _srcBounds.x1, _srcBounds.x2 - _srcBounds.x1);
-                    }
-                }
+            const OFX::PixelRowSpan<SRCPIX> srcRow = getSrcRowSpan<SRCPIX>(dsty);
 
-                const SRCPIX *srcPix = (const SRCPIX *) getSrcPixelAddress(srcx, srcy);
+            for (int x = procWindow.x1; x < procWindow.x2; ) {
+                const SRCPIX *srcPix;
+                int srcStride;
+                const int xEnd = srcRow.getSegment(x, procWindow.x2, &srcPix, &srcStride);
                 if (!srcPix) {
                     // no source, be black and transparent
-                    for (int c = 0; c < dstNComponents; ++c) {
-                        dstPix[c] = DSTPIX();
-                    }
-                } else {
+                    std::fill( dstPix, dstPix + dstNComponents * (xEnd - x), DSTPIX() );
+                    dstPix += dstNComponents * (xEnd - x);
+                    x = xEnd;
+                    continue;
+                }
+                for (; x < xEnd; ++x) {
                     float unpPix[4] = {0.f, 0.f, 0.f, 0.f};
                     if (srcNComponents == 1) {
                         unpPix[3] = srcPix[0] * (1.f / srcMaxValue);
@@ -598,9 +407,10 @@ public:
                     for (int c = 0; c < dstNComponents; ++c) {
                         dstPix[c] = ofxsClampIfInt<DSTPIX, dstMaxValue>(pPix[c], 0, dstMaxValue);
                     }
+                    srcPix += srcStride;
+                    // increment the dst pixel
+                    dstPix += dstNComponents;
                 }
-                // increment the dst pixel
-                dstPix += dstNComponents;
             }
         }
     } // multiThreadProcessImages
@@ -646,21 +456,6 @@ public:
                 break;
             }
 
-            int srcy = dsty;
-
-            if (_srcBoundary == 1) {
-                if (_srcBounds.y2 <= srcy) {
-                    srcy = _srcBounds.y2 - 1;
-                }
-                if (srcy < _srcBounds.y1) {
-                    srcy = _srcBounds.y1;
-                }
-            } else if (_srcBoundary == 2) {
-                if ( (srcy < _srcBounds.y1) || (_srcBounds.y2 <= srcy) ) {
-                    srcy = _srcBounds.y1 + positive_modulo(srcy - _srcBounds.y1, _srcBounds.y2 - _srcBounds.y1);
-                }
-            }
-
             DSTPIX *dstPix = (DSTPIX *) getDstPixelAddress(procWindow.x1, dsty);
             assert(dstPix);
             if (!dstPix) {
@@ -668,30 +463,26 @@ public:
                 continue;
             }
 
-            for (int dstx = procWindow.x1; dstx < procWindow.x2; ++dstx) {
-                int srcx = dstx;
-
-                if (_srcBoundary == 1) {
-                    if (_srcBounds.x2 <= srcx) {
-                        srcx = _srcBounds.x2 - 1;
-                    }
-                    if (srcx < _srcBounds.x1) {
-                        srcx = _srcBounds.x1;
-                    }
-                } else if (_srcBoundary == 2) {
-                    if ( (srcx < _srcBounds.x1) || (_srcBounds.x2 <= srcx) ) {
-                        srcx = _srcBounds.x1 + positive_modulo(srcx - _srcBounds.x1, _srcBounds.x2 - _srcBounds.x1);
-                    }
-                }
-                // origPix is at dstx,dsty
-                const DSTPIX *origPix = (const DSTPIX *)  (_origImg ? _origImg->getPixelAddress(dstx, dsty) : 0);
-                const SRCPIX *srcPix = (const SRCPIX *) getSrcPixelAddress(srcx, srcy);
+            const OFX::PixelRowSpan<SRCPIX> srcRow = getSrcRowSpan<SRCPIX>(dsty);
+            // dstx,dsty are the orig and mask image coordinates (no boundary conditions)
+            const OFX::PixelRowSpan<DSTPIX> origRow(_origImg, dsty);
+            const OFX::PixelRowSpan<DSTPIX> maskRow(_doMasking ? _maskImg : NULL, dsty);
+
+            for (int x = procWindow.x1; x < procWindow.x2; ) {
+                const SRCPIX *srcPix;
+                const DSTPIX *origPix, *maskPix;
+                int srcStride, origStride, maskStride;
+                int xEnd = srcRow.getSegment(x, procWindow.x2, &srcPix, &srcStride);
+                xEnd = origRow.getSegment(x, xEnd, &origPix, &origStride);
+                xEnd = maskRow.getSegment(x, xEnd, &maskPix, &maskStride);
                 if (!srcPix) {
                     // no source, be black and transparent
-                    for (int c = 0; c < dstNComponents; ++c) {
-                        dstPix[c] = DSTPIX();
-                    }
-                } else {
+                    std::fill( dstPix, dstPix + dstNComponents * (xEnd - x), DSTPIX() );
+                    dstPix += dstNComponents * (xEnd - x);
+                    x = xEnd;
+                    continue;
+                }
+                for (; x < xEnd; ++x) {
                     if (srcNComponents == 1) {
                         unpPix[3] = srcPix[0] * (1.f / srcMaxValue);
                     } else {
@@ -700,11 +491,13 @@ public:
                         unpPix[2] = (srcNComponents > 2) ? (srcPix[2] * (1.f / srcMaxValue)) : 0.f;
                         unpPix[3] = (srcNComponents == 4) ? (srcPix[3] * (1.f / srcMaxValue)) : 1.0f;
                     }
-                    // dstx,dsty are the mask image coordinates (no boundary conditions)
-                    ofxsPremultMaskMixPix<DSTPIX, dstNComponents, dstMaxValue, true>(unpPix, _premult, _premultChannel, dstx, dsty, origPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
+                    ofxsPremultMaskMixPixWithMask<DSTPIX, dstNComponents, dstMaxValue, true>(unpPix, _premult, _premultChannel, maskPix, origPix, _doMasking, (float)_mix, _maskInvert, dstPix);
+                    srcPix += srcStride;
+                    origPix += origStride;
+                    maskPix += maskStride;
+                    // increment the dst pixel
+                    dstPix += dstNComponents;
                 }
-                // increment the dst pixel
-                dstPix += dstNComponents;
             }
         }
     } // multiThreadProcessImages
@@ -23,6 +23,7 @@
 
 #include "ofxsProcessing.H"
 #include "ofxsMaskMix.h"
+#include "ofxsPixelProcessor.h"
 #include "ofxsImageBlender.H"
 #include "ofxsMacros.h"
 
@@ -91,40 +92,66 @@ public:
             }
 
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
-
-            for (int x = procWindow.x1; x < procWindow.x2; x++) {
-                PIX *fromPix = (PIX *)  (_fromImg ? _fromImg->getPixelAddress(x, y) : 0);
-                PIX *toPix   = (PIX *)  (_toImg   ? _toImg->getPixelAddress(x, y)   : 0);
+            const OFX::PixelRowSpan<PIX> fromRow(_fromImg, y);
+            const OFX::PixelRowSpan<PIX> toRow(_toImg, y);
+            const OFX::PixelRowSpan<PIX> maskRow( (masked && _doMasking) ? _maskImg : NULL, y );
+
+            for (int x = procWindow.x1; x < procWindow.x2; ) {
+                // the segment [x,xEnd) over which all pixel addresses are affine in x
+                const PIX *fromPix, *toPix, *maskPix = NULL;
+                int fromStride, toStride, maskStride = 0;
+                int xEnd = fromRow.getSegment(x, procWindow.x2, &fromPix, &fromStride);
+                xEnd = toRow.getSegment(x, xEnd, &toPix, &toStride);
+                if (masked) {
+                    xEnd = maskRow.getSegment(x, xEnd, &maskPix, &maskStride);
+                }
 
                 if ( masked && (fromPix || toPix) ) {
-                    for (int c = 0; c < nComponents; ++c) {
-                        // all images are supposed to be black and transparent outside o
-                        tmpPix[c] = toPix ? (float)toPix[c] : 0.f;
+                    for (; x < xEnd; ++x) {
+                        for (int c = 0; c < nComponents; ++c) {
+                            // all images are supposed to be black and transparent outside o
+                            tmpPix[c] = toPix ? (float)toPix[c] : 0.f;
+                        }
+                        ofxsMaskMixPixWithMask<PIX, nComponents, maxValue, masked>(tmpPix, maskPix, fromPix, _doMasking, blend, _maskInvert, dstPix);
+                        fromPix += fromStride;
+                        toPix += toStride;
+                        maskPix += maskStride;
+                        dstPix += nComponents;
                     }
-                    ofxsMaskMixPix<PIX, nComponents, maxValue, masked>(tmpPix, x, y, fromPix, _doMasking, _maskImg, blend, _maskInvert, dstPix);
                 } else if (fromPix && toPix) {
                     assert(!masked);
-                    for (int c = 0; c < nComponents; ++c) {
-                        dstPix[c] = Lerp(fromPix[c], toPix[c], blend);
+                    for (; x < xEnd; ++x) {
+                        for (int c = 0; c < nComponents; ++c) {
+                            dstPix[c] = Lerp(fromPix[c], toPix[c], blend);
+                        }
+                        fromPix += fromStride;
+                        toPix += toStride;
+                        dstPix += nComponents;
                     }
                 } else if (fromPix) {
                     assert(!masked);
-                    for (int c = 0; c < nComponents; ++c) {
-                        dstPix[c] = PIX(fromPix[c] * blendComp);
+                    for (; x < xEnd; ++x) {
+                        for (int c = 0; c < nComponents; ++c) {
+                            dstPix[c] = PIX(fromPix[c] * blendComp);
+                        }
+                        fromPix += fromStride;
+                        dstPix += nComponents;
                     }
                 } else if (toPix) {
                     assert(!masked);
-                    for (int c = 0; c < nComponents; ++c) {
-                        dstPix[c] = PIX(toPix[c] * blend);
+                    for (; x < xEnd; ++x) {
+                        for (int c = 0; c < nComponents; ++c) {
+                            dstPix[c] = PIX(toPix[c] * blend);
+                        }
+                        toPix += toStride;
+                        dstPix += nComponents;
                     }
                 } else {
                     // everything is black and transparent
-                    for (int c = 0; c < nComponents; ++c) {
-                        dstPix[c] = PIX(0);
-                    }
+                    std::fill( dstPix, dstPix + nComponents * (xEnd - x), PIX(0) );
+                    dstPix += nComponents * (xEnd - x);
+                    x = xEnd;
                 }
-
-                dstPix += nComponents;
             }
         }
     }
@@ -33,6 +33,21 @@ typedef unsigned char uint8_t;
 #endif
 #include <limits>
 #include <cmath>
+#include <functional>
+#include <map>
+#include <utility>
+#if __cplusplus > 199711L           // C++11
+#include <mutex>
+#else
+#include "tinythread.h"
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #ifndef M_PI
 #define M_PI        3.14159265358979323846264338327950288   /* pi             */
@@ -60,31 +75,6 @@ static const o32_host_order_t o32_host_order = {
     { 0, 1, 2, 3 }
 };
 #define O32_HOST_ORDER (o32_host_order.value)
-unsigned short
-Lut::hipart(const float f)
-{
-    union
-    {
-        float f;
-        unsigned short us[2];
-    }
-
-    tmp;
-
-    tmp.us[0] = tmp.us[1] = 0;
-    tmp.f = f;
-
-    if (O32_HOST_ORDER == O32_BIG_ENDIAN) {
-        return tmp.us[0];
-    } else if (O32_HOST_ORDER == O32_LITTLE_ENDIAN) {
-        return tmp.us[1];
-    } else {
-        assert( (O32_HOST_ORDER == O32_LITTLE_ENDIAN) || (O32_HOST_ORDER == O32_BIG_ENDIAN) );
-
-        return 0;
-    }
-}
-
 float
 Lut::index_to_float(const unsigned short i)
 {
@@ -120,6 +110,545 @@ Lut::index_to_float(const unsigned short i)
     return tmp.f;
 }
 
+void
+Lut::fillTables(fromColorSpaceFunctionV1 fromFunc,
+                toColorSpaceFunctionV1 toFunc,
+                LutTables* tables)
+{
+    // fill all
+    for (int i = 0; i < 0x10000; ++i) {
+        float inp = index_to_float( (unsigned short)i );
+        float f = toFunc(inp);
+        tables->toFunc_hipart_to_uint8xx[i] = Color::floatToInt<0xff01>(f);
+    }
+    // fill fromFunc_uint8_to_float, and make sure that
+    // the entries of toFunc_hipart_to_uint8xx corresponding
+    // to the transform of each byte value contain the same value,
+    // so that toFunc(fromFunc(b)) is identity
+    //
+    for (int b = 0; b < 256; ++b) {
+        float f = fromFunc( Color::intToFloat<256>(b) );
+        tables->fromFunc_uint8_to_float[b] = f;
+        int i = hipart(f);
+        tables->toFunc_hipart_to_uint8xx[i] = Color::charToUint8xx(b);
+    }
+    tables->toFunc_hipart_to_uint8xx[0x10000] = 0;
+}
+
+// The tables of all the Luts of the process, by name and transfer functions, with their reference count.
+// There is one registry per type of tables.
+// The registries are constructed on first use and never destroyed, because Luts may be released
+// by static LutManager objects during the destruction of static objects.
+namespace {
+#if __cplusplus > 199711L
+typedef std::mutex LutTablesMutex;
+typedef std::lock_guard<std::mutex> LutTablesLock;
+#else
+typedef tthread::mutex LutTablesMutex;
+typedef tthread::lock_guard<tthread::mutex> LutTablesLock;
+#endif
+
+struct LutTablesKey
+{
+    std::string name;
+    fromColorSpaceFunctionV1 fromFunc;
+    toColorSpaceFunctionV1 toFunc;
+
+    LutTablesKey(const std::string& name_,
+                 fromColorSpaceFunctionV1 fromFunc_,
+                 toColorSpaceFunctionV1 toFunc_)
+        : name(name_)
+        , fromFunc(fromFunc_)
+        , toFunc(toFunc_)
+    {
+    }
+
+    bool operator<(const LutTablesKey& other) const
+    {
+        if (name != other.name) {
+            return name < other.name;
+        }
+        if (fromFunc != other.fromFunc) {
+            return std::less<fromColorSpaceFunctionV1>()(fromFunc, other.fromFunc);
+        }
+
+        return std::less<toColorSpaceFunctionV1>()(toFunc, other.toFunc);
+    }
+};
+
+template <class TABLES>
+class LutTablesRegistry
+{
+    typedef std::map<LutTablesKey, std::pair<TABLES*, int> > TablesMap;
+
+    LutTablesMutex _mutex;
+    TablesMap _tables;
+
+public:
+    static LutTablesRegistry& get()
+    {
+        static LutTablesRegistry* registry = new LutTablesRegistry;
+
+        return *registry;
+    }
+
+    // returns the tables for the key, and sets ptr to them.
+    // If no other Lut uses these tables, they are built with fill().
+    const TABLES* acquire(LutTablesPtr<TABLES>& ptr,
+                          const LutTablesKey& key,
+                          void (*fill)(fromColorSpaceFunctionV1, toColorSpaceFunctionV1, TABLES*))
+    {
+        LutTablesLock l(_mutex);
+        // another thread may have set the tables while we were waiting for the lock
+        const TABLES* tables = ptr.load();
+
+        if (tables) {
+            return tables;
+        }
+        typename TablesMap::iterator found = _tables.find(key);
+        if ( found != _tables.end() ) {
+            ++found->second.second;
+            tables = found->second.first;
+        } else {
+            TABLES* newTables = new TABLES;
+            fill(key.fromFunc, key.toFunc, newTables);
+            _tables.insert( std::make_pair( key, std::make_pair(newTables, 1) ) );
+            tables = newTables;
+        }
+        ptr.store(tables);
+
+        return tables;
+    }
+
+    // drops the reference held through ptr, and resets ptr
+    void release(LutTablesPtr<TABLES>& ptr,
+                 const LutTablesKey& key)
+    {
+        LutTablesLock l(_mutex);
+        const TABLES* tables = ptr.load();
+
+        if (!tables) {
+            return;
+        }
+        typename TablesMap::iterator found = _tables.find(key);
+        assert( found != _tables.end() && found->second.first == tables );
+        if ( ( found != _tables.end() ) && (--found->second.second == 0) ) {
+            delete found->second.first;
+            _tables.erase(found);
+        }
+        ptr.store(NULL);
+    }
+};
+
+#ifdef OFXS_LUT_STATIC_TABLES
+struct LutStaticTables
+{
+    const char* name;
+    fromColorSpaceFunctionV1 fromFunc;
+    toColorSpaceFunctionV1 toFunc;
+    const LutTables* tables;
+};
+
+// ofxsLutTables.inc is generated by ofxsLutTablesGenerator at build time.
+// It defines the tables of some built-in Luts, and the ofxsLutStaticTables array, which ends with a NULL name.
+#include "ofxsLutTables.inc"
+#endif
+
+// the tables that were generated at build time for the given Lut, if any
+const LutTables*
+findStaticTables(const std::string& name,
+                 fromColorSpaceFunctionV1 fromFunc,
+                 toColorSpaceFunctionV1 toFunc)
+{
+#ifdef OFXS_LUT_STATIC_TABLES
+    for (const LutStaticTables* t = ofxsLutStaticTables; t->name; ++t) {
+        if ( (t->fromFunc == fromFunc) && (t->toFunc == toFunc) && (name == t->name) ) {
+            return t->tables;
+        }
+    }
+#else
+    (void)name;
+    (void)fromFunc;
+    (void)toFunc;
+#endif
+
+    return NULL;
+}
+} // anon namespace
+
+const LutTables*
+Lut::acquireTables() const
+{
+    // the static tables need neither a lock nor a reference count
+    const LutTables* tables = findStaticTables(_name, _fromFunc, _toFunc);
+
+    if (tables) {
+        _tables.store(tables);
+
+        return tables;
+    }
+
+    return LutTablesRegistry<LutTables>::get().acquire( _tables, LutTablesKey(_name, _fromFunc, _toFunc), fillTables );
+}
+
+const LutFloatTables*
+Lut::acquireFloatTables() const
+{
+    return LutTablesRegistry<LutFloatTables>::get().acquire( _floatTables, LutTablesKey(_name, _fromFunc, _toFunc), fillFloatTables );
+}
+
+const LutUint16Tables*
+Lut::acquireUint16Tables() const
+{
+    return LutTablesRegistry<LutUint16Tables>::get().acquire( _uint16Tables, LutTablesKey(_name, _fromFunc, _toFunc), fillUint16Tables );
+}
+
+void
+Lut::releaseTables()
+{
+    const LutTables* tables = _tables.load();
+
+    if ( tables && ( tables != findStaticTables(_name, _fromFunc, _toFunc) ) ) {
+        LutTablesRegistry<LutTables>::get().release( _tables, LutTablesKey(_name, _fromFunc, _toFunc) );
+    }
+    if ( _floatTables.load() ) {
+        LutTablesRegistry<LutFloatTables>::get().release( _floatTables, LutTablesKey(_name, _fromFunc, _toFunc) );
+    }
+    if ( _uint16Tables.load() ) {
+        LutTablesRegistry<LutUint16Tables>::get().release( _uint16Tables, LutTablesKey(_name, _fromFunc, _toFunc) );
+    }
+}
+
+void
+Lut::fillFloatTables(fromColorSpaceFunctionV1 fromFunc,
+                     toColorSpaceFunctionV1 toFunc,
+                     LutFloatTables* tables)
+{
+    // the values at the ends of the intervals. The transfer functions may overflow near 2^8
+    // (e.g. Cineon), in which case the largest float is stored, so that the interpolation stays finite.
+    for (int i = 0; i < LutFloatTables::kSize; ++i) {
+        const unsigned int bits = (unsigned int)LutFloatTables::kMinBits + ( (unsigned int)i << LutFloatTables::kShift );
+        float v;
+        std::memcpy( &v, &bits, sizeof(v) );
+        tables->toFunc[i] = (std::max)( -std::numeric_limits<float>::max(), (std::min)( toFunc(v), std::numeric_limits<float>::max() ) );
+        tables->fromFunc[i] = (std::max)( -std::numeric_limits<float>::max(), (std::min)( fromFunc(v), std::numeric_limits<float>::max() ) );
+    }
+    tables->toFunc_zero = toFunc(0.f);
+    tables->fromFunc_zero = fromFunc(0.f);
+}
+
+void
+Lut::fillUint16Tables(fromColorSpaceFunctionV1 fromFunc,
+                      toColorSpaceFunctionV1 toFunc,
+                      LutUint16Tables* tables)
+{
+    for (int i = 0; i < 0x10000; ++i) {
+        tables->fromFunc_uint16_to_float[i] = fromFunc( Color::intToFloat<65536>(i) );
+    }
+    // the values of toFunc at the ends of the intervals are only clamped to [-1, 2] (to stay finite):
+    // clamping them to [0, 1] would bend the interpolated function in the intervals where it crosses 0 or 1.
+    // The interpolated values are clamped to [0, 65535] before rounding.
+    for (int i = 0; i < LutUint16Tables::kSize; ++i) {
+        const unsigned int bits = (unsigned int)LutUint16Tables::kMinBits + ( (unsigned int)i << LutUint16Tables::kShift );
+        float v;
+        std::memcpy( &v, &bits, sizeof(v) );
+        tables->toFunc_to_uint16[i] = (std::min)( (std::max)( -1.f, toFunc(v) ), 2.f ) * 65535.f;
+    }
+    tables->toFunc_zero_to_uint16 = (std::min)( (std::max)( 0.f, toFunc(0.f) ), 1.f ) * 65535.f;
+}
+
+namespace {
+// the values of a transfer function outside of the LutFloatTables
+struct FloatFallback
+{
+    FloatFallback(float zero_,
+                  float (*func_)(float))
+        : zero(zero_)
+        , func(func_)
+    {
+    }
+
+    float operator()(float v) const
+    {
+        return (v == 0.f) ? zero : func(v);
+    }
+
+    float zero;
+    float (*func)(float);
+};
+
+// the values of toFunc outside of the LutUint16Tables, clamped and scaled to [0, 65535]
+struct Uint16Fallback
+{
+    Uint16Fallback(float zero_,
+                   float (*func_)(float))
+        : zero(zero_)
+        , func(func_)
+    {
+    }
+
+    float operator()(float v) const
+    {
+        // this also maps NaN to 0
+        return (v == 0.f) ? zero : (std::min)( (std::max)( 0.f, func(v) ), 1.f ) * 65535.f;
+    }
+
+    float zero;
+    float (*func)(float);
+};
+} // anon namespace
+
+template <class TABLES, class FALLBACK>
+void
+Lut::interpolateTable(const float* table,
+                      const FALLBACK& fallback,
+                      const float* src,
+                      float* dst,
+                      int n)
+{
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256i minBits = _mm256_set1_epi32(TABLES::kMinBits);
+    const __m256i range = _mm256_set1_epi32(TABLES::kMaxBits - TABLES::kMinBits);
+    const __m256i fracMask = _mm256_set1_epi32( (1 << TABLES::kShift) - 1 );
+    const __m256 fracScale = _mm256_set1_ps( 1.f / (1 << TABLES::kShift) );
+    for (; i + 8 <= n; i += 8) {
+        const __m256 v = _mm256_loadu_ps(src + i);
+        const __m256i offset = _mm256_sub_epi32(_mm256_castps_si256(v), minBits);
+        // 0 <= offset < range, as in the scalar version
+        const __m256i inside = _mm256_andnot_si256( _mm256_cmpgt_epi32( _mm256_setzero_si256(), offset ), _mm256_cmpgt_epi32(range, offset) );
+        // the indices of the values outside of the table are set to 0, and those values are computed below
+        const __m256i idx = _mm256_and_si256( _mm256_srli_epi32(offset, TABLES::kShift), inside );
+        const __m256 a = _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_and_si256(offset, fracMask) ), fracScale );
+        const __m256 y0 = _mm256_i32gather_ps(table, idx, 4);
+        const __m256 y1 = _mm256_i32gather_ps(table + 1, idx, 4);
+        _mm256_storeu_ps( dst + i, _mm256_add_ps( y0, _mm256_mul_ps( a, _mm256_sub_ps(y1, y0) ) ) );
+        const int insideMask = _mm256_movemask_ps( _mm256_castsi256_ps(inside) );
+        if (insideMask != 0xff) {
+            // src may have been overwritten, if it is dst
+            float values[8];
+            _mm256_storeu_ps(values, v);
+            for (int k = 0; k < 8; ++k) {
+                if ( !( insideMask & (1 << k) ) ) {
+                    dst[i + k] = fallback(values[k]);
+                }
+            }
+        }
+    }
+#elif defined(__SSE4_1__)
+    const __m128i minBits = _mm_set1_epi32(TABLES::kMinBits);
+    const __m128i range = _mm_set1_epi32(TABLES::kMaxBits - TABLES::kMinBits);
+    const __m128i fracMask = _mm_set1_epi32( (1 << TABLES::kShift) - 1 );
+    const __m128 fracScale = _mm_set1_ps( 1.f / (1 << TABLES::kShift) );
+    for (; i + 4 <= n; i += 4) {
+        const __m128 v = _mm_loadu_ps(src + i);
+        const __m128i offset = _mm_sub_epi32(_mm_castps_si128(v), minBits);
+        const __m128i inside = _mm_andnot_si128( _mm_cmpgt_epi32( _mm_setzero_si128(), offset ), _mm_cmpgt_epi32(range, offset) );
+        const __m128i idx = _mm_and_si128( _mm_srli_epi32(offset, TABLES::kShift), inside );
+        const __m128 a = _mm_mul_ps( _mm_cvtepi32_ps( _mm_and_si128(offset, fracMask) ), fracScale );
+        const int i0 = _mm_cvtsi128_si32(idx);
+        const int i1 = _mm_extract_epi32(idx, 1);
+        const int i2 = _mm_extract_epi32(idx, 2);
+        const int i3 = _mm_extract_epi32(idx, 3);
+        const __m128 y0 = _mm_setr_ps(table[i0], table[i1], table[i2], table[i3]);
+        const __m128 y1 = _mm_setr_ps(table[i0 + 1], table[i1 + 1], table[i2 + 1], table[i3 + 1]);
+        _mm_storeu_ps( dst + i, _mm_add_ps( y0, _mm_mul_ps( a, _mm_sub_ps(y1, y0) ) ) );
+        const int insideMask = _mm_movemask_ps( _mm_castsi128_ps(inside) );
+        if (insideMask != 0xf) {
+            // src may have been overwritten, if it is dst
+            float values[4];
+            _mm_storeu_ps(values, v);
+            for (int k = 0; k < 4; ++k) {
+                if ( !( insideMask & (1 << k) ) ) {
+                    dst[i + k] = fallback(values[k]);
+                }
+            }
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        if ( !interpolateTable<TABLES>(table, src[i], dst + i) ) {
+            dst[i] = fallback(src[i]);
+        }
+    }
+}
+
+void
+Lut::fromColorSpaceFloatToLinearFloatFast(const float* src,
+                                          float* dst,
+                                          int n) const
+{
+    const LutFloatTables& tables = getFloatTables();
+
+    interpolateTable<LutFloatTables>( tables.fromFunc, FloatFallback(tables.fromFunc_zero, _fromFunc), src, dst, n );
+}
+
+void
+Lut::toColorSpaceFloatFromLinearFloatFast(const float* src,
+                                          float* dst,
+                                          int n) const
+{
+    const LutFloatTables& tables = getFloatTables();
+
+    interpolateTable<LutFloatTables>( tables.toFunc, FloatFallback(tables.toFunc_zero, _toFunc), src, dst, n );
+}
+
+// The array conversions below use SIMD instructions if the code is compiled for them (e.g. -mavx2 or -msse4.1).
+// The index in toFunc_hipart_to_uint8xx is the high half of the float bits, which is computed for a whole vector.
+// With AVX2, the table is read with 32-bit gathers at a 2-byte scale: the high 16 bits of each gathered value
+// belong to the next entry (hence the padding entry at the end of the table) and are masked out.
+#if defined(__AVX2__)
+static inline __m256i
+lookupUint8xx8(const unsigned short* table,
+               const float* src)
+{
+    const __m256i idx = _mm256_srli_epi32(_mm256_castps_si256( _mm256_loadu_ps(src) ), 16);
+    const __m256i v = _mm256_i32gather_epi32( (const int*)table, idx, 2 );
+
+    return _mm256_and_si256( v, _mm256_set1_epi32(0xffff) );
+}
+
+#elif defined(__SSE4_1__)
+static inline __m128i
+lookupUint8xx4(const unsigned short* table,
+               const float* src)
+{
+    const __m128i idx = _mm_srli_epi32(_mm_castps_si128( _mm_loadu_ps(src) ), 16);
+
+    return _mm_setr_epi32( table[_mm_cvtsi128_si32(idx)], table[_mm_extract_epi32(idx, 1)],
+                           table[_mm_extract_epi32(idx, 2)], table[_mm_extract_epi32(idx, 3)] );
+}
+
+#endif
+
+void
+Lut::toColorSpaceUint8FromLinearFloatFast(const float* src,
+                                          unsigned char* dst,
+                                          int n) const
+{
+    const LutTables& tables = getTables();
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256i half = _mm256_set1_epi32(0x80);
+    for (; i + 8 <= n; i += 8) {
+        // same rounding as Color::uint8xxToChar()
+        const __m256i v = _mm256_srli_epi32(_mm256_add_epi32(lookupUint8xx8(tables.toFunc_hipart_to_uint8xx, src + i), half), 8);
+        const __m128i v16 = _mm_packus_epi32( _mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1) );
+        _mm_storel_epi64( (__m128i*)(dst + i), _mm_packus_epi16(v16, v16) );
+    }
+#elif defined(__SSE4_1__)
+    const __m128i half = _mm_set1_epi32(0x80);
+    for (; i + 8 <= n; i += 8) {
+        const __m128i lo = _mm_srli_epi32(_mm_add_epi32(lookupUint8xx4(tables.toFunc_hipart_to_uint8xx, src + i), half), 8);
+        const __m128i hi = _mm_srli_epi32(_mm_add_epi32(lookupUint8xx4(tables.toFunc_hipart_to_uint8xx, src + i + 4), half), 8);
+        const __m128i v16 = _mm_packus_epi32(lo, hi);
+        _mm_storel_epi64( (__m128i*)(dst + i), _mm_packus_epi16(v16, v16) );
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = Color::uint8xxToChar(tables.toFunc_hipart_to_uint8xx[hipart(src[i])]);
+    }
+}
+
+void
+Lut::toColorSpaceUint8xxFromLinearFloatFast(const float* src,
+                                            unsigned short* dst,
+                                            int n) const
+{
+    const LutTables& tables = getTables();
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= n; i += 8) {
+        const __m256i v = lookupUint8xx8(tables.toFunc_hipart_to_uint8xx, src + i);
+        _mm_storeu_si128( (__m128i*)(dst + i), _mm_packus_epi32( _mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1) ) );
+    }
+#elif defined(__SSE4_1__)
+    for (; i + 8 <= n; i += 8) {
+        const __m128i lo = lookupUint8xx4(tables.toFunc_hipart_to_uint8xx, src + i);
+        const __m128i hi = lookupUint8xx4(tables.toFunc_hipart_to_uint8xx, src + i + 4);
+        _mm_storeu_si128( (__m128i*)(dst + i), _mm_packus_epi32(lo, hi) );
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = tables.toFunc_hipart_to_uint8xx[hipart(src[i])];
+    }
+}
+
+void
+Lut::toColorSpaceUint16FromLinearFloatFast(const float* src,
+                                           unsigned short* dst,
+                                           int n) const
+{
+    const LutUint16Tables& tables = getUint16Tables();
+    const Uint16Fallback fallback(tables.toFunc_zero_to_uint16, _toFunc);
+    // the values are interpolated by blocks, in a buffer which stays in the L1 cache, and then rounded
+    const int kBlockSize = 256;
+    float buf[kBlockSize];
+
+    for (int start = 0; start < n; start += kBlockSize) {
+        const int count = (std::min)(kBlockSize, n - start);
+        unsigned short* dstBlock = dst + start;
+        interpolateTable<LutUint16Tables>(tables.toFunc_to_uint16, fallback, src + start, buf, count);
+        int i = 0;
+#if defined(__AVX2__)
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 maxValue = _mm256_set1_ps(65535.f);
+        for (; i + 8 <= count; i += 8) {
+            // the negative values are clamped to 0 by the pack
+            const __m256i v = _mm256_cvttps_epi32( _mm256_add_ps(_mm256_min_ps(_mm256_loadu_ps(buf + i), maxValue), half) );
+            _mm_storeu_si128( (__m128i*)(dstBlock + i), _mm_packus_epi32( _mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1) ) );
+        }
+#elif defined(__SSE4_1__)
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 maxValue = _mm_set1_ps(65535.f);
+        for (; i + 8 <= count; i += 8) {
+            const __m128i lo = _mm_cvttps_epi32( _mm_add_ps(_mm_min_ps(_mm_loadu_ps(buf + i), maxValue), half) );
+            const __m128i hi = _mm_cvttps_epi32( _mm_add_ps(_mm_min_ps(_mm_loadu_ps(buf + i + 4), maxValue), half) );
+            _mm_storeu_si128( (__m128i*)(dstBlock + i), _mm_packus_epi32(lo, hi) );
+        }
+#endif
+        for (; i < count; ++i) {
+            dstBlock[i] = (unsigned short)( (std::min)( (std::max)( 0.f, buf[i] ), 65535.f ) + 0.5f );
+        }
+    }
+}
+
+void
+Lut::fromColorSpaceUint8ToLinearFloatFast(const unsigned char* src,
+                                          float* dst,
+                                          int n) const
+{
+    const LutTables& tables = getTables();
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= n; i += 8) {
+        const __m256i idx = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)(src + i) ) );
+        _mm256_storeu_ps( dst + i, _mm256_i32gather_ps(tables.fromFunc_uint8_to_float, idx, 4) );
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = tables.fromFunc_uint8_to_float[src[i]];
+    }
+}
+
+void
+Lut::fromColorSpaceUint16ToLinearFloatFast(const unsigned short* src,
+                                           float* dst,
+                                           int n) const
+{
+    const LutUint16Tables& tables = getUint16Tables();
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= n; i += 8) {
+        const __m256i idx = _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*)(src + i) ) );
+        _mm256_storeu_ps( dst + i, _mm256_i32gather_ps(tables.fromFunc_uint16_to_float, idx, 4) );
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = tables.fromFunc_uint16_to_float[src[i]];
+    }
+}
+
 // r,g,b values are linear values from 0 to 1
 // h = [0,OFXS_HUE_CIRCLE], s = [0,1], v = [0,1]
 //		if s == 0, then h = 0 (undefined)
@@ -192,7 +721,7 @@ hsv_to_rgb(float h,
     h *= 6. / OFXS_HUE_CIRCLE;            // sector 0 to 5
     int i = (int)std::floor(h);
     float f = h - i;          // factorial part of h
-    i = (i >= 0) ? (i % 6) : (i % 6) + 6; // take h modulo 360
+    i = (i >= 0) ? (i % 6) : ( (i % 6) + 6 ) % 6; // take h modulo 360
     float p = v * ( 1 - s );
     float q = v * ( 1 - s * f );
     float t = v * ( 1 - s * ( 1 - f ) );
@@ -288,7 +817,7 @@ hsl_to_rgb(float h,
     h *= 6.f / OFXS_HUE_CIRCLE;            // sector 0 to 5
     int i = (int)std::floor(h);
     float f = h - i;          // factorial part of h
-    i = (i >= 0) ? (i % 6) : (i % 6) + 6; // take h modulo 360
+    i = (i >= 0) ? (i % 6) : ( (i % 6) + 6 ) % 6; // take h modulo 360
     float v = (l <= 0.5f) ? ( l * (1.0f + s) ) : (l + s - l * s);
     float p = l + l - v;
     float sv = (v - p ) / v;
@@ -772,6 +1301,695 @@ lab_to_rgb709(float l,
     lab_to_xyz(l, a, b, &x, &y, &z);
     xyz_to_rgb709(x, y, z, r, g, b_);
 }
+
+// Batch color model conversions.
+// Each conversion is written once, as a branchless template on a vector type: SimdVec holds 8 floats with AVX2
+// and 4 floats with SSE2, and ScalarVec, which has the same interface, converts the remaining pixels.
+// The operations are the same as in the scalar functions above, in the same order.
+namespace {
+struct ScalarVec
+{
+    typedef bool Mask;
+
+    float v;
+
+    ScalarVec()
+    {
+    }
+
+    // implicit, so that the constants of the formulas can be used as vectors
+    ScalarVec(float x)
+        : v(x)
+    {
+    }
+
+    static ScalarVec load(const float* p)
+    {
+        return ScalarVec(*p);
+    }
+
+    void store(float* p) const
+    {
+        *p = v;
+    }
+};
+
+inline ScalarVec operator +(ScalarVec a, ScalarVec b) { return a.v + b.v; }
+inline ScalarVec operator -(ScalarVec a, ScalarVec b) { return a.v - b.v; }
+inline ScalarVec operator *(ScalarVec a, ScalarVec b) { return a.v * b.v; }
+inline ScalarVec operator /(ScalarVec a, ScalarVec b) { return a.v / b.v; }
+inline ScalarVec vmin(ScalarVec a, ScalarVec b) { return (std::min)(a.v, b.v); }
+inline ScalarVec vmax(ScalarVec a, ScalarVec b) { return (std::max)(a.v, b.v); }
+inline ScalarVec vfloor(ScalarVec a) { return std::floor(a.v); }
+inline bool veq(ScalarVec a, ScalarVec b) { return a.v == b.v; }
+inline bool vlt(ScalarVec a, ScalarVec b) { return a.v < b.v; }
+inline bool vle(ScalarVec a, ScalarVec b) { return a.v <= b.v; }
+inline bool vge(ScalarVec a, ScalarVec b) { return a.v >= b.v; }
+inline bool vor(bool a, bool b) { return a || b; }
+inline ScalarVec vselect(bool m, ScalarVec a, ScalarVec b) { return m ? a : b; }
+
+// an estimate of the cube root of a positive float, from its bits, which is refined by vcbrt()
+inline ScalarVec
+vcbrtEstimate(ScalarVec a)
+{
+    uint32_t i;
+
+    std::memcpy(&i, &a.v, sizeof(i));
+    i = (uint32_t)( (float)i * (1.f / 3) ) + 709958130;
+    float f;
+    std::memcpy(&f, &i, sizeof(f));
+
+    return f;
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#if defined(__AVX2__)
+typedef __m256 SimdType;
+#define OFXS_SIMD(op) _mm256_ ## op
+#else
+typedef __m128 SimdType;
+#define OFXS_SIMD(op) _mm_ ## op
+#endif
+
+struct SimdMask
+{
+    SimdType m;
+};
+
+struct SimdVec
+{
+    typedef SimdMask Mask;
+    enum
+    {
+        kWidth = sizeof(SimdType) / sizeof(float)
+    };
+
+    SimdType v;
+
+    SimdVec()
+    {
+    }
+
+    SimdVec(SimdType x)
+        : v(x)
+    {
+    }
+
+    SimdVec(float x)
+        : v( OFXS_SIMD(set1_ps)(x) )
+    {
+    }
+
+    static SimdVec load(const float* p)
+    {
+        return OFXS_SIMD(loadu_ps)(p);
+    }
+
+    void store(float* p) const
+    {
+        OFXS_SIMD(storeu_ps)(p, v);
+    }
+};
+
+inline SimdVec operator +(SimdVec a, SimdVec b) { return OFXS_SIMD(add_ps)(a.v, b.v); }
+inline SimdVec operator -(SimdVec a, SimdVec b) { return OFXS_SIMD(sub_ps)(a.v, b.v); }
+inline SimdVec operator *(SimdVec a, SimdVec b) { return OFXS_SIMD(mul_ps)(a.v, b.v); }
+inline SimdVec operator /(SimdVec a, SimdVec b) { return OFXS_SIMD(div_ps)(a.v, b.v); }
+// same results as std::min and std::max, except for NaNs
+inline SimdVec vmin(SimdVec a, SimdVec b) { return OFXS_SIMD(min_ps)(b.v, a.v); }
+inline SimdVec vmax(SimdVec a, SimdVec b) { return OFXS_SIMD(max_ps)(b.v, a.v); }
+inline SimdMask vor(SimdMask a, SimdMask b) { SimdMask m = { OFXS_SIMD(or_ps)(a.m, b.m) }; return m; }
+inline SimdVec
+vselect(SimdMask m,
+        SimdVec a,
+        SimdVec b)
+{
+    return OFXS_SIMD(or_ps)( OFXS_SIMD(and_ps)(m.m, a.v), OFXS_SIMD(andnot_ps)(m.m, b.v) );
+}
+
+#if defined(__AVX2__)
+inline SimdMask veq(SimdVec a, SimdVec b) { SimdMask m = { _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ) }; return m; }
+inline SimdMask vlt(SimdVec a, SimdVec b) { SimdMask m = { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; return m; }
+inline SimdMask vle(SimdVec a, SimdVec b) { SimdMask m = { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; return m; }
+inline SimdMask vge(SimdVec a, SimdVec b) { SimdMask m = { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; return m; }
+inline SimdVec vfloor(SimdVec a) { return _mm256_floor_ps(a.v); }
+inline SimdVec
+vcbrtEstimate(SimdVec a)
+{
+    const __m256i i = _mm256_cvttps_epi32( _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_castps_si256(a.v) ), _mm256_set1_ps(1.f / 3) ) );
+
+    return _mm256_castsi256_ps( _mm256_add_epi32( i, _mm256_set1_epi32(709958130) ) );
+}
+
+#else
+inline SimdMask veq(SimdVec a, SimdVec b) { SimdMask m = { _mm_cmpeq_ps(a.v, b.v) }; return m; }
+inline SimdMask vlt(SimdVec a, SimdVec b) { SimdMask m = { _mm_cmplt_ps(a.v, b.v) }; return m; }
+inline SimdMask vle(SimdVec a, SimdVec b) { SimdMask m = { _mm_cmple_ps(a.v, b.v) }; return m; }
+inline SimdMask vge(SimdVec a, SimdVec b) { SimdMask m = { _mm_cmpge_ps(a.v, b.v) }; return m; }
+inline SimdVec
+vfloor(SimdVec a)
+{
+#if defined(__SSE4_1__)
+    return _mm_floor_ps(a.v);
+#else
+    // truncate, and subtract 1 if that rounded up
+    const __m128 t = _mm_cvtepi32_ps( _mm_cvttps_epi32(a.v) );
+
+    return _mm_sub_ps( t, _mm_and_ps( _mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.f) ) );
+#endif
+}
+
+inline SimdVec
+vcbrtEstimate(SimdVec a)
+{
+    const __m128i i = _mm_cvttps_epi32( _mm_mul_ps( _mm_cvtepi32_ps( _mm_castps_si128(a.v) ), _mm_set1_ps(1.f / 3) ) );
+
+    return _mm_castsi128_ps( _mm_add_epi32( i, _mm_set1_epi32(709958130) ) );
+}
+
+#endif // if defined(__AVX2__)
+#undef OFXS_SIMD
+#endif // if defined(__AVX2__) || defined(__SSE2__)
+
+// the cube root of a positive value: three Newton iterations after the estimate
+template <class V>
+V
+vcbrt(V a)
+{
+    V y = vcbrtEstimate(a);
+
+    for (int k = 0; k < 3; ++k) {
+        y = (y + y + a / (y * y) ) * (1.f / 3);
+    }
+
+    return y;
+}
+
+// the hue of rgb_to_hsv() and rgb_to_hsl(), given the max of r, g and b, and delta (which is not zero)
+template <class V>
+V
+hueFromMax(V r,
+           V g,
+           V b,
+           V maxv,
+           V delta)
+{
+    const typename V::Mask rIsMax = veq(r, maxv);
+    const typename V::Mask gIsMax = veq(g, maxv);
+    const V num = vselect( rIsMax, g - b, vselect(gIsMax, b - r, r - g) );
+    const V h = ( vselect( rIsMax, V(0.f), vselect( gIsMax, V(2.f), V(4.f) ) ) + num / delta ) * (OFXS_HUE_CIRCLE / 6);
+
+    return vselect(vlt( h, V(0.f) ), h + OFXS_HUE_CIRCLE, h);
+}
+
+// the r, g and b of hsv_to_rgb() and hsl_to_rgb(), given h in [0, 6) modulo 6, and the values of the sector
+template <class V>
+void
+rgbFromSector(V h,
+              V v,
+              V p,
+              V q,
+              V t,
+              V* r,
+              V* g,
+              V* b)
+{
+    const V i = vfloor(h);
+    // take h modulo 360
+    const V sector = i - vfloor( i / V(6.f) ) * 6.f;
+    const typename V::Mask s1 = veq( sector, V(1.f) );
+    const typename V::Mask s2 = veq( sector, V(2.f) );
+    const typename V::Mask s3 = veq( sector, V(3.f) );
+    const typename V::Mask s4 = veq( sector, V(4.f) );
+    const typename V::Mask s5 = veq( sector, V(5.f) );
+
+    // sector: 0    1    2    3    4    5
+    // r:      v    q    p    p    t    v
+    // g:      t    v    v    q    p    p
+    // b:      p    p    t    v    v    q
+    *r = vselect( s1, q, vselect( vor(s2, s3), p, vselect(s4, t, v) ) );
+    *g = vselect( vor(s1, s2), v, vselect( s3, q, vselect(vor(s4, s5), p, t) ) );
+    *b = vselect( s2, t, vselect( vor(s3, s4), v, vselect(s5, q, p) ) );
+}
+
+struct RgbToHsv
+{
+    template <class V>
+    static void apply(V r,
+                      V g,
+                      V b,
+                      V* h,
+                      V* s,
+                      V* v)
+    {
+        const V minv = vmin(vmin(r, g), b);
+        const V maxv = vmax(vmax(r, g), b);
+        const V delta = maxv - minv;
+        // r = g = b = 0: s = 0, h = 0
+        const typename V::Mask black = veq( maxv, V(0.f) );
+
+        *v = maxv;
+        *s = vselect(black, V(0.f), delta / maxv);
+        *h = vselect( vor( black, veq( delta, V(0.f) ) ), V(0.f), hueFromMax(r, g, b, maxv, delta) );
+    }
+};
+
+struct HsvToRgb
+{
+    template <class V>
+    static void apply(V h,
+                      V s,
+                      V v,
+                      V* r,
+                      V* g,
+                      V* b)
+    {
+        h = h * (float)(6. / OFXS_HUE_CIRCLE);            // sector 0 to 5
+        const V f = h - vfloor(h);          // factorial part of h
+        const V p = v * ( 1.f - s );
+        const V q = v * ( 1.f - s * f );
+        const V t = v * ( 1.f - s * ( 1.f - f ) );
+        rgbFromSector(h, v, p, q, t, r, g, b);
+        // achromatic (grey)
+        const typename V::Mask grey = veq( s, V(0.f) );
+        *r = vselect(grey, v, *r);
+        *g = vselect(grey, v, *g);
+        *b = vselect(grey, v, *b);
+    }
+};
+
+struct RgbToHsl
+{
+    template <class V>
+    static void apply(V r,
+                      V g,
+                      V b,
+                      V* h,
+                      V* s,
+                      V* l)
+    {
+        V minv = vmin(vmin(r, g), b);
+        V maxv = vmax(vmax(r, g), b);
+
+        *l = (minv + maxv) / 2.f;
+        minv = vmax(V(0.f), minv);
+        maxv = vmin(V(1.f), maxv);
+        const V delta = maxv - minv;
+        // gray: h = 0, s = 0
+        const typename V::Mask grey = veq( delta, V(0.f) );
+        *s = vselect( grey, V(0.f), vselect( vle( *l, V(0.5f) ), delta / (maxv + minv), delta / ( 2.f - (maxv + minv) ) ) );
+        *h = vselect( grey, V(0.f), hueFromMax(r, g, b, maxv, delta) );
+    }
+};
+
+struct HslToRgb
+{
+    template <class V>
+    static void apply(V h,
+                      V s,
+                      V l,
+                      V* r,
+                      V* g,
+                      V* b)
+    {
+        h = h * (6.f / OFXS_HUE_CIRCLE);            // sector 0 to 5
+        const V f = h - vfloor(h);          // factorial part of h
+        const V v = vselect( vle( l, V(0.5f) ), l * (1.0f + s), l + s - l * s );
+        const V p = l + l - v;
+        const V sv = (v - p ) / v;
+        const V vsf = v * sv * f;
+        const V t = p + vsf;
+        const V q = v - vsf;
+        rgbFromSector(h, v, p, q, t, r, g, b);
+        // achromatic (grey)
+        const typename V::Mask grey = veq( s, V(0.f) );
+        *r = vselect(grey, l, *r);
+        *g = vselect(grey, l, *g);
+        *b = vselect(grey, l, *b);
+    }
+};
+
+struct RgbToYcbcr709
+{
+    template <class V>
+    static void apply(V r,
+                      V g,
+                      V b,
+                      V* y,
+                      V* cb,
+                      V* cr)
+    {
+        *y  =  0.183f * r + 0.614f * g + 0.062f * b + 16 / 255.f;
+        *cb = -0.101f * r - 0.339f * g + 0.439f * b + 128 / 255.f;
+        *cr =  0.439f * r - 0.399f * g - 0.040f * b + 128 / 255.f;
+    }
+};
+
+struct Ycbcr709ToRgb
+{
+    template <class V>
+    static void apply(V y,
+                      V cb,
+                      V cr,
+                      V* r,
+                      V* g,
+                      V* b)
+    {
+        *r = 1.164f * (y - 16 / 255.f) + 1.793f * (cr - 128 / 255.f);
+        *g = 1.164f * (y - 16 / 255.f) - 0.533f * (cr - 128 / 255.f) - 0.213f * (cb - 128 / 255.f);
+        *b = 1.164f * (y - 16 / 255.f) + 2.112f * (cb - 128 / 255.f);
+    }
+};
+
+template <class V>
+V
+vlabf(V x)
+{
+    return vselect( vge( x, V(0.008856f) ), vcbrt(x), 7.787f * x + 16.0f / 116 );
+}
+
+template <class V>
+V
+vlabfi(V x)
+{
+    return vselect( vge( x, V(0.206893f) ), x * x * x, ( x - 16.0f / 116 ) / 7.787f );
+}
+
+struct Rgb709ToLab
+{
+    template <class V>
+    static void apply(V r,
+                      V g,
+                      V b,
+                      V* l,
+                      V* a,
+                      V* b_)
+    {
+        V x, y, z;
+
+        rgb709_to_xyz(r, g, b, &x, &y, &z);
+        const V fx = vlabf( x / (0.412453f + 0.357580f + 0.180423f) );
+        const V fy = vlabf( y / (0.212671f + 0.715160f + 0.072169f) );
+        const V fz = vlabf( z / (0.019334f + 0.119193f + 0.950227f) );
+        *l = 116.f * fy - 16.f;
+        *a = 500.f * (fx - fy);
+        *b_ = 200.f * (fy - fz);
+    }
+};
+
+struct LabToRgb709
+{
+    template <class V>
+    static void apply(V l,
+                      V a,
+                      V b,
+                      V* r,
+                      V* g,
+                      V* b_)
+    {
+        const V cy = (l + 16.f) / 116.f;
+        const V y = (0.212671f + 0.715160f + 0.072169f) * vlabfi(cy);
+        const V cx = a / 500.f + cy;
+        const V x = (0.412453f + 0.357580f + 0.180423f) * vlabfi(cx);
+        const V cz = cy - b / 200.f;
+        const V z = (0.019334f + 0.119193f + 0.950227f) * vlabfi(cz);
+
+        xyz_to_rgb709(x, y, z, r, g, b_);
+    }
+};
+
+template <class CONVERSION>
+void
+convertPlanar(const float* src0,
+              const float* src1,
+              const float* src2,
+              float* dst0,
+              float* dst1,
+              float* dst2,
+              int n)
+{
+    int i = 0;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    for (; i + SimdVec::kWidth <= n; i += SimdVec::kWidth) {
+        SimdVec out0, out1, out2;
+        CONVERSION::apply(SimdVec::load(src0 + i), SimdVec::load(src1 + i), SimdVec::load(src2 + i), &out0, &out1, &out2);
+        out0.store(dst0 + i);
+        out1.store(dst1 + i);
+        out2.store(dst2 + i);
+    }
+#endif
+    for (; i < n; ++i) {
+        ScalarVec out0, out1, out2;
+        CONVERSION::apply(ScalarVec::load(src0 + i), ScalarVec::load(src1 + i), ScalarVec::load(src2 + i), &out0, &out1, &out2);
+        out0.store(dst0 + i);
+        out1.store(dst1 + i);
+        out2.store(dst2 + i);
+    }
+}
+
+// the packed pixels are converted by blocks, which are stored in planar form in a buffer that stays in the L1 cache
+template <class CONVERSION>
+void
+convertPacked(const float* src,
+              float* dst,
+              int n,
+              int nComponents)
+{
+    assert(nComponents == 3 || nComponents == 4);
+    const int kBlockSize = 256;
+    float planes[4 * kBlockSize];
+
+    for (int start = 0; start < n; start += kBlockSize) {
+        const int count = (std::min)(kBlockSize, n - start);
+        const float* blockSrc = src + (size_t)start * nComponents;
+        float* blockDst = dst + (size_t)start * nComponents;
+        float* p0 = planes;
+        float* p1 = planes + count;
+        float* p2 = planes + 2 * count;
+        // the alpha channel, which is written back as is
+        float* p3 = planes + 3 * count;
+        int i = 0;
+#if defined(__SSE2__)
+        if (nComponents == 4) {
+            // 4 RGBA pixels are a 4x4 matrix, which is transposed
+            for (; i + 4 <= count; i += 4) {
+                __m128 c0 = _mm_loadu_ps(blockSrc + i * 4);
+                __m128 c1 = _mm_loadu_ps(blockSrc + i * 4 + 4);
+                __m128 c2 = _mm_loadu_ps(blockSrc + i * 4 + 8);
+                __m128 c3 = _mm_loadu_ps(blockSrc + i * 4 + 12);
+                _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+                _mm_storeu_ps(p0 + i, c0);
+                _mm_storeu_ps(p1 + i, c1);
+                _mm_storeu_ps(p2 + i, c2);
+                _mm_storeu_ps(p3 + i, c3);
+            }
+        }
+#endif
+        for (; i < count; ++i) {
+            p0[i] = blockSrc[i * nComponents];
+            p1[i] = blockSrc[i * nComponents + 1];
+            p2[i] = blockSrc[i * nComponents + 2];
+            if (nComponents == 4) {
+                p3[i] = blockSrc[i * 4 + 3];
+            }
+        }
+        convertPlanar<CONVERSION>(p0, p1, p2, p0, p1, p2, count);
+        i = 0;
+#if defined(__SSE2__)
+        if (nComponents == 4) {
+            for (; i + 4 <= count; i += 4) {
+                __m128 c0 = _mm_loadu_ps(p0 + i);
+                __m128 c1 = _mm_loadu_ps(p1 + i);
+                __m128 c2 = _mm_loadu_ps(p2 + i);
+                __m128 c3 = _mm_loadu_ps(p3 + i);
+                _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+                _mm_storeu_ps(blockDst + i * 4, c0);
+                _mm_storeu_ps(blockDst + i * 4 + 4, c1);
+                _mm_storeu_ps(blockDst + i * 4 + 8, c2);
+                _mm_storeu_ps(blockDst + i * 4 + 12, c3);
+            }
+        }
+#endif
+        for (; i < count; ++i) {
+            blockDst[i * nComponents] = p0[i];
+            blockDst[i * nComponents + 1] = p1[i];
+            blockDst[i * nComponents + 2] = p2[i];
+            if (nComponents == 4) {
+                blockDst[i * 4 + 3] = p3[i];
+            }
+        }
+    }
+}
+} // anon namespace
+
+void
+rgb_to_hsv_packed(const float* src,
+                  float* dst,
+                  int n,
+                  int nComponents)
+{
+    convertPacked<RgbToHsv>(src, dst, n, nComponents);
+}
+
+void
+rgb_to_hsv_planar(const float* r,
+                  const float* g,
+                  const float* b,
+                  float* h,
+                  float* s,
+                  float* v,
+                  int n)
+{
+    convertPlanar<RgbToHsv>(r, g, b, h, s, v, n);
+}
+
+void
+hsv_to_rgb_packed(const float* src,
+                  float* dst,
+                  int n,
+                  int nComponents)
+{
+    convertPacked<HsvToRgb>(src, dst, n, nComponents);
+}
+
+void
+hsv_to_rgb_planar(const float* h,
+                  const float* s,
+                  const float* v,
+                  float* r,
+                  float* g,
+                  float* b,
+                  int n)
+{
+    convertPlanar<HsvToRgb>(h, s, v, r, g, b, n);
+}
+
+void
+rgb_to_hsl_packed(const float* src,
+                  float* dst,
+                  int n,
+                  int nComponents)
+{
+    convertPacked<RgbToHsl>(src, dst, n, nComponents);
+}
+
+void
+rgb_to_hsl_planar(const float* r,
+                  const float* g,
+                  const float* b,
+                  float* h,
+                  float* s,
+                  float* l,
+                  int n)
+{
+    convertPlanar<RgbToHsl>(r, g, b, h, s, l, n);
+}
+
+void
+hsl_to_rgb_packed(const float* src,
+                  float* dst,
+                  int n,
+                  int nComponents)
+{
+    convertPacked<HslToRgb>(src, dst, n, nComponents);
+}
+
+void
+hsl_to_rgb_planar(const float* h,
+                  const float* s,
+                  const float* l,
+                  float* r,
+                  float* g,
+                  float* b,
+                  int n)
+{
+    convertPlanar<HslToRgb>(h, s, l, r, g, b, n);
+}
+
+void
+rgb_to_ycbcr709_packed(const float* src,
+                       float* dst,
+                       int n,
+                       int nComponents)
+{
+    convertPacked<RgbToYcbcr709>(src, dst, n, nComponents);
+}
+
+void
+rgb_to_ycbcr709_planar(const float* r,
+                       const float* g,
+                       const float* b,
+                       float* y,
+                       float* cb,
+                       float* cr,
+                       int n)
+{
+    convertPlanar<RgbToYcbcr709>(r, g, b, y, cb, cr, n);
+}
+
+void
+ycbcr_to_rgb709_packed(const float* src,
+                       float* dst,
+                       int n,
+                       int nComponents)
+{
+    convertPacked<Ycbcr709ToRgb>(src, dst, n, nComponents);
+}
+
+void
+ycbcr_to_rgb709_planar(const float* y,
+                       const float* cb,
+                       const float* cr,
+                       float* r,
+                       float* g,
+                       float* b,
+                       int n)
+{
+    convertPlanar<Ycbcr709ToRgb>(y, cb, cr, r, g, b, n);
+}
+
+void
+rgb709_to_lab_packed(const float* src,
+                     float* dst,
+                     int n,
+                     int nComponents)
+{
+    convertPacked<Rgb709ToLab>(src, dst, n, nComponents);
+}
+
+void
+rgb709_to_lab_planar(const float* r,
+                     const float* g,
+                     const float* b,
+                     float* l,
+                     float* a,
+                     float* b_,
+                     int n)
+{
+    convertPlanar<Rgb709ToLab>(r, g, b, l, a, b_, n);
+}
+
+void
+lab_to_rgb709_packed(const float* src,
+                     float* dst,
+                     int n,
+                     int nComponents)
+{
+    convertPacked<LabToRgb709>(src, dst, n, nComponents);
+}
+
+void
+lab_to_rgb709_planar(const float* l,
+                     const float* a,
+                     const float* b,
+                     float* r,
+                     float* g,
+                     float* b_,
+                     int n)
+{
+    convertPlanar<LabToRgb709>(l, a, b, r, g, b_, n);
+}
 }         // namespace Color
 } //namespace OFX
 
@@ -27,11 +27,17 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <cmath>
 #include <cassert>
+#include <algorithm> // for min, max
 #include <cstring> // for memcpy
-#include <cstdlib> // for rand
 #include <memory> // for auto_ptr
+#if __cplusplus > 199711L           // C++11
+#include <atomic>
+#else
+#include "tinythread.h"
+#endif
 
 #include "ofxCore.h"
 #include "ofxsImageEffect.h"
@@ -133,6 +139,111 @@ typedef float (*fromColorSpaceFunctionV1)(float v);
 /* @brief Converts a float ranging in [0 - 1.f] in  linear color-space to the desired color-space to also ranging in [0 - 1.f]*/
 typedef float (*toColorSpaceFunctionV1)(float v);
 
+/* @brief Transforms a color. This is the signature of the color conversions below (e.g. rgb_to_hsv(), or
+   rgb709_to_xyz<float>()), which can thus be baked into a Lut3D, or added to a ColorTransformChain. */
+typedef void (*colorTransformFunctionV1)(float r, float g, float b, float *rOut, float *gOut, float *bOut);
+
+
+/**
+ * @brief The look-up tables of a Lut.
+ * They are built on the first conversion that needs them, and they are shared by all the Luts of the process
+ * which have the same name and transfer functions, even if they come from different LutManager instances.
+ **/
+struct LutTables
+{
+    unsigned short toFunc_hipart_to_uint8xx[0x10001];                 /// contains  2^16 = 65536 values between 0-0xff00, plus one padding entry for the SIMD gathers
+    float fromFunc_uint8_to_float[256];                 /// values between 0-1.f
+};
+
+/**
+ * @brief The look-up tables of the float to float conversions of a Lut.
+ * They contain the values of the transfer functions for 512 floats per power of two in [2^-16, 2^8),
+ * which are interpolated linearly, see Lut::fromColorSpaceFloatToLinearFloatFast().
+ * They are built on the first float to float conversion, and shared like the LutTables.
+ **/
+struct LutFloatTables
+{
+    enum
+    {
+        kMinBits = 111 << 23,    // the bits of 2^-16, the start of the first interval
+        kMaxBits = 135 << 23,    // the bits of 2^8, the end of the last interval
+        kShift = 14,             // 23 - kShift = 9 mantissa bits give the interval index
+        kSize = ( (kMaxBits - kMinBits) >> kShift ) + 1
+    };
+
+    float toFunc[kSize];
+    float fromFunc[kSize];
+    float toFunc_zero;           /// toFunc(0)
+    float fromFunc_zero;         /// fromFunc(0)
+};
+
+/**
+ * @brief The look-up tables of the 16-bit conversions of a Lut.
+ * fromFunc_uint16_to_float contains the value of fromFunc for each 16-bit value.
+ * toFunc_to_uint16 is its dense inverse: it contains the values of toFunc, scaled to [0, 65535], for 1024 floats
+ * per power of two in [2^-16, 2^8), which are interpolated linearly, see Lut::toColorSpaceUint16FromLinearFloatFast().
+ * They are built on the first 16-bit conversion, and shared like the LutTables.
+ **/
+struct LutUint16Tables
+{
+    enum
+    {
+        kMinBits = 111 << 23,    // the bits of 2^-16, the start of the first interval
+        kMaxBits = 135 << 23,    // the bits of 2^8, the end of the last interval
+        kShift = 13,             // 23 - kShift = 10 mantissa bits give the interval index
+        kSize = ( (kMaxBits - kMinBits) >> kShift ) + 1
+    };
+
+    float fromFunc_uint16_to_float[65536];
+    float toFunc_to_uint16[kSize];   /// values between -65535.f-131070.f
+    float toFunc_zero_to_uint16;     /// toFunc(0), between 0-65535.f
+};
+
+/// a pointer to immutable data (e.g. look-up tables which are built on first use), which is written under a lock,
+/// and read without locking.
+/// The store has release semantics and the load has acquire semantics, so that a thread which reads the pointer
+/// also sees the data that was written before it was published.
+template <class TABLES>
+class LutTablesPtr
+{
+#if __cplusplus > 199711L
+    std::atomic<const TABLES*> _p;
+#else
+    tthread::atomic<const TABLES*> _p;
+#endif
+
+public:
+    LutTablesPtr()
+        : _p(NULL)
+    {
+    }
+
+    const TABLES* load() const
+    {
+#if __cplusplus > 199711L
+        return _p.load(std::memory_order_acquire);
+#else
+        return _p.load(); // a full barrier
+#endif
+    }
+
+    void store(const TABLES* p)
+    {
+#if __cplusplus > 199711L
+        _p.store(p, std::memory_order_release);
+#else
+#ifdef _TTHREAD_HAS_ATOMIC_BUILTINS_
+        // tthread::atomic::store() is only an acquire barrier: make the writes to *p visible before p
+        __sync_synchronize();
+#endif
+        _p.store(p);
+#endif
+    }
+
+private:
+    LutTablesPtr &operator= (const LutTablesPtr &);
+    LutTablesPtr(const LutTablesPtr &);
+};
 
 /**
  * @brief A Lut (look-up table) used to speed-up color-spaces conversions.
@@ -147,10 +258,11 @@ class Lut
     fromColorSpaceFunctionV1 _fromFunc;
     toColorSpaceFunctionV1 _toFunc;
 
-    /// the fast lookup tables are mutable, because they are automatically initialized post-construction,
+    /// the fast lookup tables are mutable, because they are built on the first conversion (see getTables()),
     /// and never change afterwards
-    mutable unsigned short toFunc_hipart_to_uint8xx[0x10000];                 /// contains  2^16 = 65536 values between 0-255
-    mutable float fromFunc_uint8_to_float[256];                 /// values between 0-1.f
+    mutable LutTablesPtr<LutTables> _tables;
+    mutable LutTablesPtr<LutFloatTables> _floatTables;
+    mutable LutTablesPtr<LutUint16Tables> _uint16Tables;
 
 private:
     // Luts should be allocated and destroyed  through the LutManager
@@ -160,41 +272,151 @@ private:
         : _name(name)
         , _fromFunc(fromFunc)
         , _toFunc(toFunc)
+        , _tables()
+        , _floatTables()
+        , _uint16Tables()
     {
-        fillTables();
     }
 
     virtual ~Lut()
     {
+        releaseTables();
     }
 
+    Lut &operator= (const Lut &);
+    Lut(const Lut &);
 
-    ///init luts
-    ///it uses fromColorSpaceFloatToLinearFloat(float) and toColorSpaceFloatFromLinearFloat(float)
-    ///Called by validate()
-    void fillTables() const
+    /// the lookup tables, which are built (or retrieved from another Lut with the same name
+    /// and functions) on the first call. This is thread-safe.
+    const LutTables& getTables() const
+    {
+        const LutTables* tables = _tables.load();
+
+        if (!tables) {
+            tables = acquireTables();
+        }
+
+        return *tables;
+    }
+
+    /// the tables of the float to float conversions, see getTables()
+    const LutFloatTables& getFloatTables() const
+    {
+        const LutFloatTables* tables = _floatTables.load();
+
+        if (!tables) {
+            tables = acquireFloatTables();
+        }
+
+        return *tables;
+    }
+
+    /// the tables of the 16-bit conversions, see getTables()
+    const LutUint16Tables& getUint16Tables() const
+    {
+        const LutUint16Tables* tables = _uint16Tables.load();
+
+        if (!tables) {
+            tables = acquireUint16Tables();
+        }
+
+        return *tables;
+    }
+
+    /// slow paths of getTables(), getFloatTables() and getUint16Tables()
+    const LutTables* acquireTables() const;
+    const LutFloatTables* acquireFloatTables() const;
+    const LutUint16Tables* acquireUint16Tables() const;
+
+    /// drops the references of this Lut to the shared tables
+    void releaseTables();
+
+    static void fillFloatTables(fromColorSpaceFunctionV1 fromFunc, toColorSpaceFunctionV1 toFunc, LutFloatTables* tables);
+    static void fillUint16Tables(fromColorSpaceFunctionV1 fromFunc, toColorSpaceFunctionV1 toFunc, LutUint16Tables* tables);
+
+    // interpolates linearly in a table which contains the values of a function at the ends of the intervals
+    // defined by TABLES (LutFloatTables or LutUint16Tables).
+    // Returns false if v is outside of the table (including zero, negative values and NaN).
+    template <class TABLES>
+    static bool interpolateTable(const float* table,
+                                 float v,
+                                 float* result)
+    {
+        unsigned int bits;
+
+        std::memcpy( &bits, &v, sizeof(bits) );
+        // this also rejects the negative values, whose sign bit is set
+        const unsigned int offset = bits - (unsigned int)TABLES::kMinBits;
+        if ( offset < (unsigned int)(TABLES::kMaxBits - TABLES::kMinBits) ) {
+            const unsigned int i = offset >> TABLES::kShift;
+            const float a = (float)( offset & ( (1u << TABLES::kShift) - 1 ) ) * ( 1.f / (1u << TABLES::kShift) );
+            *result = table[i] + a * (table[i + 1] - table[i]);
+
+            return true;
+        }
+
+        return false;
+    }
+
+    // the array version of interpolateTable(): the values outside of the table are computed by fallback(v).
+    // Defined in ofxsLut.cpp, where it is instantiated.
+    template <class TABLES, class FALLBACK>
+    static void interpolateTable(const float* table,
+                                 const FALLBACK& fallback,
+                                 const float* src,
+                                 float* dst,
+                                 int n);
+
+    // interpolates the values of a transfer function in a table of LutFloatTables, or calls the function
+    // outside of the table
+    static float interpolateFloat(const float* table,
+                                  float zero,
+                                  float (*func)(float),
+                                  float v)
+    {
+        float result;
+
+        if ( interpolateTable<LutFloatTables>(table, v, &result) ) {
+            return result;
+        }
+        if (v == 0.f) {
+            return zero;
+        }
+
+        return func(v);
+    }
+
+    // the 16-bit conversions, with tables that were already retrieved by getUint16Tables().
+    static unsigned short toColorSpaceUint16FromLinearFloatFast(const LutUint16Tables& tables,
+                                                                toColorSpaceFunctionV1 toFunc,
+                                                                float v)
     {
-        // fill all
-        for (int i = 0; i < 0x10000; ++i) {
-            float inp = index_to_float( (unsigned short)i );
-            float f = _toFunc(inp);
-            toFunc_hipart_to_uint8xx[i] = Color::floatToInt<0xff01>(f);
+        float result;
+
+        if ( interpolateTable<LutUint16Tables>(tables.toFunc_to_uint16, v, &result) ) {
+            return (unsigned short)( (std::min)( (std::max)( 0.f, result ), 65535.f ) + 0.5f );
         }
-        // fill fromFunc_uint8_to_float, and make sure that
-        // the entries of toFunc_hipart_to_uint8xx corresponding
-        // to the transform of each byte value contain the same value,
-        // so that toFunc(fromFunc(b)) is identity
-        //
-        for (int b = 0; b < 256; ++b) {
-            float f = _fromFunc( Color::intToFloat<256>(b) );
-            fromFunc_uint8_to_float[b] = f;
-            int i = hipart(f);
-            toFunc_hipart_to_uint8xx[i] = Color::charToUint8xx(b);
+        if (v == 0.f) {
+            return (unsigned short)(tables.toFunc_zero_to_uint16 + 0.5f);
         }
+
+        // same as floatToInt<65536>(), but NaN gives 0, as in the array version
+        return (unsigned short)( (std::min)( (std::max)( 0.f, toFunc(v) ), 1.f ) * 65535.f + 0.5f );
+    }
+
+    static float fromColorSpaceUint16ToLinearFloatFast(const LutUint16Tables& tables,
+                                                       unsigned short v)
+    {
+        return tables.fromFunc_uint16_to_float[v];
     }
 
 public:
 
+    ///init luts
+    ///it uses the given transfer functions.
+    ///Called by getTables(), and by ofxsLutTablesGenerator to generate the tables of the built-in Luts at build time
+    static void fillTables(fromColorSpaceFunctionV1 fromFunc, toColorSpaceFunctionV1 toFunc, LutTables* tables);
+
     /* @brief Converts a float ranging in [0 - 1.f] in the desired color-space to linear color-space also ranging in [0 - 1.f]
      * This function is not fast!
      * @see fromColorSpaceFloatToLinearFloatFast(float)
@@ -212,18 +434,48 @@ public:
         return _toFunc(v);
     }
 
-    /* @brief Converts a float ranging in [0 - 1.f] in linear color-space using the look-up tables.
-     * @return A float in [0 - 1.f] in the destination color-space.
+    /* @brief Converts a float in the desired color-space to linear color-space, using interpolated look-up tables.
+     * For v in [2^-16, 256), the transfer function is interpolated linearly between 512 values per power of two.
+     * The other values (zero, negative, very small or large values, NaN) use the transfer function itself.
+     * The maximum error on the built-in Luts, which is absolute for results in [-1, 1] and relative for larger results, is:
+     * - 1.1e-5 for the from functions (decoding) and 4.3e-6 for the to functions (encoding) on [0, 1];
+     * - 4.3e-6 for the to functions on [2^-16, 256), but up to 3e-3 for the exponential from functions (log decoding)
+     *   of values above 1.
      */
-    // It is not recommended to use this function, because the output is quantized
-    // If one really needs float, one has to use the full function (or OpenColorIO)
+    float fromColorSpaceFloatToLinearFloatFast(float v) const WARN_UNUSED_RETURN
+    {
+        const LutFloatTables& tables = getFloatTables();
+
+        return interpolateFloat(tables.fromFunc, tables.fromFunc_zero, _fromFunc, v);
+    }
+
+    /* @brief Converts a float in linear color-space to the desired color-space, using interpolated look-up tables.
+     * @see fromColorSpaceFloatToLinearFloatFast(float)
+     */
+    float toColorSpaceFloatFromLinearFloatFast(float v) const WARN_UNUSED_RETURN
+    {
+        const LutFloatTables& tables = getFloatTables();
+
+        return interpolateFloat(tables.toFunc, tables.toFunc_zero, _toFunc, v);
+    }
+
+    /* @brief Converts n floats in the desired color-space to linear color-space.
+     * This is the array version of fromColorSpaceFloatToLinearFloatFast(float), which uses SIMD instructions
+     * if the code is compiled for AVX2 or SSE4.1. src and dst may be the same buffer.
+     */
+    void fromColorSpaceFloatToLinearFloatFast(const float* src, float* dst, int n) const;
+
+    /* @brief Converts n floats in linear color-space to the desired color-space.
+     * This is the array version of toColorSpaceFloatFromLinearFloatFast(float). src and dst may be the same buffer.
+     */
+    void toColorSpaceFloatFromLinearFloatFast(const float* src, float* dst, int n) const;
 
     /* @brief Converts a float ranging in [0 - 1.f] in linear color-space using the look-up tables.
      * @return A byte in [0 - 255] in the destination color-space.
      */
     unsigned char toColorSpaceUint8FromLinearFloatFast(float v) const WARN_UNUSED_RETURN
     {
-        return Color::uint8xxToChar(toFunc_hipart_to_uint8xx[hipart(v)]);
+        return Color::uint8xxToChar(getTables().toFunc_hipart_to_uint8xx[hipart(v)]);
     }
 
     /* @brief Converts a float ranging in [0 - 1.f] in linear color-space using the look-up tables.
@@ -231,81 +483,68 @@ public:
      */
     unsigned short toColorSpaceUint8xxFromLinearFloatFast(float v) const WARN_UNUSED_RETURN
     {
-        return toFunc_hipart_to_uint8xx[hipart(v)];
+        return getTables().toFunc_hipart_to_uint8xx[hipart(v)];
     }
 
-    // the following only works for increasing LUTs
-
     /* @brief Converts a float ranging in [0 - 1.f] in linear color-space using the look-up tables.
      * @return An unsigned short in [0 - 65535] in the destination color-space.
-     * This function uses localluy linear approximations of the transfer function.
+     * This function interpolates linearly between 1024 values of the transfer function per power of two,
+     * so that the result is at most one off the exact rounded value.
+     * The 16-bit tables are only built on the first 16-bit conversion.
      */
     unsigned short toColorSpaceUint16FromLinearFloatFast(float v) const WARN_UNUSED_RETURN
     {
-        // algorithm:
-        // - convert to 8 bits -> val8u
-        // - convert val8u-1, val8u and val8u+1 to float
-        // - interpolate linearly in the right interval
-        unsigned char v8u = toColorSpaceUint8FromLinearFloatFast(v);
-        unsigned char v8u_next, v8u_prev;
-        float v32f_next, v32f_prev;
-        if (v8u == 0) {
-            v8u_prev = 0;
-            v8u_next = 1;
-            v32f_prev = fromColorSpaceUint8ToLinearFloatFast(0);
-            v32f_next = fromColorSpaceUint8ToLinearFloatFast(1);
-        } else if (v8u == 255) {
-            v8u_prev = 254;
-            v8u_next = 255;
-            v32f_prev = fromColorSpaceUint8ToLinearFloatFast(254);
-            v32f_next = fromColorSpaceUint8ToLinearFloatFast(255);
-        } else {
-            float v32f = fromColorSpaceUint8ToLinearFloatFast(v8u);
-            // we suppose the LUT is an increasing func
-            if (v < v32f) {
-                v8u_prev = v8u - 1;
-                v32f_prev = fromColorSpaceUint8ToLinearFloatFast(v8u_prev);
-                v8u_next = v8u;
-                v32f_next = v32f;
-            } else {
-                v8u_prev = v8u;
-                v32f_prev = v32f;
-                v8u_next = v8u + 1;
-                v32f_next = fromColorSpaceUint8ToLinearFloatFast(v8u_next);
-            }
-        }
-
-        // interpolate linearly
-        return (short)((v8u_prev << 8) + v8u_prev + (v - v32f_prev) * ( ( (v8u_next - v8u_prev) << 8 ) + (v8u_next + v8u_prev) ) / (v32f_next - v32f_prev) + 0.5f);
+        return toColorSpaceUint16FromLinearFloatFast(getUint16Tables(), _toFunc, v);
     }
 
+    /* @brief Converts n floats in linear color-space to bytes in the destination color-space, using the look-up tables.
+     * This is the array version of toColorSpaceUint8FromLinearFloatFast(float), which uses SIMD instructions
+     * if the code is compiled for AVX2 or SSE4.1.
+     */
+    void toColorSpaceUint8FromLinearFloatFast(const float* src, unsigned char* dst, int n) const;
+
+    /* @brief Converts n floats in linear color-space to values in [0 - 0xff00] in the destination color-space.
+     * This is the array version of toColorSpaceUint8xxFromLinearFloatFast(float).
+     */
+    void toColorSpaceUint8xxFromLinearFloatFast(const float* src, unsigned short* dst, int n) const;
+
+    /* @brief Converts n floats in linear color-space to unsigned shorts in the destination color-space.
+     * This is the array version of toColorSpaceUint16FromLinearFloatFast(float), which uses SIMD instructions
+     * if the code is compiled for AVX2 or SSE4.1.
+     */
+    void toColorSpaceUint16FromLinearFloatFast(const float* src, unsigned short* dst, int n) const;
+
     /* @brief Converts a byte ranging in [0 - 255] in the destination color-space using the look-up tables.
      * @return A float in [0 - 1.f] in linear color-space.
      */
     float fromColorSpaceUint8ToLinearFloatFast(unsigned char v) const WARN_UNUSED_RETURN
     {
-        return fromFunc_uint8_to_float[v];
+        return getTables().fromFunc_uint8_to_float[v];
     }
 
     /* @brief Converts a short ranging in [0 - 65535] in the destination color-space using the look-up tables.
      * @return A float in [0 - 1.f] in linear color-space.
+     * The 16-bit table contains the exact value for each short, and is only built on the first 16-bit conversion.
      */
     float fromColorSpaceUint16ToLinearFloatFast(unsigned short v) const WARN_UNUSED_RETURN
     {
-        // the following is from ImageMagick's quantum.h
-        unsigned char v8u_prev = ( v - (v >> 8) ) >> 8;
-        unsigned char v8u_next = v8u_prev + 1;
-        unsigned short v16u_prev = (v8u_prev << 8) + v8u_prev;
-        unsigned short v16u_next = (v8u_next << 8) + v8u_next;
-        float v32f_prev = fromColorSpaceUint8ToLinearFloatFast(v8u_prev);
-        float v32f_next = fromColorSpaceUint8ToLinearFloatFast(v8u_next);
-
-        // interpolate linearly
-        return v32f_prev + (v - v16u_prev) * (v32f_next - v32f_prev) / (v16u_next - v16u_prev);
+        return fromColorSpaceUint16ToLinearFloatFast(getUint16Tables(), v);
     }
 
+    /* @brief Converts n bytes in the destination color-space to floats in linear color-space.
+     * This is the array version of fromColorSpaceUint8ToLinearFloatFast(unsigned char).
+     */
+    void fromColorSpaceUint8ToLinearFloatFast(const unsigned char* src, float* dst, int n) const;
+
+    /* @brief Converts n unsigned shorts in the destination color-space to floats in linear color-space.
+     * This is the array version of fromColorSpaceUint16ToLinearFloatFast(unsigned short), which uses SIMD
+     * instructions if the code is compiled for AVX2.
+     */
+    void fromColorSpaceUint16ToLinearFloatFast(const unsigned short* src, float* dst, int n) const;
+
     /* @brief convert from float to byte with dithering (error diffusion).
-     It uses random numbers for error diffusion, and thus the result is different at each function call. */
+     The error diffusion in each row starts at a pseudo-random position, which only depends on the row index,
+     so that the result is reproducible. The rows are processed in parallel. */
     void to_byte_packed_dither(const void* pixelData,
                                const OfxRectI & bounds,
                                OFX::PixelComponentEnum pixelComponents,
@@ -333,60 +572,12 @@ public:
         }
         //validate();
 
-        const int nComponents = dstPixelComponentCount;
         assert(dstPixelComponentCount == 3 || dstPixelComponentCount == 4);
 
-        for (int y = renderWindow.y1; y < renderWindow.y2; ++y) {
-            // coverity[dont_call]
-            int xstart = renderWindow.x1 + std::rand() % (renderWindow.x2 - renderWindow.x1);
-            unsigned error[3] = {
-                0x80, 0x80, 0x80
-            };
-            const float *src_pixels = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, xstart, y);
-            unsigned char *dst_pixels = (unsigned char*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponents, dstBitDepth, dstRowBytes, xstart, y);
-
-            /* go forward from starting point to end of line: */
-            const float *src_end = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, renderWindow.x2, y, false);
-
-            while (src_pixels < src_end) {
-                for (int k = 0; k < 3; ++k) {
-                    error[k] = (error[k] & 0xff) + toColorSpaceUint8xxFromLinearFloatFast(src_pixels[k]);
-                    assert(error[k] < 0x10000);
-                    dst_pixels[k] = (unsigned char)(error[k] >> 8);
-                }
-                if (nComponents == 4) {
-                    // alpha channel: no dithering
-                    dst_pixels[3] = floatToInt<256>(src_pixels[3]);
-                }
-                dst_pixels += nComponents;
-                src_pixels += nComponents;
-            }
-
-            if (xstart > 0) {
-                /* go backward from starting point to start of line: */
-                src_pixels = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, xstart - 1, y);
-                src_end = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, 0, y);
-                dst_pixels = (unsigned char*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponents, dstBitDepth, dstRowBytes, xstart - 1, y);
-
-                for (int i = 0; i < 3; ++i) {
-                    error[i] = 0x80;
-                }
-
-                while (src_pixels >= src_end) {
-                    for (int k = 0; k < 3; ++k) {
-                        error[k] = (error[k] & 0xff) + toColorSpaceUint8xxFromLinearFloatFast(src_pixels[k]);
-                        assert(error[k] < 0x10000);
-                        dst_pixels[k] = (unsigned char)(error[k] >> 8);
-                    }
-                    if (nComponents == 4) {
-                        // alpha channel: no colorspace conversion & no dithering
-                        dst_pixels[3] = floatToInt<256>(src_pixels[3]);
-                    }
-                    dst_pixels -= nComponents;
-                    src_pixels -= nComponents;
-                }
-            }
-        }
+        DitherProcessor processor(*this, pixelData, bounds, pixelComponentCount, bitDepth, rowBytes,
+                                  renderWindow,
+                                  dstPixelData, dstBounds, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+        processor.process();
     } // to_byte_packed_dither
 
     /* @brief convert from float to byte without dithering. */
@@ -413,13 +604,25 @@ public:
                dstBounds.y1 <= renderWindow.y1 && renderWindow.y2 <= dstBounds.y2);
         //validate();
 
+        const LutTables& tables = getTables();
         const int srcComponents = pixelComponentCount;
         const int dstComponents = dstPixelComponentCount;
+        const int width = renderWindow.x2 - renderWindow.x1;
 
         for (int y = renderWindow.y1; y < renderWindow.y2; ++y) {
-            const float *src_pixels = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, 0, y);
-            unsigned char *dst_pixels = (unsigned char*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponents, dstBitDepth, dstRowBytes, 0, y);
-            const float *src_end = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, renderWindow.x2, y, false);
+            const float *src_pixels = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x1, y);
+            unsigned char *dst_pixels = (unsigned char*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponentCount, dstBitDepth, dstRowBytes, renderWindow.x1, y);
+            if ( (srcComponents == dstComponents) && (srcComponents >= 3) ) {
+                // convert the whole row, then fix the alpha channel (no colorspace conversion)
+                toColorSpaceUint8FromLinearFloatFast(src_pixels, dst_pixels, width * srcComponents);
+                if (srcComponents == 4) {
+                    for (int x = 0; x < width; ++x) {
+                        dst_pixels[x * 4 + 3] = floatToInt<256>(src_pixels[x * 4 + 3]);
+                    }
+                }
+                continue;
+            }
+            const float *src_end = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x2, y, false);
             unsigned char tmpPixel[4] = {0, 0, 0, 0};
             while (src_pixels != src_end) {
                 if (srcComponents == 1) {
@@ -427,7 +630,7 @@ public:
                     tmpPixel[3] = floatToInt<256>(src_pixels[0]);
                 } else {
                     for (int k = 0; k < 3; ++k) {
-                        tmpPixel[k] = toColorSpaceUint8FromLinearFloatFast(src_pixels[k]);
+                        tmpPixel[k] = Color::uint8xxToChar(tables.toFunc_hipart_to_uint8xx[hipart(src_pixels[k])]);
                     }
                     if (srcComponents == 4) {
                         // alpha channel: no colorspace conversion
@@ -476,14 +679,15 @@ public:
 
         const int srcComponents = pixelComponentCount;
 
+        const LutTables& tables = getTables();
         for (int y = renderWindow.y1; y < renderWindow.y2; ++y) {
-            const float *src_pixels = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, 0, y);
-            unsigned char *dst_pixels = (unsigned char*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponents, dstBitDepth, dstRowBytes, 0, y);
-            const float *src_end = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, renderWindow.x2, y, false);
+            const float *src_pixels = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x1, y);
+            unsigned char *dst_pixels = (unsigned char*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponentCount, dstBitDepth, dstRowBytes, renderWindow.x1, y);
+            const float *src_end = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x2, y, false);
 
             while (src_pixels != src_end) {
                 float l = 0.2126f * src_pixels[0] + 0.7152f * src_pixels[1] + 0.0722f * src_pixels[2]; // Rec.709 luminance formula
-                dst_pixels[0] = toColorSpaceUint8FromLinearFloatFast(l);
+                dst_pixels[0] = Color::uint8xxToChar(tables.toFunc_hipart_to_uint8xx[hipart(l)]);
                 ++dst_pixels;
                 src_pixels += srcComponents;
             }
@@ -514,27 +718,25 @@ public:
         //validate();
 
         const int nComponents = pixelComponentCount;
+        const int width = renderWindow.x2 - renderWindow.x1;
 
         for (int y = renderWindow.y1; y < renderWindow.y2; ++y) {
-            const float *src_pixels = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, 0, y);
-            unsigned short *dst_pixels = (unsigned short*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponents, dstBitDepth, dstRowBytes, 0, y);
-            const float *src_end = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, renderWindow.x2, y, false);
+            const float *src_pixels = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x1, y);
+            unsigned short *dst_pixels = (unsigned short*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponentCount, dstBitDepth, dstRowBytes, renderWindow.x1, y);
 
-            while (src_pixels != src_end) {
-                if (nComponents == 1) {
-                    // alpha channel: no colorspace conversion
-                    dst_pixels[0] = floatToInt<65536>(src_pixels[0]);
-                } else {
-                    for (int k = 0; k < 3; ++k) {
-                        dst_pixels[k] = toColorSpaceUint16FromLinearFloatFast(src_pixels[k]);
-                    }
-                    if (nComponents == 4) {
-                        // alpha channel: no colorspace conversion
-                        dst_pixels[3] = floatToInt<65536>(src_pixels[3]);
+            if (nComponents == 1) {
+                // alpha channel: no colorspace conversion
+                for (int x = 0; x < width; ++x) {
+                    dst_pixels[x] = floatToInt<65536>(src_pixels[x]);
+                }
+            } else {
+                // convert the whole row, then fix the alpha channel (no colorspace conversion)
+                toColorSpaceUint16FromLinearFloatFast(src_pixels, dst_pixels, width * nComponents);
+                if (nComponents == 4) {
+                    for (int x = 0; x < width; ++x) {
+                        dst_pixels[x * 4 + 3] = floatToInt<65536>(src_pixels[x * 4 + 3]);
                     }
                 }
-                dst_pixels += nComponents;
-                src_pixels += nComponents;
             }
         }
     }
@@ -561,20 +763,21 @@ public:
         unused(dstPixelComponentCount);
         //validate();
 
+        const LutTables& tables = getTables();
         const int nComponents = pixelComponentCount;
 
         for (int y = renderWindow.y1; y < renderWindow.y2; ++y) {
-            const unsigned char *src_pixels = (const unsigned char*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, 0, y);
-            float *dst_pixels = (float*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponents, dstBitDepth, dstRowBytes, 0, y);
-            const unsigned char *src_end = (const unsigned char*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, renderWindow.x2, y, false);
+            const unsigned char *src_pixels = (const unsigned char*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x1, y);
+            float *dst_pixels = (float*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponentCount, dstBitDepth, dstRowBytes, renderWindow.x1, y);
+            const unsigned char *src_end = (const unsigned char*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x2, y, false);
 
 
             while (src_pixels != src_end) {
                 if (nComponents == 1) {
-                    *dst_pixels++ = intToFloat<256>(*src_pixels++);
+                    dst_pixels[0] = intToFloat<256>(src_pixels[0]);
                 } else {
                     for (int k = 0; k < 3; ++k) {
-                        dst_pixels[k] = fromColorSpaceUint8ToLinearFloatFast(src_pixels[k]);
+                        dst_pixels[k] = tables.fromFunc_uint8_to_float[src_pixels[k]];
                     }
                     if (nComponents == 4) {
                         // alpha channel: no colorspace conversion
@@ -610,34 +813,174 @@ public:
         //validate();
 
         const int nComponents = pixelComponentCount;
+        const int width = renderWindow.x2 - renderWindow.x1;
 
         for (int y = renderWindow.y1; y < renderWindow.y2; ++y) {
-            const unsigned short *src_pixels = (const unsigned short*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, 0, y);
-            float *dst_pixels = (float*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponents, dstBitDepth, dstRowBytes, 0, y);
-            const unsigned short *src_end = (const unsigned short*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, renderWindow.x2, y, false);
+            const unsigned short *src_pixels = (const unsigned short*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x1, y);
+            float *dst_pixels = (float*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponentCount, dstBitDepth, dstRowBytes, renderWindow.x1, y);
 
+            if (nComponents == 1) {
+                for (int x = 0; x < width; ++x) {
+                    dst_pixels[x] = intToFloat<65536>(src_pixels[x]);
+                }
+            } else {
+                // convert the whole row, then fix the alpha channel (no colorspace conversion)
+                fromColorSpaceUint16ToLinearFloatFast(src_pixels, dst_pixels, width * nComponents);
+                if (nComponents == 4) {
+                    for (int x = 0; x < width; ++x) {
+                        dst_pixels[x * 4 + 3] = intToFloat<65536>(src_pixels[x * 4 + 3]);
+                    }
+                }
+            }
+        }
+    }
 
-            while (src_pixels != src_end) {
-                if (nComponents == 1) {
-                    *dst_pixels++ = intToFloat<65536>(*src_pixels++);
-                } else {
+private:
+    static float index_to_float(const unsigned short i);
+
+    // a counter-based random number: the finalizer of MurmurHash3 applied to i.
+    // It is used instead of rand(), which is not reentrant and gives a different result at each call.
+    static unsigned int hashIndex(unsigned int i)
+    {
+        i += 0x9e3779b9u;
+        i ^= i >> 16;
+        i *= 0x85ebca6bu;
+        i ^= i >> 13;
+        i *= 0xc2b2ae35u;
+        i ^= i >> 16;
+
+        return i;
+    }
+
+    // converts the rows of to_byte_packed_dither() in parallel. Each row is dithered independently.
+    class DitherProcessor
+        : public OFX::MultiThread::Processor
+    {
+        const Lut& _lut;
+        const void* _pixelData;
+        OfxRectI _bounds;
+        int _pixelComponentCount;
+        OFX::BitDepthEnum _bitDepth;
+        int _rowBytes;
+        OfxRectI _renderWindow;
+        void* _dstPixelData;
+        OfxRectI _dstBounds;
+        int _dstPixelComponentCount;
+        OFX::BitDepthEnum _dstBitDepth;
+        int _dstRowBytes;
+
+    public:
+        DitherProcessor(const Lut& lut,
+                        const void* pixelData,
+                        const OfxRectI & bounds,
+                        int pixelComponentCount,
+                        OFX::BitDepthEnum bitDepth,
+                        int rowBytes,
+                        const OfxRectI & renderWindow,
+                        void* dstPixelData,
+                        const OfxRectI & dstBounds,
+                        int dstPixelComponentCount,
+                        OFX::BitDepthEnum dstBitDepth,
+                        int dstRowBytes)
+            : _lut(lut)
+            , _pixelData(pixelData)
+            , _bounds(bounds)
+            , _pixelComponentCount(pixelComponentCount)
+            , _bitDepth(bitDepth)
+            , _rowBytes(rowBytes)
+            , _renderWindow(renderWindow)
+            , _dstPixelData(dstPixelData)
+            , _dstBounds(dstBounds)
+            , _dstPixelComponentCount(dstPixelComponentCount)
+            , _dstBitDepth(dstBitDepth)
+            , _dstRowBytes(dstRowBytes)
+        {
+        }
+
+        void process()
+        {
+            const int w = _renderWindow.x2 - _renderWindow.x1;
+            const int h = _renderWindow.y2 - _renderWindow.y1;
+
+            if ( (w <= 0) || (h <= 0) ) {
+                return;
+            }
+            // make sure there are at least 4096 pixels per CPU and at least 1 line par CPU
+            unsigned int nCPUs = (unsigned int)( (std::min)(w, 4096) * h ) / 4096;
+            nCPUs = (std::max)( 1u, (std::min)( nCPUs, OFX::MultiThread::getNumCPUs() ) );
+            multiThread(nCPUs);
+        }
+
+        void multiThreadFunction(unsigned int threadId,
+                                 unsigned int nThreads)
+        {
+            const LutTables& tables = _lut.getTables();
+            const int nComponents = _dstPixelComponentCount;
+            int y1, y2;
+
+            MultiThread::getThreadRange(threadId, nThreads, _renderWindow.y1, _renderWindow.y2, &y1, &y2);
+            for (int y = y1; y < y2; ++y) {
+                int xstart = _renderWindow.x1 + (int)( hashIndex( (unsigned int)y ) % (unsigned int)(_renderWindow.x2 - _renderWindow.x1) );
+                unsigned error[3] = {
+                    0x80, 0x80, 0x80
+                };
+                const float *src_pixels = (const float*)OFX::getPixelAddress(_pixelData, _bounds, _pixelComponentCount, _bitDepth, _rowBytes, xstart, y);
+                unsigned char *dst_pixels = (unsigned char*)OFX::getPixelAddress(_dstPixelData, _dstBounds, _dstPixelComponentCount, _dstBitDepth, _dstRowBytes, xstart, y);
+
+                /* go forward from starting point to end of line: */
+                const float *src_end = (const float*)OFX::getPixelAddress(_pixelData, _bounds, _pixelComponentCount, _bitDepth, _rowBytes, _renderWindow.x2, y, false);
+
+                while (src_pixels < src_end) {
                     for (int k = 0; k < 3; ++k) {
-                        dst_pixels[k] = fromColorSpaceUint16ToLinearFloatFast(src_pixels[k]);
+                        error[k] = (error[k] & 0xff) + tables.toFunc_hipart_to_uint8xx[hipart(src_pixels[k])];
+                        assert(error[k] < 0x10000);
+                        dst_pixels[k] = (unsigned char)(error[k] >> 8);
                     }
                     if (nComponents == 4) {
-                        // alpha channel: no colorspace conversion
-                        dst_pixels[3] = intToFloat<65536>(src_pixels[3]);
+                        // alpha channel: no dithering
+                        dst_pixels[3] = floatToInt<256>(src_pixels[3]);
+                    }
+                    dst_pixels += nComponents;
+                    src_pixels += nComponents;
+                }
+
+                if (xstart > _renderWindow.x1) {
+                    /* go backward from starting point to start of line: */
+                    src_pixels = (const float*)OFX::getPixelAddress(_pixelData, _bounds, _pixelComponentCount, _bitDepth, _rowBytes, xstart - 1, y);
+                    src_end = (const float*)OFX::getPixelAddress(_pixelData, _bounds, _pixelComponentCount, _bitDepth, _rowBytes, _renderWindow.x1, y);
+                    dst_pixels = (unsigned char*)OFX::getPixelAddress(_dstPixelData, _dstBounds, _dstPixelComponentCount, _dstBitDepth, _dstRowBytes, xstart - 1, y);
+
+                    for (int i = 0; i < 3; ++i) {
+                        error[i] = 0x80;
+                    }
+
+                    while (src_pixels >= src_end) {
+                        for (int k = 0; k < 3; ++k) {
+                            error[k] = (error[k] & 0xff) + tables.toFunc_hipart_to_uint8xx[hipart(src_pixels[k])];
+                            assert(error[k] < 0x10000);
+                            dst_pixels[k] = (unsigned char)(error[k] >> 8);
+                        }
+                        if (nComponents == 4) {
+                            // alpha channel: no colorspace conversion & no dithering
+                            dst_pixels[3] = floatToInt<256>(src_pixels[3]);
+                        }
+                        dst_pixels -= nComponents;
+                        src_pixels -= nComponents;
                     }
                 }
-                dst_pixels += nComponents;
-                src_pixels += nComponents;
             }
         }
-    }
+    };
 
-private:
-    static float index_to_float(const unsigned short i);
-    static unsigned short hipart(const float f);
+    // the 16 high bits of the IEEE 754 representation of f (sign, exponent and 7 bits of mantissa)
+    static unsigned short hipart(const float f)
+    {
+        unsigned int bits;
+
+        std::memcpy( &bits, &f, sizeof(bits) );
+
+        return (unsigned short)(bits >> 16);
+    }
 };
 
 
@@ -1149,10 +1492,45 @@ void lab_to_xyz( float l, float a, float b, float *x, float *y, float *z );
 void rgb709_to_lab( float r, float g, float b, float *l, float *a, float *b_ );
 void lab_to_rgb709( float l, float a, float b, float *r, float *g, float *b_ );
 
+/* Batch versions of rgb_to_hsv(), rgb_to_hsl(), rgb_to_ycbcr709(), rgb709_to_lab() and their inverses, for rows of pixels.
+ * The _packed functions convert n packed RGB (nComponents = 3) or RGBA (nComponents = 4) pixels, and copy the
+ * alpha channel. The _planar functions convert n pixels stored in three arrays, one per channel.
+ * src and dst may be the same buffers.
+ * The conversions are branchless, and use SIMD instructions if the code is compiled for AVX2 or SSE2 (which is
+ * available on all x86-64 processors). The results are those of the per-pixel functions, except for NaNs, and
+ * rgb709_to_lab computes the cube root with Newton iterations instead of std::pow, which changes L, a and b
+ * by less than 2e-4.
+ */
+void rgb_to_hsv_packed( const float* src, float* dst, int n, int nComponents );
+void rgb_to_hsv_planar( const float* r, const float* g, const float* b, float* h, float* s, float* v, int n );
+void hsv_to_rgb_packed( const float* src, float* dst, int n, int nComponents );
+void hsv_to_rgb_planar( const float* h, const float* s, const float* v, float* r, float* g, float* b, int n );
+
+void rgb_to_hsl_packed( const float* src, float* dst, int n, int nComponents );
+void rgb_to_hsl_planar( const float* r, const float* g, const float* b, float* h, float* s, float* l, int n );
+void hsl_to_rgb_packed( const float* src, float* dst, int n, int nComponents );
+void hsl_to_rgb_planar( const float* h, const float* s, const float* l, float* r, float* g, float* b, int n );
+
+void rgb_to_ycbcr709_packed( const float* src, float* dst, int n, int nComponents );
+void rgb_to_ycbcr709_planar( const float* r, const float* g, const float* b, float* y, float* cb, float* cr, int n );
+void ycbcr_to_rgb709_packed( const float* src, float* dst, int n, int nComponents );
+void ycbcr_to_rgb709_planar( const float* y, const float* cb, const float* cr, float* r, float* g, float* b, int n );
+
+void rgb709_to_lab_packed( const float* src, float* dst, int n, int nComponents );
+void rgb709_to_lab_planar( const float* r, const float* g, const float* b, float* l, float* a, float* b_, int n );
+void lab_to_rgb709_packed( const float* src, float* dst, int n, int nComponents );
+void lab_to_rgb709_planar( const float* l, const float* a, const float* b, float* r, float* g, float* b_, int n );
+
 
 // an object that holds precomputed LUTs for the whole application.
 // The LutManager object should be constructed in the plugin factory's load() function, and destructed in the unload() function
-// Luts are allocated on request, and destructed either on request, or when the LutManager is destroyed
+// Luts are allocated on request, and destructed when the LutManager is destroyed
+// Looking up a Lut which already exists does not lock: the Luts are also stored in an immutable copy of the
+// map (a snapshot), which is replaced under the lock when a Lut is added. The previous snapshots may still be
+// read by other threads, so they are only deleted with the LutManager.
+// Releasing a Lut does not free it: other threads may still be converting with it, so the Lut and its tables
+// stay in the map, and getLut() returns them again. The memory held by the LutManager is thus bounded by
+// the number of distinct Lut names.
 template <class MUTEX>
 class LutManager
 {
@@ -1164,6 +1542,8 @@ public:
     LutManager()
     : _lock()
     , _luts()
+    , _snapshot()
+    , _retiredSnapshots()
     {
     }
 
@@ -1172,6 +1552,10 @@ public:
         for (typename LutsMap::iterator it = _luts.begin(); it != _luts.end(); ++it) {
             delete it->second;
         }
+        delete _snapshot.load();
+        for (typename std::vector<const LutsMap*>::iterator it = _retiredSnapshots.begin(); it != _retiredSnapshots.end(); ++it) {
+            delete *it;
+        }
     }
 
     /**
@@ -1179,12 +1563,22 @@ public:
      * If a lut with the same name didn't already exist, then it will create one.
      * Ownership of the returned pointer remains to the LutManager.
      * You must release the lut when you are done using it.
-     * @WARNING: Not thread-safe. You should call it in the load() action of your plug-in
+     * If the lut was released, the same object is returned.
+     * This is thread-safe, and does not lock if the lut already exists.
      **/
     const Lut* getLut(const std::string & name,
                                  fromColorSpaceFunctionV1 fromFunc,
                                  toColorSpaceFunctionV1 toFunc)
     {
+        const LutsMap* snapshot = _snapshot.load();
+
+        if (snapshot) {
+            typename LutsMap::const_iterator found = snapshot->find(name);
+            if ( found != snapshot->end() ) {
+                return found->second;
+            }
+        }
+
         AutoMutex l(_lock);
         typename LutsMap::iterator found = _luts.find(name);
 
@@ -1195,6 +1589,7 @@ public:
             Lut* lut = new Lut(name, fromFunc, toFunc);;
             //lut->validate();
             _luts[name] = lut;
+            publishSnapshot();
 
             return lut;
         }
@@ -1204,15 +1599,13 @@ public:
 
     /**
      * @brief Release a lut previously retrieved with getLut()
+     * The Lut and its tables are kept until the LutManager is destroyed, because other threads may still be
+     * converting with them (e.g. with tables they read just before the release). A later getLut() with the
+     * same name returns the same Lut.
      **/
     void releaseLut(const std::string& name)
     {
-        AutoMutex l(_lock);
-        typename LutsMap::iterator found = _luts.find(name);
-        if ( found != _luts.end() ) {
-            delete found->second;
-            _luts.erase(found);
-        }
+        unused(name);
     }
 
     ///buit-ins color-spaces
@@ -1290,9 +1683,21 @@ private:
     LutManager &operator= (const LutManager &);
     LutManager(const LutManager &);
 
+    // replaces the snapshot by a copy of _luts. Must be called under _lock.
+    void publishSnapshot()
+    {
+        const LutsMap* previous = _snapshot.load();
+
+        _snapshot.store( new LutsMap(_luts) );
+        if (previous) {
+            _retiredSnapshots.push_back(previous);
+        }
+    }
 
-    mutable MUTEX _lock;                 ///< protects _luts
-    LutsMap _luts;
+    mutable MUTEX _lock;                 ///< protects _luts and _retiredSnapshots, and the writes of _snapshot
+    LutsMap _luts;                       ///< all the Luts, including the released ones
+    LutTablesPtr<LutsMap> _snapshot;     ///< a copy of _luts, which is read without locking
+    std::vector<const LutsMap*> _retiredSnapshots; ///< one per Lut name at most
 };
 
 }         //namespace Color
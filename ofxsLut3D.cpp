@@ -0,0 +1,426 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/NatronGitHub/openfx-supportext>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * OFX 3D look-up tables (color cubes), for gamut and look transforms.
+ */
+
+#include "ofxsLut3D.h"
+
+#include <algorithm>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace OFX {
+namespace Color {
+// The interpolation is written once, for a color type which is either a SIMD vector (SSE2 is available
+// on all x86-64 processors), or three floats.
+namespace {
+#if defined(__SSE2__)
+struct NodeColor
+{
+    __m128 v;
+};
+
+inline NodeColor
+weightedNode(const float* node,
+             float w)
+{
+    NodeColor c = { _mm_mul_ps( _mm_loadu_ps(node), _mm_set1_ps(w) ) };
+
+    return c;
+}
+
+inline void
+addWeightedNode(NodeColor& c,
+                const float* node,
+                float w)
+{
+    c.v = _mm_add_ps( c.v, _mm_mul_ps( _mm_loadu_ps(node), _mm_set1_ps(w) ) );
+}
+
+// stores r, g, b, and the 4th component of the node, which is 0
+inline void
+storeRGB0(const NodeColor& c,
+          float* dst)
+{
+    _mm_storeu_ps(dst, c.v);
+}
+
+inline void
+storeRGB(const NodeColor& c,
+         float* dst)
+{
+    float rgb0[4];
+
+    _mm_storeu_ps(rgb0, c.v);
+    dst[0] = rgb0[0];
+    dst[1] = rgb0[1];
+    dst[2] = rgb0[2];
+}
+
+#else // !defined(__SSE2__)
+struct NodeColor
+{
+    float r, g, b;
+};
+
+inline NodeColor
+weightedNode(const float* node,
+             float w)
+{
+    NodeColor c = { node[0] * w, node[1] * w, node[2] * w };
+
+    return c;
+}
+
+inline void
+addWeightedNode(NodeColor& c,
+                const float* node,
+                float w)
+{
+    c.r += node[0] * w;
+    c.g += node[1] * w;
+    c.b += node[2] * w;
+}
+
+inline void
+storeRGB(const NodeColor& c,
+         float* dst)
+{
+    dst[0] = c.r;
+    dst[1] = c.g;
+    dst[2] = c.b;
+}
+
+inline void
+storeRGB0(const NodeColor& c,
+          float* dst)
+{
+    storeRGB(c, dst);
+    dst[3] = 0.f;
+}
+
+#endif // !defined(__SSE2__)
+
+// the index of the cell which contains v along an axis, and the position of v in that cell.
+// v is clamped to [0, 1], and NaN gives 0.
+inline int
+cellIndex(float v,
+          float scale,
+          int maxIndex,
+          float* frac)
+{
+    const float x = (std::min)( 1.f, (std::max)(0.f, v) ) * scale;
+    const int i = (std::min)( (int)x, maxIndex );
+
+    *frac = x - (float)i;
+
+    return i;
+}
+
+#if defined(__AVX2__)
+// cellIndex() for 8 values
+inline __m256i
+cellIndex8(__m256 v,
+           __m256 scale,
+           __m256i maxIndex,
+           __m256* frac)
+{
+    const __m256 x = _mm256_mul_ps( _mm256_min_ps( _mm256_max_ps( v, _mm256_setzero_ps() ), _mm256_set1_ps(1.f) ), scale );
+    const __m256i i = _mm256_min_epi32( _mm256_cvttps_epi32(x), maxIndex );
+
+    *frac = _mm256_sub_ps( x, _mm256_cvtepi32_ps(i) );
+
+    return i;
+}
+
+// adds the weighted values of 8 nodes to the 3 channels of c
+inline void
+addWeightedNodes8(__m256 c[3],
+                  const float* nodes,
+                  __m256i offsets,
+                  __m256 w)
+{
+    for (int k = 0; k < 3; ++k) {
+        c[k] = _mm256_add_ps( c[k], _mm256_mul_ps( _mm256_i32gather_ps(nodes + k, offsets, 4), w ) );
+    }
+}
+
+#endif
+} // anon namespace
+
+Lut3D::Lut3D(const std::string & name,
+             int size,
+             const float* data,
+             const Lut* shaper)
+    : _name(name)
+    , _size(size)
+    , _shaper(shaper)
+    , _nodes( (size_t)4 * size * size * size, 0.f )
+{
+    assert(kMinSize <= size && size <= kMaxSize);
+    const size_t nNodes = (size_t)size * size * size;
+    for (size_t i = 0; i < nNodes; ++i) {
+        _nodes[i * 4 + 0] = data[i * 3 + 0];
+        _nodes[i * 4 + 1] = data[i * 3 + 1];
+        _nodes[i * 4 + 2] = data[i * 3 + 2];
+    }
+}
+
+Lut3D::Lut3D(const std::string & name,
+             int size,
+             colorTransformFunctionV1 func,
+             const Lut* shaper)
+    : _name(name)
+    , _size(size)
+    , _shaper(shaper)
+    , _nodes( (size_t)4 * size * size * size, 0.f )
+{
+    assert(kMinSize <= size && size <= kMaxSize);
+    // the colors of the nodes along each axis
+    std::vector<float> axis(size);
+    for (int i = 0; i < size; ++i) {
+        axis[i] = i / (float)(size - 1);
+        if (shaper) {
+            axis[i] = shaper->fromColorSpaceFloatToLinearFloat(axis[i]);
+        }
+    }
+    float* node = &_nodes[0];
+    for (int b = 0; b < size; ++b) {
+        for (int g = 0; g < size; ++g) {
+            for (int r = 0; r < size; ++r, node += 4) {
+                func(axis[r], axis[g], axis[b], &node[0], &node[1], &node[2]);
+            }
+        }
+    }
+}
+
+template <int nComponents, Lut3DInterpolationEnum interpolation>
+void
+Lut3D::interpolate(const float* src,
+                   const float* alphaSrc,
+                   float* dst,
+                   int n) const
+{
+    const float* nodes = &_nodes[0];
+    const float scale = (float)(_size - 1);
+    const int maxIndex = _size - 2;
+    // the offsets of the next node along each axis
+    const int dr = 4;
+    const int dg = 4 * _size;
+    const int db = 4 * _size * _size;
+    int i = 0;
+
+#if defined(__AVX2__)
+    // 8 pixels at a time, with one channel per vector, and the nodes read with gathers.
+    // The operations are the same, in the same order, as below, so the results are the same unless the
+    // compiler contracts multiplies and adds into FMAs (e.g. with -mfma), which it may do differently in
+    // both paths: the results may then differ by a few ulps.
+    {
+        const __m256 scale8 = _mm256_set1_ps(scale);
+        const __m256i maxIndex8 = _mm256_set1_epi32(maxIndex);
+        const __m256i srcOffsets = _mm256_mullo_epi32( _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(nComponents) );
+        const __m256i dr8 = _mm256_set1_epi32(dr);
+        const __m256i dg8 = _mm256_set1_epi32(dg);
+        const __m256i db8 = _mm256_set1_epi32(db);
+        const __m256i d111 = _mm256_set1_epi32(dr + dg + db);
+        const __m256 one = _mm256_set1_ps(1.f);
+        for (; i + 8 <= n; i += 8) {
+            const float* pix = src + i * nComponents;
+            __m256 fr, fg, fb;
+            const __m256i ir = cellIndex8(_mm256_i32gather_ps(pix, srcOffsets, 4), scale8, maxIndex8, &fr);
+            const __m256i ig = cellIndex8(_mm256_i32gather_ps(pix + 1, srcOffsets, 4), scale8, maxIndex8, &fg);
+            const __m256i ib = cellIndex8(_mm256_i32gather_ps(pix + 2, srcOffsets, 4), scale8, maxIndex8, &fb);
+            const __m256i c000 = _mm256_add_epi32( _mm256_add_epi32( _mm256_mullo_epi32(ir, dr8), _mm256_mullo_epi32(ig, dg8) ),
+                                                   _mm256_mullo_epi32(ib, db8) );
+            __m256 c[3] = { _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps() };
+
+            if (interpolation == eLut3DInterpolationTetrahedral) {
+                const __m256 f1 = _mm256_max_ps( _mm256_max_ps(fr, fg), fb );
+                const __m256 f2 = _mm256_max_ps( _mm256_min_ps(fr, fg), _mm256_min_ps( _mm256_max_ps(fr, fg), fb ) );
+                const __m256 f3 = _mm256_min_ps( _mm256_min_ps(fr, fg), fb );
+                const __m256i rg = _mm256_castps_si256( _mm256_cmp_ps(fr, fg, _CMP_GE_OQ) );
+                const __m256i rb = _mm256_castps_si256( _mm256_cmp_ps(fr, fb, _CMP_GE_OQ) );
+                const __m256i gb = _mm256_castps_si256( _mm256_cmp_ps(fg, fb, _CMP_GE_OQ) );
+                const __m256i f1IsR = _mm256_and_si256(rg, rb);
+                const __m256i f1IsG = _mm256_andnot_si256(f1IsR, gb);
+                const __m256i f3IsB = _mm256_and_si256(gb, rb);
+                const __m256i f3IsG = _mm256_andnot_si256(f3IsB, rg);
+                const __m256i a = _mm256_or_si256( _mm256_or_si256( _mm256_and_si256(f1IsR, dr8), _mm256_and_si256(f1IsG, dg8) ),
+                                                   _mm256_andnot_si256( _mm256_or_si256(f1IsR, f1IsG), db8 ) );
+                const __m256i f3Axis = _mm256_or_si256( _mm256_or_si256( _mm256_and_si256(f3IsB, db8), _mm256_and_si256(f3IsG, dg8) ),
+                                                        _mm256_andnot_si256( _mm256_or_si256(f3IsB, f3IsG), dr8 ) );
+                for (int k = 0; k < 3; ++k) {
+                    c[k] = _mm256_mul_ps( _mm256_i32gather_ps(nodes + k, c000, 4), _mm256_sub_ps(one, f1) );
+                }
+                addWeightedNodes8( c, nodes, _mm256_add_epi32(c000, a), _mm256_sub_ps(f1, f2) );
+                addWeightedNodes8( c, nodes, _mm256_add_epi32( c000, _mm256_sub_epi32(d111, f3Axis) ), _mm256_sub_ps(f2, f3) );
+                addWeightedNodes8( c, nodes, _mm256_add_epi32(c000, d111), f3 );
+            } else {
+                const __m256 fr0 = _mm256_sub_ps(one, fr);
+                const __m256 gb00 = _mm256_mul_ps( _mm256_sub_ps(one, fg), _mm256_sub_ps(one, fb) );
+                const __m256 gb10 = _mm256_mul_ps( fg, _mm256_sub_ps(one, fb) );
+                const __m256 gb01 = _mm256_mul_ps( _mm256_sub_ps(one, fg), fb );
+                const __m256 gb11 = _mm256_mul_ps(fg, fb);
+                for (int k = 0; k < 3; ++k) {
+                    c[k] = _mm256_mul_ps( _mm256_i32gather_ps(nodes + k, c000, 4), _mm256_mul_ps(fr0, gb00) );
+                }
+                addWeightedNodes8( c, nodes, _mm256_add_epi32(c000, dr8), _mm256_mul_ps(fr, gb00) );
+                addWeightedNodes8( c, nodes, _mm256_add_epi32(c000, dg8), _mm256_mul_ps(fr0, gb10) );
+                addWeightedNodes8( c, nodes, _mm256_add_epi32( c000, _mm256_add_epi32(dr8, dg8) ), _mm256_mul_ps(fr, gb10) );
+                addWeightedNodes8( c, nodes, _mm256_add_epi32(c000, db8), _mm256_mul_ps(fr0, gb01) );
+                addWeightedNodes8( c, nodes, _mm256_add_epi32( c000, _mm256_add_epi32(dr8, db8) ), _mm256_mul_ps(fr, gb01) );
+                addWeightedNodes8( c, nodes, _mm256_add_epi32( c000, _mm256_add_epi32(dg8, db8) ), _mm256_mul_ps(fr0, gb11) );
+                addWeightedNodes8( c, nodes, _mm256_add_epi32(c000, d111), _mm256_mul_ps(fr, gb11) );
+            }
+            float rgb[3][8];
+            for (int k = 0; k < 3; ++k) {
+                _mm256_storeu_ps(rgb[k], c[k]);
+            }
+            float* dstPix = dst + i * nComponents;
+            for (int x = 0; x < 8; ++x, dstPix += nComponents) {
+                dstPix[0] = rgb[0][x];
+                dstPix[1] = rgb[1][x];
+                dstPix[2] = rgb[2][x];
+                if (nComponents == 4) {
+                    dstPix[3] = alphaSrc[(i + x) * 4 + 3];
+                }
+            }
+        }
+    }
+#endif
+
+    for (; i < n; ++i) {
+        const float* pix = src + i * nComponents;
+        float* dstPix = dst + i * nComponents;
+        float fr, fg, fb;
+        const int ir = cellIndex(pix[0], scale, maxIndex, &fr);
+        const int ig = cellIndex(pix[1], scale, maxIndex, &fg);
+        const int ib = cellIndex(pix[2], scale, maxIndex, &fb);
+        // read before dst is written, since src and dst may be the same
+        const float alpha = (nComponents == 4) ? alphaSrc[i * 4 + 3] : 0.f;
+        const float* c000 = nodes + ir * dr + ig * dg + ib * db;
+        NodeColor c;
+
+        if (interpolation == eLut3DInterpolationTetrahedral) {
+            // the cell is split in 6 tetrahedra, which all contain the nodes 000 and 111.
+            // The other two nodes are found by sorting the fractional parts, f1 >= f2 >= f3:
+            // a is along the axis of f1, and b is a + the axis of f2 (i.e. 111 - the axis of f3).
+            // This is written without branches, which would be mispredicted on noisy images.
+            const float f1 = (std::max)( (std::max)(fr, fg), fb );
+            const float f2 = (std::max)( (std::min)(fr, fg), (std::min)( (std::max)(fr, fg), fb ) );
+            const float f3 = (std::min)( (std::min)(fr, fg), fb );
+            // The ties are broken in opposite orders, so that the axes of f1 and f3 are different.
+            const int rg = (fr >= fg);
+            const int rb = (fr >= fb);
+            const int gb = (fg >= fb);
+            const int f1IsR = rg & rb;
+            const int f1IsG = (1 - f1IsR) & gb;
+            const int f3IsB = gb & rb;
+            const int f3IsG = (1 - f3IsB) & rg;
+            const int a = f1IsR * dr + f1IsG * dg + (1 - f1IsR - f1IsG) * db;
+            const int b = dr + dg + db - (f3IsB * db + f3IsG * dg + (1 - f3IsB - f3IsG) * dr);
+            c = weightedNode(c000, 1.f - f1);
+            addWeightedNode(c, c000 + a, f1 - f2);
+            addWeightedNode(c, c000 + b, f2 - f3);
+            addWeightedNode(c, c000 + dr + dg + db, f3);
+        } else {
+            const float gb00 = (1.f - fg) * (1.f - fb);
+            const float gb10 = fg * (1.f - fb);
+            const float gb01 = (1.f - fg) * fb;
+            const float gb11 = fg * fb;
+            c = weightedNode(c000, (1.f - fr) * gb00);
+            addWeightedNode(c, c000 + dr, fr * gb00);
+            addWeightedNode(c, c000 + dg, (1.f - fr) * gb10);
+            addWeightedNode(c, c000 + dr + dg, fr * gb10);
+            addWeightedNode(c, c000 + db, (1.f - fr) * gb01);
+            addWeightedNode(c, c000 + dr + db, fr * gb01);
+            addWeightedNode(c, c000 + dg + db, (1.f - fr) * gb11);
+            addWeightedNode(c, c000 + dr + dg + db, fr * gb11);
+        }
+        if (nComponents == 4) {
+            storeRGB0(c, dstPix);
+            dstPix[3] = alpha;
+        } else {
+            storeRGB(c, dstPix);
+        }
+    }
+} // Lut3D::interpolate
+
+void
+Lut3D::apply(float r,
+             float g,
+             float b,
+             float *rOut,
+             float *gOut,
+             float *bOut,
+             Lut3DInterpolationEnum interpolation) const
+{
+    float rgb[3] = { r, g, b };
+
+    // same as the array version
+    apply(rgb, rgb, 1, 3, interpolation);
+    *rOut = rgb[0];
+    *gOut = rgb[1];
+    *bOut = rgb[2];
+}
+
+void
+Lut3D::apply(const float* src,
+             float* dst,
+             int n,
+             int nComponents,
+             Lut3DInterpolationEnum interpolation) const
+{
+    assert(nComponents == 3 || nComponents == 4);
+    // the pixels are encoded by the shaper by blocks, in a buffer which stays in the L1 cache
+    const int kBlockSize = 256;
+    float shaped[kBlockSize * 4];
+
+    for (int start = 0; start < n; start += kBlockSize) {
+        const int count = (std::min)(kBlockSize, n - start);
+        const float* blockSrc = src + (size_t)start * nComponents;
+        float* blockDst = dst + (size_t)start * nComponents;
+        const float* cubeSrc = blockSrc;
+        if (_shaper) {
+            _shaper->toColorSpaceFloatFromLinearFloatFast(blockSrc, shaped, count * nComponents);
+            cubeSrc = shaped;
+        }
+        if (nComponents == 4) {
+            if (interpolation == eLut3DInterpolationTetrahedral) {
+                interpolate<4, eLut3DInterpolationTetrahedral>(cubeSrc, blockSrc, blockDst, count);
+            } else {
+                interpolate<4, eLut3DInterpolationTrilinear>(cubeSrc, blockSrc, blockDst, count);
+            }
+        } else {
+            if (interpolation == eLut3DInterpolationTetrahedral) {
+                interpolate<3, eLut3DInterpolationTetrahedral>(cubeSrc, blockSrc, blockDst, count);
+            } else {
+                interpolate<3, eLut3DInterpolationTrilinear>(cubeSrc, blockSrc, blockDst, count);
+            }
+        }
+    }
+}
+}         //namespace Color
+}     //namespace OFX
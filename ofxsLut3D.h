@@ -0,0 +1,276 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/NatronGitHub/openfx-supportext>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * OFX 3D look-up tables (color cubes), for gamut and look transforms.
+ */
+
+#ifndef openfx_supportext_ofxsLut3D_h
+#define openfx_supportext_ofxsLut3D_h
+
+#include <string>
+#include <map>
+#include <vector>
+#include <cassert>
+#include <cstring>
+
+#include "ofxsImageEffect.h"
+#include "ofxsMacros.h"
+#include "ofxsPixelProcessor.h"
+#include "ofxsRGBRowTransformProcessor.h"
+#include "ofxsMultiThread.h"
+#include "ofxsLut.h"
+
+namespace OFX {
+namespace Color {
+enum Lut3DInterpolationEnum
+{
+    eLut3DInterpolationTrilinear = 0,   // interpolates between the 8 nodes of the cell
+    eLut3DInterpolationTetrahedral,     // interpolates between 4 nodes of the cell: faster, and preserves the neutral axis
+};
+
+/**
+ * @brief A 3D look-up table: a cube of size^3 RGB values, which samples a color transform on [0, 1]^3.
+ * An optional 1D shaper Lut encodes the input values before they are looked up in the cube, so that
+ * scene-linear values (which are not limited to [0, 1]) can be transformed by a cube defined in a log
+ * color-space. The values outside of the cube are clamped to its faces.
+ * Lut3Ds are immutable, and can be used by several threads at once.
+ **/
+class Lut3D
+{
+    template<class MUTEX>
+    friend class Lut3DManager;
+
+    std::string _name;                 ///< name of the lut
+    int _size;                         ///< number of nodes along each axis
+    const Lut* _shaper;                ///< the shaper, or NULL
+    std::vector<float> _nodes;         ///< 4 floats per node (r, g, b, 0), so that a node can be read as a SIMD vector.
+                                       ///< The red index varies fastest, then green, then blue.
+
+public:
+    enum
+    {
+        kMinSize = 2,
+        kMaxSize = 129
+    };
+
+private:
+    // Lut3Ds should be allocated and destroyed through the Lut3DManager.
+    // data contains size^3 RGB triplets (with red varying fastest, as in .cube files), in the output color-space
+    Lut3D(const std::string & name,
+          int size,
+          const float* data,
+          const Lut* shaper);
+
+    // bakes func: the node at (i, j, k) is func applied to the color (i, j, k) / (size - 1), decoded by the shaper
+    Lut3D(const std::string & name,
+          int size,
+          colorTransformFunctionV1 func,
+          const Lut* shaper);
+
+    virtual ~Lut3D()
+    {
+    }
+
+    Lut3D &operator= (const Lut3D &);
+    Lut3D(const Lut3D &);
+
+public:
+    const std::string& getName() const
+    {
+        return _name;
+    }
+
+    int getSize() const
+    {
+        return _size;
+    }
+
+    /// the shaper Lut, which must outlive this Lut3D. It is owned by a LutManager.
+    const Lut* getShaper() const
+    {
+        return _shaper;
+    }
+
+    /* @brief Transforms a color, which is first encoded by the shaper (if any).
+     * This function is not fast, use the array version for images.
+     */
+    void apply(float r,
+               float g,
+               float b,
+               float *rOut,
+               float *gOut,
+               float *bOut,
+               Lut3DInterpolationEnum interpolation = eLut3DInterpolationTetrahedral) const;
+
+    /* @brief Transforms n packed RGB (nComponents = 3) or RGBA (nComponents = 4) pixels.
+     * The shaper is applied with its fast float conversion, and the alpha channel is copied.
+     * src and dst may be the same buffer.
+     * The cube is interpolated with SIMD instructions if the code is compiled for SSE2 (i.e. on x86-64).
+     */
+    void apply(const float* src,
+               float* dst,
+               int n,
+               int nComponents,
+               Lut3DInterpolationEnum interpolation = eLut3DInterpolationTetrahedral) const;
+
+private:
+    // transforms n pixels, already encoded by the shaper. alphaSrc contains the alpha channel, if nComponents == 4.
+    template <int nComponents, Lut3DInterpolationEnum interpolation>
+    void interpolate(const float* src, const float* alphaSrc, float* dst, int n) const;
+};
+
+template <class MUTEX>
+class Lut3DManager
+{
+    typedef OFX::MultiThread::AutoMutexT<MUTEX> AutoMutex;
+
+    typedef std::map<std::string, const Lut3D* > Lut3DsMap;
+
+public:
+    Lut3DManager()
+    : _lock()
+    , _luts()
+    {
+    }
+
+    ~Lut3DManager()
+    {
+        for (typename Lut3DsMap::iterator it = _luts.begin(); it != _luts.end(); ++it) {
+            delete it->second;
+        }
+    }
+
+    /**
+     * @brief Returns a pointer to a 3D lut with the given name, which is built from the given cube data if it
+     * didn't already exist. data contains size^3 RGB triplets, with the red index varying fastest (as in .cube files).
+     * If shaper is not NULL, the cube is indexed by the input colors encoded with shaper->toColorSpaceFloatFromLinearFloat().
+     * Returns NULL if size is not within [Lut3D::kMinSize, Lut3D::kMaxSize].
+     * Ownership of the returned pointer remains to the Lut3DManager.
+     **/
+    const Lut3D* getLut3D(const std::string & name,
+                          int size,
+                          const float* data,
+                          const Lut* shaper = NULL)
+    {
+        AutoMutex l(_lock);
+        typename Lut3DsMap::iterator found = _luts.find(name);
+
+        if ( found != _luts.end() ) {
+            return found->second;
+        }
+        if ( !data || (size < Lut3D::kMinSize) || (size > Lut3D::kMaxSize) ) {
+            return NULL;
+        }
+        Lut3D* lut = new Lut3D(name, size, data, shaper);
+        _luts[name] = lut;
+
+        return lut;
+    }
+
+    /**
+     * @brief Same as above, but the cube is baked from a color transform.
+     * If shaper is not NULL, the composite "shaper, then cube" is baked: each node is the transform
+     * of the color it represents, decoded by shaper->fromColorSpaceFloatToLinearFloat(), so that
+     * the Lut3D approximates func over the whole range of the shaper.
+     **/
+    const Lut3D* getLut3D(const std::string & name,
+                          int size,
+                          colorTransformFunctionV1 func,
+                          const Lut* shaper = NULL)
+    {
+        AutoMutex l(_lock);
+        typename Lut3DsMap::iterator found = _luts.find(name);
+
+        if ( found != _luts.end() ) {
+            return found->second;
+        }
+        if ( !func || (size < Lut3D::kMinSize) || (size > Lut3D::kMaxSize) ) {
+            return NULL;
+        }
+        Lut3D* lut = new Lut3D(name, size, func, shaper);
+        _luts[name] = lut;
+
+        return lut;
+    }
+
+    /**
+     * @brief Release a 3D lut previously retrieved with getLut3D()
+     **/
+    void releaseLut3D(const std::string& name)
+    {
+        AutoMutex l(_lock);
+        typename Lut3DsMap::iterator found = _luts.find(name);
+        if ( found != _luts.end() ) {
+            delete found->second;
+            _luts.erase(found);
+        }
+    }
+
+private:
+    Lut3DManager &operator= (const Lut3DManager &);
+    Lut3DManager(const Lut3DManager &);
+
+    MUTEX _lock;
+    Lut3DsMap _luts;
+};
+
+/**
+ * @brief Applies a Lut3D to an RGB or RGBA image. The alpha channel is copied.
+ * Integer images are converted to floats in [0, 1] before the transform, and the result is clamped.
+ **/
+template <class PIX, int nComponents, int maxValue>
+class Lut3DProcessor
+    : public OFX::RGBRowTransformProcessor<PIX, nComponents, maxValue, Lut3DProcessor<PIX, nComponents, maxValue> >
+{
+    friend class OFX::RGBRowTransformProcessor<PIX, nComponents, maxValue, Lut3DProcessor>;
+
+    const Lut3D* _lut3D;
+    Lut3DInterpolationEnum _interpolation;
+
+public:
+    Lut3DProcessor(OFX::ImageEffect &instance)
+        : OFX::RGBRowTransformProcessor<PIX, nComponents, maxValue, Lut3DProcessor>(instance)
+        , _lut3D(NULL)
+        , _interpolation(eLut3DInterpolationTetrahedral)
+    {
+    }
+
+    void setValues(const Lut3D* lut3D,
+                   Lut3DInterpolationEnum interpolation)
+    {
+        _lut3D = lut3D;
+        _interpolation = interpolation;
+    }
+
+private:
+    void apply(const float* src,
+               float* dst,
+               int n,
+               int nComps) const
+    {
+        assert(_lut3D);
+        _lut3D->apply(src, dst, n, nComps, _interpolation);
+    }
+};
+}         //namespace Color
+}     //namespace OFX
+
+#endif // ifndef openfx_supportext_ofxsLut3D_h
@@ -0,0 +1,154 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/NatronGitHub/openfx-supportext>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Generates the look-up tables of the built-in Luts of ofxsLut.h as static read-only data.
+ *
+ * The output is meant to be saved as ofxsLutTables.inc, and ofxsLut.cpp must then be compiled with
+ * -DOFXS_LUT_STATIC_TABLES, so that the Luts of the LutManager built-in accessors use these tables
+ * instead of computing them at runtime. Since they are in the read-only data of the plug-in binary,
+ * they are shared by all the processes that load it.
+ *
+ * Each table takes about 129kB, so only the Luts given on the command line are generated
+ * (all of them if none is given), e.g.:
+ *
+ *   c++ -O2 -I../openfx/include -I../openfx/Support/include -I. \
+ *       ofxsLutTablesGenerator.cpp ofxsLut.cpp tinythread.cpp -o ofxsLutTablesGenerator -lpthread
+ *   ./ofxsLutTablesGenerator sRGB Rec709 > ofxsLutTables.inc
+ *
+ * The tables are computed with the transfer functions of the machine that runs the generator,
+ * so the same generator should be used for all the platforms if bit-identical results are needed.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "ofxsLut.h"
+
+using namespace OFX::Color;
+
+namespace {
+struct LutBuiltin
+{
+    const char* name;     // the name used by the LutManager accessor
+    const char* ident;    // the name of the generated variable
+    const char* fromFunc; // the names of the transfer functions
+    const char* toFunc;
+    fromColorSpaceFunctionV1 from;
+    toColorSpaceFunctionV1 to;
+};
+
+#define LUT_BUILTIN(name, ident, func) { name, #ident, "from_func_" #func, "to_func_" #func, from_func_ ## func, to_func_ ## func }
+
+// the Luts of the LutManager built-in accessors
+const LutBuiltin builtins[] = {
+    LUT_BUILTIN("Linear", Linear, linear),
+    LUT_BUILTIN("sRGB", sRGB, srgb),
+    LUT_BUILTIN("Rec709", Rec709, Rec709),
+    LUT_BUILTIN("Cineon", Cineon, Cineon),
+    LUT_BUILTIN("Gamma1_8", Gamma1_8, Gamma1_8),
+    LUT_BUILTIN("Gamma2_2", Gamma2_2, Gamma2_2),
+    LUT_BUILTIN("Panalog", Panalog, Panalog),
+    LUT_BUILTIN("ViperLog", ViperLog, ViperLog),
+    LUT_BUILTIN("REDLog", REDLog, REDLog),
+    LUT_BUILTIN("AlexaV3LogC", AlexaV3LogC, AlexaV3LogC),
+    LUT_BUILTIN("SLog1", SLog1, SLog1),
+    LUT_BUILTIN("SLog2", SLog2, SLog2),
+    LUT_BUILTIN("SLog3", SLog3, SLog3),
+    LUT_BUILTIN("V-Log", VLog, VLog),
+};
+const int nBuiltins = (int)( sizeof(builtins) / sizeof(builtins[0]) );
+
+bool
+writeTables(const LutBuiltin& lut)
+{
+    static LutTables tables;
+
+    Lut::fillTables(lut.from, lut.to, &tables);
+    std::printf("// %s\n", lut.name);
+    std::printf("const LutTables ofxsLutTables_%s = {\n    {", lut.ident);
+    for (int i = 0; i < 0x10001; ++i) {
+        std::printf( "%s%u,", (i % 16) ? " " : "\n        ", (unsigned)tables.toFunc_hipart_to_uint8xx[i] );
+    }
+    std::printf("\n    },\n    {");
+    for (int i = 0; i < 256; ++i) {
+        const float f = tables.fromFunc_uint8_to_float[i];
+#if __cplusplus > 199711L
+        if ( !std::isfinite(f) ) {
+#else
+        if ( (f != f) || (f - f != 0.f) ) {
+#endif
+            std::fprintf(stderr, "%s: from_func(%d/255) is not finite\n", lut.name, i);
+
+            return false;
+        }
+        // 9 significant digits are enough to get the same float back
+        std::printf( "%s%.9ef,", (i % 4) ? " " : "\n        ", (double)f );
+    }
+    std::printf("\n    }\n};\n\n");
+
+    return true;
+}
+} // anon namespace
+
+int
+main(int argc,
+     char **argv)
+{
+    bool selected[nBuiltins];
+
+    for (int j = 0; j < nBuiltins; ++j) {
+        selected[j] = (argc <= 1);
+    }
+    for (int i = 1; i < argc; ++i) {
+        int j = 0;
+        while ( (j < nBuiltins) && (std::strcmp(argv[i], builtins[j].name) != 0) ) {
+            ++j;
+        }
+        if (j == nBuiltins) {
+            std::fprintf(stderr, "usage: %s [lut...]\nunknown lut: %s\nthe luts are:", argv[0], argv[i]);
+            for (j = 0; j < nBuiltins; ++j) {
+                std::fprintf(stderr, " %s", builtins[j].name);
+            }
+            std::fprintf(stderr, "\n");
+
+            return 1;
+        }
+        selected[j] = true;
+    }
+
+    std::printf("// Generated by ofxsLutTablesGenerator, do not edit.\n");
+    std::printf("// This file is included by ofxsLut.cpp when OFXS_LUT_STATIC_TABLES is defined.\n\n");
+    for (int j = 0; j < nBuiltins; ++j) {
+        if ( selected[j] && !writeTables(builtins[j]) ) {
+            return 1;
+        }
+    }
+    std::printf("const LutStaticTables ofxsLutStaticTables[] = {\n");
+    for (int j = 0; j < nBuiltins; ++j) {
+        if (selected[j]) {
+            std::printf("    { \"%s\", %s, %s, &ofxsLutTables_%s },\n", builtins[j].name, builtins[j].fromFunc, builtins[j].toFunc, builtins[j].ident);
+        }
+    }
+    std::printf("    { NULL, NULL, NULL, NULL }\n};\n");
+
+    return 0;
+}
@@ -407,21 +407,18 @@ ofxsMixPix(const float *tmpPix, //!< interpolated pixel
 } // ofxsMixPix
 
 // tmpPix is not normalized, it is within [0,maxValue] (but is allowed to be outside of this range)
+// Same as ofxsMaskMixPix, but the mask pixel is given (e.g. by a PixelRowSpan over the mask image),
+// and is NULL outside of the mask image.
 template <class PIX, int nComponents, int maxValue, bool masked>
 void
-ofxsMaskMixPix(const float *tmpPix, //!< interpolated pixel
-               int x, //!< coordinates for the pixel to be computed (PIXEL coordinates)
-               int y,
-               const PIX *srcPix, //!< the background image (the output is srcImg where maskImg=0, else it is tmpPix)
-               bool domask, //!< apply the mask?
-               const OFX::Image *maskImg, //!< the mask image (ignored if masked=false or domask=false), which must be Alpha
-               float mix, //!< mix factor between the output and bkImg
-               bool maskInvert, //<! invert mask behavior
-               PIX *dstPix) //!< destination pixel
+ofxsMaskMixPixWithMask(const float *tmpPix, //!< interpolated pixel
+                       const PIX *maskPix, //!< the mask pixel (ignored if masked=false or domask=false)
+                       const PIX *srcPix, //!< the background image (the output is srcImg where maskImg=0, else it is tmpPix)
+                       bool domask, //!< apply the mask?
+                       float mix, //!< mix factor between the output and bkImg
+                       bool maskInvert, //<! invert mask behavior
+                       PIX *dstPix) //!< destination pixel
 {
-    // For a multi-planar effect, the mask image may have any components
-    assert(!domask || !maskImg || maskImg->getPixelComponentCount() > 0);
-    const PIX *maskPix = NULL;
     float maskScale = 1.f;
 
     // are we doing masking
@@ -429,9 +426,7 @@ ofxsMaskMixPix(const float *tmpPix, //!< interpolated pixel
         ofxsMixPix<PIX, nComponents, maxValue>(tmpPix, srcPix, mix, dstPix);
     } else {
         if (domask) {
-            // we do, get the pixel from the mask
-            maskPix = maskImg ? (const PIX *)maskImg->getPixelAddress(x, y) : 0;
-            // figure the scale factor from that pixel
+            // figure the scale factor from the mask pixel
             if (maskPix == 0) {
                 maskScale = maskInvert ? 1.f : 0.f;
             } else {
@@ -470,6 +465,30 @@ ofxsMaskMixPix(const float *tmpPix, //!< interpolated pixel
             }
         }
     }
+} // ofxsMaskMixPixWithMask
+
+// tmpPix is not normalized, it is within [0,maxValue] (but is allowed to be outside of this range)
+template <class PIX, int nComponents, int maxValue, bool masked>
+void
+ofxsMaskMixPix(const float *tmpPix, //!< interpolated pixel
+               int x, //!< coordinates for the pixel to be computed (PIXEL coordinates)
+               int y,
+               const PIX *srcPix, //!< the background image (the output is srcImg where maskImg=0, else it is tmpPix)
+               bool domask, //!< apply the mask?
+               const OFX::Image *maskImg, //!< the mask image (ignored if masked=false or domask=false), which must be Alpha
+               float mix, //!< mix factor between the output and bkImg
+               bool maskInvert, //<! invert mask behavior
+               PIX *dstPix) //!< destination pixel
+{
+    // For a multi-planar effect, the mask image may have any components
+    assert(!domask || !maskImg || maskImg->getPixelComponentCount() > 0);
+    const PIX *maskPix = NULL;
+
+    if (masked && domask && maskImg) {
+        // we do, get the pixel from the mask
+        maskPix = (const PIX *)maskImg->getPixelAddress(x, y);
+    }
+    ofxsMaskMixPixWithMask<PIX, nComponents, maxValue, masked>(tmpPix, maskPix, srcPix, domask, mix, maskInvert, dstPix);
 } // ofxsMaskMixPix
 
 // unpPix is normalized between [0,1]
@@ -496,6 +515,28 @@ ofxsPremultMaskMixPix(const float unpPix[4], //!< interpolated unpremultiplied p
     ofxsMaskMixPix<PIX, nComponents, maxValue, masked>(tmpPix, x, y, srcPix, domask, maskImg, mix, maskInvert, dstPix);
 }
 
+// unpPix is normalized between [0,1]
+// Same as ofxsPremultMaskMixPix, but the mask pixel is given, and is NULL outside of the mask image.
+template <class PIX, int nComponents, int maxValue, bool masked>
+void
+ofxsPremultMaskMixPixWithMask(const float unpPix[4], //!< interpolated unpremultiplied pixel
+                              bool premult,
+                              int premultChannel,
+                              const PIX *maskPix, //!< the mask pixel (ignored if masked=false or domask=false)
+                              const PIX *srcPix, //!< the background image (the output is srcImg where maskImg=0, else it is tmpPix)
+                              bool domask, //!< apply the mask?
+                              float mix, //!< mix factor between the output and bkImg
+                              bool maskInvert, //<! invert mask behavior
+                              PIX *dstPix) //!< destination pixel
+{
+    float tmpPix[nComponents];
+
+    // unpPix is in [0..1]
+    ofxsPremult<PIX, nComponents, maxValue>(unpPix, tmpPix, premult, premultChannel);
+    // tmpPix is in [0..maxValue]
+    ofxsMaskMixPixWithMask<PIX, nComponents, maxValue, masked>(tmpPix, maskPix, srcPix, domask, mix, maskInvert, dstPix);
+}
+
 // unpPix is normalized between [0,1]
 template <class PIX, int nComponents, int maxValue>
 void
@@ -22,9 +22,581 @@
  * OFX mipmapping help functions
  */
 
-#include "ofxsMipMap.h"
+#include "ofxsMipmap.h"
+
+#include <algorithm>
+#include <cstring>
+#include <list>
+#include <map>
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#include "ofxsCoords.h"
 
 namespace OFX {
+// a half-float component, stored as its IEEE 754 binary16 bits
+struct MipMapHalf
+{
+    unsigned short bits;
+};
+
+// conversion from half to float. Denormals, infinities and NaNs are preserved.
+static inline float
+halfToFloat(unsigned short h)
+{
+#ifdef __F16C__
+    return _cvtsh_ss(h);
+#else
+    const unsigned int shiftedExp = 0x7c00 << 13; // the exponent mask, after the shift
+    unsigned int u = (h & 0x7fff) << 13; // exponent and mantissa
+    const unsigned int exp = shiftedExp & u;
+    float f;
+
+    u += (127 - 15) << 23; // adjust the exponent
+    if (exp == shiftedExp) {
+        // infinity or NaN
+        u += (128 - 16) << 23;
+        std::memcpy( &f, &u, sizeof(f) );
+    } else if (exp == 0) {
+        // zero or denormal: renormalize
+        u += 1 << 23;
+        std::memcpy( &f, &u, sizeof(f) );
+        f -= 6.103515625e-05f; // 2^-14
+    } else {
+        std::memcpy( &f, &u, sizeof(f) );
+    }
+
+    return (h & 0x8000) ? -f : f;
+#endif
+}
+
+// conversion from float to half, rounding to nearest even.
+// Values that are too large become infinities, and NaNs stay NaNs.
+static inline unsigned short
+floatToHalf(float f)
+{
+#ifdef __F16C__
+    return _cvtss_sh(f, 0);
+#else
+    unsigned int u;
+    std::memcpy( &u, &f, sizeof(u) );
+    const unsigned int sign = (u >> 16) & 0x8000;
+    unsigned short h;
+
+    u &= 0x7fffffff;
+    if (u >= 0x47800000) {
+        // infinity, NaN, or too large
+        h = (u > 0x7f800000) ? 0x7e00 : 0x7c00;
+    } else if (u < 0x38800000) {
+        // the result is a denormal or zero: let the float addition do the rounding
+        float a;
+        std::memcpy( &a, &u, sizeof(a) );
+        a += 0.5f;
+        std::memcpy( &u, &a, sizeof(u) );
+        h = (unsigned short)(u - 0x3f000000);
+    } else {
+        const unsigned int mantissaOdd = (u >> 13) & 1;
+        u += ( (unsigned int)(15 - 127) << 23 ) + 0xfff + mantissaOdd; // adjust the exponent and round
+        h = (unsigned short)(u >> 13);
+    }
+
+    return (unsigned short)(h | sign);
+#endif
+}
+
+// how the pixel components of each bit depth are summed and averaged:
+// integer components are summed as int and rounded to the nearest value,
+// half components are averaged as float.
+template <typename PIX>
+struct MipMapPixelTraits;
+
+template <>
+struct MipMapPixelTraits<float>
+{
+    typedef float Sum;
+    static Sum toSum(float v) { return v; }
+    static float average(Sum sum, int count) { return sum / count; }
+    static float toFloat(float v) { return v; }
+    static float fromFloat(float v) { return v; }
+};
+
+template <>
+struct MipMapPixelTraits<unsigned char>
+{
+    typedef int Sum;
+    static Sum toSum(unsigned char v) { return v; }
+    static unsigned char average(Sum sum, int count) { return (unsigned char)( (sum + count / 2) / count ); }
+    static float toFloat(unsigned char v) { return v; }
+    static unsigned char fromFloat(float v) { return (v <= 0.f) ? 0 : (v >= 255.f) ? 255 : (unsigned char)(v + 0.5f); }
+};
+
+template <>
+struct MipMapPixelTraits<unsigned short>
+{
+    typedef int Sum;
+    static Sum toSum(unsigned short v) { return v; }
+    static unsigned short average(Sum sum, int count) { return (unsigned short)( (sum + count / 2) / count ); }
+    static float toFloat(unsigned short v) { return v; }
+    static unsigned short fromFloat(float v) { return (v <= 0.f) ? 0 : (v >= 65535.f) ? 65535 : (unsigned short)(v + 0.5f); }
+};
+
+template <>
+struct MipMapPixelTraits<MipMapHalf>
+{
+    typedef float Sum;
+    static Sum toSum(MipMapHalf v) { return halfToFloat(v.bits); }
+    static MipMapHalf average(Sum sum, int count) { return fromFloat(sum / count); }
+    static float toFloat(MipMapHalf v) { return halfToFloat(v.bits); }
+    static MipMapHalf fromFloat(float v) { MipMapHalf h; h.bits = floatToHalf(v); return h; }
+};
+
+// halve the first pixels of an interior row using SIMD instructions, and return the number of pixels done.
+// By default, nothing is done and the scalar code in halveInteriorRow is used.
+template <typename PIX, int nComponents>
+static inline int
+halveInteriorRowSimd(const PIX* /*thisRow*/,
+                     const PIX* /*nextRow*/,
+                     PIX* /*dst*/,
+                     int /*n*/)
+{
+    return 0;
+}
+
+#if defined(__SSE2__)
+// pack two vectors of 32-bit values in [0,65535] to unsigned short
+static inline __m128i
+packUShort(__m128i a,
+           __m128i b)
+{
+#if defined(__SSE4_1__)
+    return _mm_packus_epi32(a, b);
+#else
+    // SSE2 only has a signed pack: shift the values to the signed range and back
+    const __m128i bias32 = _mm_set1_epi32(32768);
+    const __m128i bias16 = _mm_set1_epi16(-32768);
+
+    return _mm_add_epi16( _mm_packs_epi32( _mm_sub_epi32(a, bias32), _mm_sub_epi32(b, bias32) ), bias16 );
+#endif
+}
+
+template <>
+inline int
+halveInteriorRowSimd<unsigned char, 1>(const unsigned char* thisRow,
+                                       const unsigned char* nextRow,
+                                       unsigned char* dst,
+                                       int n)
+{
+    const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+    const __m128i two = _mm_set1_epi16(2);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        const __m128i t = _mm_loadu_si128( (const __m128i*)(thisRow + i * 2) );
+        const __m128i b = _mm_loadu_si128( (const __m128i*)(nextRow + i * 2) );
+        // sum the even and odd columns, as 16-bit
+        const __m128i s = _mm_add_epi16( _mm_add_epi16( _mm_and_si128(t, lowBytes), _mm_srli_epi16(t, 8) ),
+                                         _mm_add_epi16( _mm_and_si128(b, lowBytes), _mm_srli_epi16(b, 8) ) );
+        const __m128i avg = _mm_srli_epi16(_mm_add_epi16(s, two), 2);
+        _mm_storel_epi64( (__m128i*)(dst + i), _mm_packus_epi16(avg, avg) );
+    }
+
+    return i;
+}
+
+template <>
+inline int
+halveInteriorRowSimd<unsigned char, 4>(const unsigned char* thisRow,
+                                       const unsigned char* nextRow,
+                                       unsigned char* dst,
+                                       int n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    int i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        const __m128i t = _mm_loadu_si128( (const __m128i*)(thisRow + i * 8) );
+        const __m128i b = _mm_loadu_si128( (const __m128i*)(nextRow + i * 8) );
+        // sum the rows, as 16-bit: source pixels 0,1 are in lo, 2,3 in hi
+        const __m128i lo = _mm_add_epi16( _mm_unpacklo_epi8(t, zero), _mm_unpacklo_epi8(b, zero) );
+        const __m128i hi = _mm_add_epi16( _mm_unpackhi_epi8(t, zero), _mm_unpackhi_epi8(b, zero) );
+        // sum the columns: 0+1, 2+3
+        const __m128i s = _mm_add_epi16( _mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi) );
+        const __m128i avg = _mm_srli_epi16(_mm_add_epi16(s, two), 2);
+        _mm_storel_epi64( (__m128i*)(dst + i * 4), _mm_packus_epi16(avg, avg) );
+    }
+
+    return i;
+}
+
+template <>
+inline int
+halveInteriorRowSimd<unsigned short, 1>(const unsigned short* thisRow,
+                                        const unsigned short* nextRow,
+                                        unsigned short* dst,
+                                        int n)
+{
+    const __m128i lowShorts = _mm_set1_epi32(0xffff);
+    const __m128i two = _mm_set1_epi32(2);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i avg[2];
+        for (int j = 0; j < 2; ++j) {
+            const __m128i t = _mm_loadu_si128( (const __m128i*)(thisRow + i * 2 + j * 8) );
+            const __m128i b = _mm_loadu_si128( (const __m128i*)(nextRow + i * 2 + j * 8) );
+            // sum the even and odd columns, as 32-bit
+            const __m128i s = _mm_add_epi32( _mm_add_epi32( _mm_and_si128(t, lowShorts), _mm_srli_epi32(t, 16) ),
+                                             _mm_add_epi32( _mm_and_si128(b, lowShorts), _mm_srli_epi32(b, 16) ) );
+            avg[j] = _mm_srli_epi32(_mm_add_epi32(s, two), 2);
+        }
+        _mm_storeu_si128( (__m128i*)(dst + i), packUShort(avg[0], avg[1]) );
+    }
+
+    return i;
+}
+
+template <>
+inline int
+halveInteriorRowSimd<unsigned short, 4>(const unsigned short* thisRow,
+                                        const unsigned short* nextRow,
+                                        unsigned short* dst,
+                                        int n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi32(2);
+    int i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        __m128i avg[2];
+        for (int j = 0; j < 2; ++j) {
+            const __m128i t = _mm_loadu_si128( (const __m128i*)(thisRow + i * 8 + j * 8) );
+            const __m128i b = _mm_loadu_si128( (const __m128i*)(nextRow + i * 8 + j * 8) );
+            // sum the two source pixels of both rows, as 32-bit
+            const __m128i s = _mm_add_epi32( _mm_add_epi32( _mm_unpacklo_epi16(t, zero), _mm_unpackhi_epi16(t, zero) ),
+                                             _mm_add_epi32( _mm_unpacklo_epi16(b, zero), _mm_unpackhi_epi16(b, zero) ) );
+            avg[j] = _mm_srli_epi32(_mm_add_epi32(s, two), 2);
+        }
+        _mm_storeu_si128( (__m128i*)(dst + i * 4), packUShort(avg[0], avg[1]) );
+    }
+
+    return i;
+}
+
+#if defined(__SSE4_1__)
+// 3-component pixels need byte shuffles (SSSE3) to separate the even and odd source pixels
+template <>
+inline int
+halveInteriorRowSimd<unsigned char, 3>(const unsigned char* thisRow,
+                                       const unsigned char* nextRow,
+                                       unsigned char* dst,
+                                       int n)
+{
+    // bytes 0..15 hold destination pixels 0,1 and bytes 8..23 hold pixels 2,3,
+    // these masks extract the even and odd source pixels as 16-bit
+    const __m128i even01 = _mm_setr_epi8(0, -1, 1, -1, 2, -1, 6, -1, 7, -1, 8, -1, -1, -1, -1, -1);
+    const __m128i odd01 = _mm_setr_epi8(3, -1, 4, -1, 5, -1, 9, -1, 10, -1, 11, -1, -1, -1, -1, -1);
+    const __m128i even23 = _mm_setr_epi8(4, -1, 5, -1, 6, -1, 10, -1, 11, -1, 12, -1, -1, -1, -1, -1);
+    const __m128i odd23 = _mm_setr_epi8(7, -1, 8, -1, 9, -1, 13, -1, 14, -1, 15, -1, -1, -1, -1, -1);
+    const __m128i compact = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 8, 9, 10, 11, 12, 13, -1, -1, -1, -1);
+    const __m128i two = _mm_set1_epi16(2);
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        const __m128i t01 = _mm_loadu_si128( (const __m128i*)(thisRow + i * 6) );
+        const __m128i t23 = _mm_loadu_si128( (const __m128i*)(thisRow + i * 6 + 8) );
+        const __m128i b01 = _mm_loadu_si128( (const __m128i*)(nextRow + i * 6) );
+        const __m128i b23 = _mm_loadu_si128( (const __m128i*)(nextRow + i * 6 + 8) );
+        const __m128i s01 = _mm_add_epi16( _mm_add_epi16( _mm_shuffle_epi8(t01, even01), _mm_shuffle_epi8(t01, odd01) ),
+                                           _mm_add_epi16( _mm_shuffle_epi8(b01, even01), _mm_shuffle_epi8(b01, odd01) ) );
+        const __m128i s23 = _mm_add_epi16( _mm_add_epi16( _mm_shuffle_epi8(t23, even23), _mm_shuffle_epi8(t23, odd23) ),
+                                           _mm_add_epi16( _mm_shuffle_epi8(b23, even23), _mm_shuffle_epi8(b23, odd23) ) );
+        const __m128i avg = _mm_shuffle_epi8( _mm_packus_epi16( _mm_srli_epi16(_mm_add_epi16(s01, two), 2),
+                                                                _mm_srli_epi16(_mm_add_epi16(s23, two), 2) ), compact );
+        // store the 12 bytes
+        _mm_storel_epi64( (__m128i*)(dst + i * 3), avg );
+        const int last = _mm_cvtsi128_si32( _mm_srli_si128(avg, 8) );
+        std::memcpy( dst + i * 3 + 8, &last, sizeof(last) );
+    }
+
+    return i;
+}
+
+template <>
+inline int
+halveInteriorRowSimd<unsigned short, 3>(const unsigned short* thisRow,
+                                        const unsigned short* nextRow,
+                                        unsigned short* dst,
+                                        int n)
+{
+    // components 0..7 hold destination pixel 0 and components 4..11 hold pixel 1,
+    // these masks extract the even and odd source pixels as 32-bit
+    const __m128i even0 = _mm_setr_epi8(0, 1, -1, -1, 2, 3, -1, -1, 4, 5, -1, -1, -1, -1, -1, -1);
+    const __m128i odd0 = _mm_setr_epi8(6, 7, -1, -1, 8, 9, -1, -1, 10, 11, -1, -1, -1, -1, -1, -1);
+    const __m128i even1 = _mm_setr_epi8(4, 5, -1, -1, 6, 7, -1, -1, 8, 9, -1, -1, -1, -1, -1, -1);
+    const __m128i odd1 = _mm_setr_epi8(10, 11, -1, -1, 12, 13, -1, -1, 14, 15, -1, -1, -1, -1, -1, -1);
+    const __m128i compact = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 8, 9, 10, 11, 12, 13, -1, -1, -1, -1);
+    const __m128i two = _mm_set1_epi32(2);
+    int i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        const __m128i t0 = _mm_loadu_si128( (const __m128i*)(thisRow + i * 6) );
+        const __m128i t1 = _mm_loadu_si128( (const __m128i*)(thisRow + i * 6 + 4) );
+        const __m128i b0 = _mm_loadu_si128( (const __m128i*)(nextRow + i * 6) );
+        const __m128i b1 = _mm_loadu_si128( (const __m128i*)(nextRow + i * 6 + 4) );
+        const __m128i s0 = _mm_add_epi32( _mm_add_epi32( _mm_shuffle_epi8(t0, even0), _mm_shuffle_epi8(t0, odd0) ),
+                                          _mm_add_epi32( _mm_shuffle_epi8(b0, even0), _mm_shuffle_epi8(b0, odd0) ) );
+        const __m128i s1 = _mm_add_epi32( _mm_add_epi32( _mm_shuffle_epi8(t1, even1), _mm_shuffle_epi8(t1, odd1) ),
+                                          _mm_add_epi32( _mm_shuffle_epi8(b1, even1), _mm_shuffle_epi8(b1, odd1) ) );
+        const __m128i avg = _mm_shuffle_epi8( packUShort( _mm_srli_epi32(_mm_add_epi32(s0, two), 2),
+                                                          _mm_srli_epi32(_mm_add_epi32(s1, two), 2) ), compact );
+        // store the 6 components
+        _mm_storel_epi64( (__m128i*)(dst + i * 3), avg );
+        const int last = _mm_cvtsi128_si32( _mm_srli_si128(avg, 8) );
+        std::memcpy( dst + i * 3 + 4, &last, sizeof(last) );
+    }
+
+    return i;
+}
+#endif // defined(__SSE4_1__)
+
+// float and half interiors are averaged as 4 floats, and the sums are done in the same order
+// as in the scalar code, so that the results are identical.
+static inline __m128
+loadFloats(const float* p)
+{
+    return _mm_loadu_ps(p);
+}
+
+static inline void
+storeFloats(float* p,
+            __m128 v)
+{
+    _mm_storeu_ps(p, v);
+}
+
+#ifdef __F16C__
+static inline __m128
+loadFloats(const MipMapHalf* p)
+{
+    return _mm_cvtph_ps( _mm_loadl_epi64( (const __m128i*)p ) );
+}
+
+static inline void
+storeFloats(MipMapHalf* p,
+            __m128 v)
+{
+    _mm_storel_epi64( (__m128i*)p, _mm_cvtps_ph(v, 0) );
+}
+#endif
+
+template <typename PIX>
+static inline int
+halveInteriorRowFloats1(const PIX* thisRow,
+                        const PIX* nextRow,
+                        PIX* dst,
+                        int n)
+{
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        const __m128 t0 = loadFloats(thisRow + i * 2);
+        const __m128 t1 = loadFloats(thisRow + i * 2 + 4);
+        const __m128 b0 = loadFloats(nextRow + i * 2);
+        const __m128 b1 = loadFloats(nextRow + i * 2 + 4);
+        // separate the even and odd columns
+        const __m128 a = _mm_shuffle_ps( t0, t1, _MM_SHUFFLE(2, 0, 2, 0) );
+        const __m128 b = _mm_shuffle_ps( t0, t1, _MM_SHUFFLE(3, 1, 3, 1) );
+        const __m128 c = _mm_shuffle_ps( b0, b1, _MM_SHUFFLE(2, 0, 2, 0) );
+        const __m128 d = _mm_shuffle_ps( b0, b1, _MM_SHUFFLE(3, 1, 3, 1) );
+        storeFloats( dst + i, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(a, b), c), d), quarter) );
+    }
+
+    return i;
+}
+
+template <typename PIX>
+static inline int
+halveInteriorRowFloats3(const PIX* thisRow,
+                        const PIX* nextRow,
+                        PIX* dst,
+                        int n)
+{
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    int i = 0;
+
+    // each pixel is loaded and stored with the first component of the next one, which must exist:
+    // the last pixel is done by the scalar code, and overwrites what was stored there
+    for (; i + 1 < n; ++i) {
+        const __m128 a = loadFloats(thisRow + i * 6);
+        const __m128 b = loadFloats(thisRow + i * 6 + 3);
+        const __m128 c = loadFloats(nextRow + i * 6);
+        const __m128 d = loadFloats(nextRow + i * 6 + 3);
+        storeFloats( dst + i * 3, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(a, b), c), d), quarter) );
+    }
+
+    return i;
+}
+
+template <typename PIX>
+static inline int
+halveInteriorRowFloats4(const PIX* thisRow,
+                        const PIX* nextRow,
+                        PIX* dst,
+                        int n)
+{
+    const __m128 quarter = _mm_set1_ps(0.25f);
+
+    for (int i = 0; i < n; ++i) {
+        const __m128 a = loadFloats(thisRow + i * 8);
+        const __m128 b = loadFloats(thisRow + i * 8 + 4);
+        const __m128 c = loadFloats(nextRow + i * 8);
+        const __m128 d = loadFloats(nextRow + i * 8 + 4);
+        storeFloats( dst + i * 4, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(a, b), c), d), quarter) );
+    }
+
+    return n;
+}
+
+template <>
+inline int
+halveInteriorRowSimd<float, 1>(const float* thisRow,
+                               const float* nextRow,
+                               float* dst,
+                               int n)
+{
+    return halveInteriorRowFloats1(thisRow, nextRow, dst, n);
+}
+
+template <>
+inline int
+halveInteriorRowSimd<float, 3>(const float* thisRow,
+                               const float* nextRow,
+                               float* dst,
+                               int n)
+{
+    return halveInteriorRowFloats3(thisRow, nextRow, dst, n);
+}
+
+template <>
+inline int
+halveInteriorRowSimd<float, 4>(const float* thisRow,
+                               const float* nextRow,
+                               float* dst,
+                               int n)
+{
+    return halveInteriorRowFloats4(thisRow, nextRow, dst, n);
+}
+
+#ifdef __F16C__
+template <>
+inline int
+halveInteriorRowSimd<MipMapHalf, 1>(const MipMapHalf* thisRow,
+                                    const MipMapHalf* nextRow,
+                                    MipMapHalf* dst,
+                                    int n)
+{
+    return halveInteriorRowFloats1(thisRow, nextRow, dst, n);
+}
+
+template <>
+inline int
+halveInteriorRowSimd<MipMapHalf, 3>(const MipMapHalf* thisRow,
+                                    const MipMapHalf* nextRow,
+                                    MipMapHalf* dst,
+                                    int n)
+{
+    return halveInteriorRowFloats3(thisRow, nextRow, dst, n);
+}
+
+template <>
+inline int
+halveInteriorRowSimd<MipMapHalf, 4>(const MipMapHalf* thisRow,
+                                    const MipMapHalf* nextRow,
+                                    MipMapHalf* dst,
+                                    int n)
+{
+    return halveInteriorRowFloats4(thisRow, nextRow, dst, n);
+}
+#endif // __F16C__
+#endif // defined(__SSE2__)
+
+// halve an interior row of n destination pixels, where the 2*n pixels of both source rows are within the source bounds
+template <typename PIX, int nComponents>
+static void
+halveInteriorRow(const PIX* thisRow,
+                 const PIX* nextRow,
+                 PIX* dst,
+                 int n)
+{
+    typedef MipMapPixelTraits<PIX> Traits;
+    const int done = halveInteriorRowSimd<PIX, nComponents>(thisRow, nextRow, dst, n);
+
+    for (int i = done * nComponents; i < n * nComponents; i += nComponents) {
+        for (int k = 0; k < nComponents; ++k) {
+            const typename Traits::Sum a = Traits::toSum(thisRow[i * 2 + k]);
+            const typename Traits::Sum b = Traits::toSum(thisRow[i * 2 + k + nComponents]);
+            const typename Traits::Sum c = Traits::toSum(nextRow[i * 2 + k]);
+            const typename Traits::Sum d = Traits::toSum(nextRow[i * 2 + k + nComponents]);
+            dst[i + k] = Traits::average(a + b + c + d, 4);
+        }
+    }
+}
+
+// update the pixels x1..x2 of a dst row, where some source pixels may be outside of the source bounds
+template <typename PIX, int nComponents>
+static void
+halveEdgePixels(int x1,
+                int x2,
+                const PIX* srcLineStart,
+                bool pickThisRow,
+                bool pickNextRow,
+                const OfxRectI & srcBounds,
+                int srcRowSize,
+                PIX* dstLineStart)
+{
+    typedef MipMapPixelTraits<PIX> Traits;
+    const typename Traits::Sum zero = typename Traits::Sum();
+    const int sumH = (int)pickNextRow + (int)pickThisRow;
+
+    assert(sumH == 1 || sumH == 2);
+    for (int x = x1; x < x2; ++x) {
+        const PIX* const srcPixStart    = srcLineStart   + x * 2 * nComponents;
+        PIX* const dstPixStart          = dstLineStart   + x * nComponents;
+
+        // The current dst col, at y, covers the src cols x*2 (thisCol) and x*2+1 (nextCol).
+        // Check that if are within srcBounds.
+        int srcx = x * 2;
+        bool pickThisCol = srcBounds.x1 <= (srcx + 0) && (srcx + 0) < srcBounds.x2;
+        bool pickNextCol = srcBounds.x1 <= (srcx + 1) && (srcx + 1) < srcBounds.x2;
+        const int sumW = (int)pickThisCol + (int)pickNextCol;
+        assert(sumW == 1 || sumW == 2);
+        const int sum = sumW * sumH;
+        assert(0 < sum && sum <= 4);
+
+        for (int k = 0; k < nComponents; ++k) {
+            ///a b
+            ///c d
+
+            const typename Traits::Sum a = (pickThisCol && pickThisRow) ? Traits::toSum(*(srcPixStart + k)) : zero;
+            const typename Traits::Sum b = (pickNextCol && pickThisRow) ? Traits::toSum(*(srcPixStart + k + nComponents)) : zero;
+            const typename Traits::Sum c = (pickThisCol && pickNextRow) ? Traits::toSum(*(srcPixStart + k + srcRowSize)) : zero;
+            const typename Traits::Sum d = (pickNextCol && pickNextRow) ? Traits::toSum(*(srcPixStart + k + srcRowSize  + nComponents)) : zero;
+
+            assert( sumW == 2 || ( sumW == 1 && ( (a == 0 && c == 0) || (b == 0 && d == 0) ) ) );
+            assert( sumH == 2 || ( sumH == 1 && ( (a == 0 && b == 0) || (c == 0 && d == 0) ) ) );
+            dstPixStart[k] = Traits::average(a + b + c + d, sum);
+        }
+    }
+}
+
 // update the window of dst defined by dstRoI by halving the corresponding area in src.
 // proofread and fixed by F. Devernay on 3/10/2014
 template <typename PIX, int nComponents>
@@ -51,6 +623,10 @@ halveWindow(const OfxRectI & dstRoI,
     const PIX* const srcData = srcPixels - (srcBounds.x1 * nComponents + srcRowSize * srcBounds.y1);
     PIX* const dstData       = dstPixels - (dstBounds.x1 * nComponents + dstRowSize * dstBounds.y1);
 
+    // the interior columns, where both src cols x*2 and x*2+1 are within srcBounds
+    const int interiorX1 = (std::min)( (std::max)( dstRoI.x1, (srcBounds.x1 + 1) >> 1 ), dstRoI.x2 );
+    const int interiorX2 = (std::max)( (std::min)( dstRoI.x2, srcBounds.x2 >> 1 ), interiorX1 );
+
     for (int y = dstRoI.y1; y < dstRoI.y2; ++y) {
         const PIX* const srcLineStart    = srcData + y * 2 * srcRowSize;
         PIX* const dstLineStart          = dstData + y     * dstRowSize;
@@ -60,40 +636,236 @@ halveWindow(const OfxRectI & dstRoI,
         int srcy = y * 2;
         bool pickThisRow = srcBounds.y1 <= (srcy + 0) && (srcy + 0) < srcBounds.y2;
         bool pickNextRow = srcBounds.y1 <= (srcy + 1) && (srcy + 1) < srcBounds.y2;
-        const int sumH = (int)pickNextRow + (int)pickThisRow;
-        assert(sumH == 1 || sumH == 2);
-
-        for (int x = dstRoI.x1; x < dstRoI.x2; ++x) {
-            const PIX* const srcPixStart    = srcLineStart   + x * 2 * nComponents;
-            PIX* const dstPixStart          = dstLineStart   + x * nComponents;
-
-            // The current dst col, at y, covers the src cols x*2 (thisCol) and x*2+1 (nextCol).
-            // Check that if are within srcBounds.
-            int srcx = x * 2;
-            bool pickThisCol = srcBounds.x1 <= (srcx + 0) && (srcx + 0) < srcBounds.x2;
-            bool pickNextCol = srcBounds.x1 <= (srcx + 1) && (srcx + 1) < srcBounds.x2;
-            const int sumW = (int)pickThisCol + (int)pickNextCol;
-            assert(sumW == 1 || sumW == 2);
-            const int sum = sumW * sumH;
-            assert(0 < sum && sum <= 4);
-
-            for (int k = 0; k < nComponents; ++k) {
-                ///a b
-                ///c d
-
-                const PIX a = (pickThisCol && pickThisRow) ? *(srcPixStart + k) : 0;
-                const PIX b = (pickNextCol && pickThisRow) ? *(srcPixStart + k + nComponents) : 0;
-                const PIX c = (pickThisCol && pickNextRow) ? *(srcPixStart + k + srcRowSize) : 0;
-                const PIX d = (pickNextCol && pickNextRow) ? *(srcPixStart + k + srcRowSize  + nComponents)  : 0;
-
-                assert( sumW == 2 || ( sumW == 1 && ( (a == 0 && c == 0) || (b == 0 && d == 0) ) ) );
-                assert( sumH == 2 || ( sumH == 1 && ( (a == 0 && b == 0) || (c == 0 && d == 0) ) ) );
-                dstPixStart[k] = (a + b + c + d) / sum;
-            }
+
+        if (pickThisRow && pickNextRow) {
+            // only the first and last columns may be partial
+            halveEdgePixels<PIX, nComponents>(dstRoI.x1, interiorX1, srcLineStart, true, true, srcBounds, srcRowSize, dstLineStart);
+            halveInteriorRow<PIX, nComponents>(srcLineStart + interiorX1 * 2 * nComponents,
+                                               srcLineStart + interiorX1 * 2 * nComponents + srcRowSize,
+                                               dstLineStart + interiorX1 * nComponents,
+                                               interiorX2 - interiorX1);
+            halveEdgePixels<PIX, nComponents>(interiorX2, dstRoI.x2, srcLineStart, true, true, srcBounds, srcRowSize, dstLineStart);
+        } else {
+            halveEdgePixels<PIX, nComponents>(dstRoI.x1, dstRoI.x2, srcLineStart, pickThisRow, pickNextRow, srcBounds, srcRowSize, dstLineStart);
         }
     }
 } // halveWindow
 
+// number of levels computed by a single parallel pass of MipMapPyramidBuilder.
+// A strip of a pass covers 2^kMipMapPassLevels source rows, which should stay in cache
+// until all the levels of the pass are computed.
+#define kMipMapPassLevels 4
+
+// a level of a mipmap pyramid, as processed by MipMapPyramidBuilder
+template <typename PIX>
+struct MipMapPyramidLevel
+{
+    PIX* pixels; // never written for level 0
+    OfxRectI bounds;
+    int rowBytes;
+    OfxRectI window; // the window to compute, the smallest enclosing po2 rect of the window at the level before
+};
+
+// computes the levels 1 to n of a mipmap pyramid from level 0, in parallel.
+// Levels are computed in passes of at most kMipMapPassLevels levels. In each pass, the rows
+// of the last level are split between the threads, and each thread computes, one row of the
+// last level at a time, the strip of each level of the pass that this row depends on.
+// This way, the rows of a level are computed as soon as the rows they depend on at the level
+// before are done, while those are still in cache, and threads never wait for each other.
+template <typename PIX, int nComponents>
+class MipMapPyramidBuilder
+    : public OFX::MultiThread::Processor
+{
+    const std::vector<MipMapPyramidLevel<PIX> >& _levels;
+    unsigned int _first; // the pass computes levels _first+1 to _last
+    unsigned int _last;
+
+public:
+    explicit MipMapPyramidBuilder(const std::vector<MipMapPyramidLevel<PIX> >& levels)
+        : _levels(levels)
+        , _first(0)
+        , _last(0)
+    {
+    }
+
+    void process()
+    {
+        const unsigned int n = (unsigned int)_levels.size() - 1;
+
+        for (_first = 0; _first < n; _first = _last) {
+            const OfxRectI & w = _levels[_first + 1].window;
+            if ( (w.x2 <= w.x1) || (w.y2 <= w.y1) ) {
+                return;
+            }
+            // make sure there are at least 4096 pixels per CPU at the first level of the pass
+            unsigned int nCPUs = (unsigned int)( (std::min)(w.x2 - w.x1, 4096) * (w.y2 - w.y1) ) / 4096;
+            nCPUs = (std::max)( 1u, (std::min)( nCPUs, OFX::MultiThread::getNumCPUs() ) );
+            // and at least one row of the last level of the pass per CPU
+            _last = (std::min)(_first + kMipMapPassLevels, n);
+            while ( _last > _first + 1 && (unsigned int)(_levels[_last].window.y2 - _levels[_last].window.y1) < nCPUs ) {
+                --_last;
+            }
+            nCPUs = (std::min)( nCPUs, (unsigned int)(_levels[_last].window.y2 - _levels[_last].window.y1) );
+            multiThread(nCPUs);
+        }
+    }
+
+    void multiThreadFunction(unsigned int threadId,
+                             unsigned int nThreads)
+    {
+        int y1, y2;
+
+        MultiThread::getThreadRange(threadId, nThreads, _levels[_last].window.y1, _levels[_last].window.y2, &y1, &y2);
+        for (int y = y1; y < y2; ++y) {
+            for (unsigned int i = _first + 1; i <= _last; ++i) {
+                // row y of the last level depends on 2^(_last-i) rows of level i
+                const int scale = 1 << (_last - i);
+                const MipMapPyramidLevel<PIX> & src = _levels[i - 1];
+                const MipMapPyramidLevel<PIX> & dst = _levels[i];
+                OfxRectI strip = dst.window;
+                strip.y1 = (std::max)(strip.y1, y * scale);
+                strip.y2 = (std::min)(strip.y2, (y + 1) * scale);
+                if (strip.y1 < strip.y2) {
+                    halveWindow<PIX, nComponents>(strip, src.pixels, src.bounds, src.rowBytes, dst.pixels, dst.bounds, dst.rowBytes);
+                }
+            }
+        }
+    }
+};
+
+// minimum level for which ofxsScalePixelData averages the source pixels directly,
+// instead of computing all the intermediate levels
+#define kMipMapFusedMinLevel 3
+
+// computes the weights of the source rows (if vertical) or columns (if !vertical) in the
+// last level of a pyramid, starting at the first source row or column of the last level window.
+// As in halveWindow, a pixel is the average of its children that are present in the level before,
+// i.e. that are within the bounds at level 0, or within the window at the other levels.
+// The pixel (x,y) of the last level is thus the sum of weightsX[sx] * weightsY[sy] * src(sx,sy)
+// over its block of 2^n x 2^n source pixels, where n is the last level.
+template <typename PIX>
+static void
+computeFusedWeights(const std::vector<MipMapPyramidLevel<PIX> >& levels,
+                    bool vertical,
+                    std::vector<float>* weights)
+{
+    const unsigned int n = (unsigned int)levels.size() - 1;
+    const OfxRectI & window = levels[n].window;
+    int x1 = vertical ? window.y1 : window.x1;
+    int x2 = vertical ? window.y2 : window.x2;
+    std::vector<double> w(x2 - x1, 1.);
+    std::vector<double> children;
+
+    for (unsigned int i = n; i > 0; --i) {
+        const OfxRectI & present = (i == 1) ? levels[0].bounds : levels[i - 1].window;
+        const int p1 = vertical ? present.y1 : present.x1;
+        const int p2 = vertical ? present.y2 : present.x2;
+        children.assign(2 * (x2 - x1), 0.);
+        for (int x = x1; x < x2; ++x) {
+            // the pixel x covers the pixels x*2 (this) and x*2+1 (next) of the level before
+            const bool pickThis = p1 <= (x * 2 + 0) && (x * 2 + 0) < p2;
+            const bool pickNext = p1 <= (x * 2 + 1) && (x * 2 + 1) < p2;
+            const int sum = (int)pickThis + (int)pickNext;
+            if (sum > 0) {
+                children[(x - x1) * 2 + 0] = pickThis ? w[x - x1] / sum : 0.;
+                children[(x - x1) * 2 + 1] = pickNext ? w[x - x1] / sum : 0.;
+            }
+        }
+        w.swap(children);
+        x1 *= 2;
+        x2 *= 2;
+    }
+    weights->assign( w.begin(), w.end() );
+}
+
+// computes the last level of a mipmap pyramid directly from level 0, in parallel.
+// Each destination pixel is the weighted average of its block of source pixels, with the weights
+// given by computeFusedWeights, so that the result is the same as halving the image n times
+// (up to rounding errors), but the source is read in a single pass and no intermediate level is stored.
+template <typename PIX, int nComponents>
+class MipMapFusedDownscaler
+    : public OFX::MultiThread::Processor
+{
+    const std::vector<MipMapPyramidLevel<PIX> >& _levels;
+    std::vector<float> _weightsX;
+    std::vector<float> _weightsY;
+
+public:
+    explicit MipMapFusedDownscaler(const std::vector<MipMapPyramidLevel<PIX> >& levels)
+        : _levels(levels)
+        , _weightsX()
+        , _weightsY()
+    {
+        computeFusedWeights(_levels, false, &_weightsX);
+        computeFusedWeights(_levels, true, &_weightsY);
+    }
+
+    void process()
+    {
+        const unsigned int n = (unsigned int)_levels.size() - 1;
+        const OfxRectI & w = _levels[n].window;
+
+        if ( (w.x2 <= w.x1) || (w.y2 <= w.y1) ) {
+            return;
+        }
+        // make sure there are at least 4096 source pixels per CPU and at least 1 line par CPU
+        unsigned int nCPUs = (unsigned int)( (std::min)( (w.x2 - w.x1) << n, 4096 ) * ( (w.y2 - w.y1) << n ) ) / 4096;
+        nCPUs = (std::max)( 1u, (std::min)( nCPUs, OFX::MultiThread::getNumCPUs() ) );
+        nCPUs = (std::min)( nCPUs, (unsigned int)(w.y2 - w.y1) );
+        multiThread(nCPUs);
+    }
+
+    void multiThreadFunction(unsigned int threadId,
+                             unsigned int nThreads)
+    {
+        const unsigned int n = (unsigned int)_levels.size() - 1;
+        const int scale = 1 << n;
+        const MipMapPyramidLevel<PIX> & src = _levels[0];
+        const MipMapPyramidLevel<PIX> & dst = _levels[n];
+        const OfxRectI & window = dst.window;
+        std::vector<float> sums( (window.x2 - window.x1) * nComponents );
+        int y1, y2;
+
+        MultiThread::getThreadRange(threadId, nThreads, window.y1, window.y2, &y1, &y2);
+        for (int y = y1; y < y2; ++y) {
+            std::fill( sums.begin(), sums.end(), 0.f );
+            const int srcy1 = (std::max)(y * scale, src.bounds.y1);
+            const int srcy2 = (std::min)( (y + 1) * scale, src.bounds.y2 );
+            for (int srcy = srcy1; srcy < srcy2; ++srcy) {
+                const float wy = _weightsY[srcy - window.y1 * scale];
+                if (wy == 0.f) {
+                    continue;
+                }
+                const PIX* const srcLineStart = (const PIX*)( (const char*)src.pixels + (std::ptrdiff_t)(srcy - src.bounds.y1) * src.rowBytes );
+                float* sumPix = &sums[0];
+                for (int x = window.x1; x < window.x2; ++x, sumPix += nComponents) {
+                    const int srcx1 = (std::max)(x * scale, src.bounds.x1);
+                    const int srcx2 = (std::min)( (x + 1) * scale, src.bounds.x2 );
+                    const PIX* srcPix = srcLineStart + (srcx1 - src.bounds.x1) * nComponents;
+                    const float* wx = &_weightsX[srcx1 - window.x1 * scale];
+                    float rowSum[nComponents];
+                    for (int k = 0; k < nComponents; ++k) {
+                        rowSum[k] = 0.f;
+                    }
+                    for (int srcx = srcx1; srcx < srcx2; ++srcx, srcPix += nComponents, ++wx) {
+                        for (int k = 0; k < nComponents; ++k) {
+                            rowSum[k] += *wx * MipMapPixelTraits<PIX>::toFloat(srcPix[k]);
+                        }
+                    }
+                    for (int k = 0; k < nComponents; ++k) {
+                        sumPix[k] += wy * rowSum[k];
+                    }
+                }
+            }
+            PIX* const dstLineStart = (PIX*)( (char*)dst.pixels + (std::ptrdiff_t)(y - dst.bounds.y1) * dst.rowBytes ) +
+                                      (window.x1 - dst.bounds.x1) * nComponents;
+            for (std::size_t i = 0; i < sums.size(); ++i) {
+                dstLineStart[i] = MipMapPixelTraits<PIX>::fromFloat(sums[i]);
+            }
+        }
+    }
+};
+
 // update the window of dst defined by originalRenderWindow by mipmapping the windows of src defined by renderWindowFullRes
 // proofread and fixed by F. Devernay on 3/10/2014
 template <typename PIX, int nComponents>
@@ -115,66 +887,89 @@ buildMipMapLevel(ImageEffect* instance,
         throwSuiteStatusException(kOfxStatFailed);
     }
 
-    auto_ptr<ImageMemory> mem;
+    std::vector<MipMapPyramidLevel<PIX> > levels(level + 1);
+    levels[0].pixels = const_cast<PIX*>(srcPixels);
+    levels[0].bounds = srcBounds;
+    levels[0].rowBytes = srcRowBytes;
+    levels[0].window = renderWindowFullRes;
+
+    ///Compute the window of all the mipmap levels until we reach the one we are interested in
     size_t memSize = 0;
-    auto_ptr<ImageMemory> tmpMem;
-    size_t tmpMemSize = 0;
-    PIX* nextImg = NULL;
-    const PIX* previousImg = srcPixels;
-    OfxRectI previousBounds = srcBounds;
-    int previousRowBytes = srcRowBytes;
-    OfxRectI nextRenderWindow = renderWindowFullRes;
-
-    ///Build all the mipmap levels until we reach the one we are interested in
-    for (unsigned int i = 1; i < level; ++i) {
-        // loop invariant:
-        // - previousImg, previousBounds, previousRowBytes describe the data ate the level before i
-        // - nextRenderWindow contains the renderWindow at the level before i
-        //
+    for (unsigned int i = 1; i <= level; ++i) {
         ///Halve the smallest enclosing po2 rect as we need to render a minimum of the renderWindow
-        nextRenderWindow = downscalePowerOfTwoSmallestEnclosing(nextRenderWindow, 1);
+        levels[i].window = Coords::downscalePowerOfTwoSmallestEnclosing(levels[i - 1].window, 1);
 #     ifdef DEBUG
         {
             // check that doing i times 1 level is the same as doing i levels
-            OfxRectI nrw = downscalePowerOfTwoSmallestEnclosing(renderWindowFullRes, i);
-            assert(nrw.x1 == nextRenderWindow.x1 && nrw.x2 == nextRenderWindow.x2 && nrw.y1 == nextRenderWindow.y1 && nrw.y2 == nextRenderWindow.y2);
+            OfxRectI nrw = Coords::downscalePowerOfTwoSmallestEnclosing(renderWindowFullRes, i);
+            assert(nrw.x1 == levels[i].window.x1 && nrw.x2 == levels[i].window.x2 && nrw.y1 == levels[i].window.y1 && nrw.y2 == levels[i].window.y2);
         }
 #     endif
-        ///Allocate a temporary image if necessary, or reuse the previously allocated buffer
-        int nextRowBytes =  (nextRenderWindow.x2 - nextRenderWindow.x1)  * nComponents * sizeof(PIX);
-        size_t newMemSize =  (nextRenderWindow.y2 - nextRenderWindow.y1) * nextRowBytes;
-        if ( tmpMem.get() ) {
-            // there should be enough memory: no need to reallocate
-            assert(tmpMemSize >= memSize);
-        } else {
-            tmpMem.reset( new ImageMemory(newMemSize, instance) );
-            tmpMemSize = newMemSize;
+        if (i < level) {
+            levels[i].bounds = levels[i].window;
+            levels[i].rowBytes = (levels[i].window.x2 - levels[i].window.x1) * nComponents * sizeof(PIX);
+            memSize += (levels[i].window.y2 - levels[i].window.y1) * levels[i].rowBytes;
         }
-        nextImg = (float*)tmpMem->lock();
+    }
+
+    ///The last level is halved directly into the dstPixels
+    ///Its window should be equal to the original render window.
+    assert(originalRenderWindow.x1 == levels[level].window.x1 && originalRenderWindow.x2 == levels[level].window.x2 &&
+           originalRenderWindow.y1 == levels[level].window.y1 && originalRenderWindow.y2 == levels[level].window.y2);
+    levels[level].pixels = dstPixels;
+    levels[level].bounds = dstBounds;
+    levels[level].rowBytes = dstRowBytes;
 
-        halveWindow<PIX, nComponents>(nextRenderWindow, previousImg, previousBounds, previousRowBytes, nextImg, nextRenderWindow, nextRowBytes);
+    if (level >= kMipMapFusedMinLevel) {
+        ///Average the source pixels directly, without computing the intermediate levels
+        MipMapFusedDownscaler<PIX, nComponents> downscaler(levels);
+        downscaler.process();
 
-        ///Switch for next pass
-        previousBounds = nextRenderWindow;
-        previousRowBytes = nextRowBytes;
-        previousImg = nextImg;
-        mem = tmpMem;
-        memSize = tmpMemSize;
+        return;
     }
-    // here:
-    // - previousImg, previousBounds, previousRowBytes describe the data ate the level before 'level'
-    // - nextRenderWindow contains the renderWindow at the level before 'level'
 
-    ///On the last iteration halve directly into the dstPixels
-    ///The nextRenderWindow should be equal to the original render window.
-    nextRenderWindow = downscalePowerOfTwoSmallestEnclosing(nextRenderWindow, 1);
-    assert(originalRenderWindow.x1 == nextRenderWindow.x1 && originalRenderWindow.x2 == nextRenderWindow.x2 &&
-           originalRenderWindow.y1 == nextRenderWindow.y1 && originalRenderWindow.y2 == nextRenderWindow.y2);
+    ///Allocate a temporary image for all the intermediate levels, which are computed together
+    auto_ptr<ImageMemory> mem;
+    if (level > 1) {
+        mem.reset( new ImageMemory(memSize, instance) );
+        char* tmpPixels = (char*)mem->lock();
+        for (unsigned int i = 1; i < level; ++i) {
+            levels[i].pixels = (PIX*)tmpPixels;
+            tmpPixels += (levels[i].window.y2 - levels[i].window.y1) * levels[i].rowBytes;
+        }
+    }
 
-    halveWindow<PIX, nComponents>(nextRenderWindow, previousImg, previousBounds, previousRowBytes, dstPixels, dstBounds, dstRowBytes);
-    // mem and tmpMem are freed at destruction
+    MipMapPyramidBuilder<PIX, nComponents> builder(levels);
+    builder.process();
+    // mem is freed at destruction
 } // buildMipMapLevel
 
+template <typename PIX>
+static void
+ofxsScalePixelDataForDepth(ImageEffect* instance,
+                           const OfxRectI & originalRenderWindow,
+                           const OfxRectI & renderWindow,
+                           unsigned int levels,
+                           const void* srcPixelData,
+                           const OfxRectI & srcBounds,
+                           int srcRowBytes,
+                           void* dstPixelData,
+                           PixelComponentEnum dstPixelComponents,
+                           const OfxRectI & dstBounds,
+                           int dstRowBytes)
+{
+    if (dstPixelComponents == ePixelComponentRGBA) {
+        buildMipMapLevel<PIX, 4>(instance, originalRenderWindow, renderWindow, levels, (const PIX*)srcPixelData,
+                                 srcBounds, srcRowBytes, (PIX*)dstPixelData, dstBounds, dstRowBytes);
+    } else if (dstPixelComponents == ePixelComponentRGB) {
+        buildMipMapLevel<PIX, 3>(instance, originalRenderWindow, renderWindow, levels, (const PIX*)srcPixelData,
+                                 srcBounds, srcRowBytes, (PIX*)dstPixelData, dstBounds, dstRowBytes);
+    }  else if (dstPixelComponents == ePixelComponentAlpha) {
+        buildMipMapLevel<PIX, 1>(instance, originalRenderWindow, renderWindow, levels, (const PIX*)srcPixelData,
+                                 srcBounds, srcRowBytes, (PIX*)dstPixelData, dstBounds, dstRowBytes);
+    }     // switch
+}
+
 void
 ofxsScalePixelData(ImageEffect* instance,
                    const OfxRectI & originalRenderWindow,
@@ -198,7 +993,10 @@ ofxsScalePixelData(ImageEffect* instance,
 
 # ifndef NDEBUG
     // do the rendering
-    if ( ( dstPixelDepth != eBitDepthFloat) ||
+    if ( ( ( dstPixelDepth != eBitDepthUByte) &&
+           ( dstPixelDepth != eBitDepthUShort) &&
+           ( dstPixelDepth != eBitDepthHalf) &&
+           ( dstPixelDepth != eBitDepthFloat) ) ||
          ( ( dstPixelComponents != ePixelComponentRGBA) &&
            ( dstPixelComponents != ePixelComponentRGB) &&
            ( dstPixelComponents != ePixelComponentAlpha) ) ||
@@ -208,15 +1006,18 @@ ofxsScalePixelData(ImageEffect* instance,
     }
 # endif
 
-    if (dstPixelComponents == ePixelComponentRGBA) {
-        buildMipMapLevel<float, 4>(instance, originalRenderWindow, renderWindow, levels, (const float*)srcPixelData,
-                                   srcBounds, srcRowBytes, (float*)dstPixelData, dstBounds, dstRowBytes);
-    } else if (dstPixelComponents == ePixelComponentRGB) {
-        buildMipMapLevel<float, 3>(instance, originalRenderWindow, renderWindow, levels, (const float*)srcPixelData,
-                                   srcBounds, srcRowBytes, (float*)dstPixelData, dstBounds, dstRowBytes);
-    }  else if (dstPixelComponents == ePixelComponentAlpha) {
-        buildMipMapLevel<float, 1>(instance, originalRenderWindow, renderWindow, levels, (const float*)srcPixelData,
-                                   srcBounds, srcRowBytes, (float*)dstPixelData, dstBounds, dstRowBytes);
+    if (dstPixelDepth == eBitDepthUByte) {
+        ofxsScalePixelDataForDepth<unsigned char>(instance, originalRenderWindow, renderWindow, levels, srcPixelData, srcBounds, srcRowBytes,
+                                                  dstPixelData, dstPixelComponents, dstBounds, dstRowBytes);
+    } else if (dstPixelDepth == eBitDepthUShort) {
+        ofxsScalePixelDataForDepth<unsigned short>(instance, originalRenderWindow, renderWindow, levels, srcPixelData, srcBounds, srcRowBytes,
+                                                   dstPixelData, dstPixelComponents, dstBounds, dstRowBytes);
+    } else if (dstPixelDepth == eBitDepthHalf) {
+        ofxsScalePixelDataForDepth<MipMapHalf>(instance, originalRenderWindow, renderWindow, levels, srcPixelData, srcBounds, srcRowBytes,
+                                               dstPixelData, dstPixelComponents, dstBounds, dstRowBytes);
+    } else if (dstPixelDepth == eBitDepthFloat) {
+        ofxsScalePixelDataForDepth<float>(instance, originalRenderWindow, renderWindow, levels, srcPixelData, srcBounds, srcRowBytes,
+                                          dstPixelData, dstPixelComponents, dstBounds, dstRowBytes);
     }     // switch
 }
 
@@ -234,44 +1035,63 @@ ofxsBuildMipMapsForComponents(ImageEffect* instance,
     if (!srcPixelData) {
         throwSuiteStatusException(kOfxStatFailed);
     }
-    const PIX* previousImg = srcPixelData;
-    OfxRectI previousBounds = srcBounds;
-    int previousRowBytes = srcRowBytes;
-    OfxRectI nextRenderWindow = renderWindow;
 
-    ///Build all the mipmap levels until we reach the one we are interested in
+    std::vector<MipMapPyramidLevel<PIX> > levels(maxLevel + 1);
+    levels[0].pixels = const_cast<PIX*>(srcPixelData);
+    levels[0].bounds = srcBounds;
+    levels[0].rowBytes = srcRowBytes;
+    levels[0].window = renderWindow;
+
+    ///Allocate all the mipmap levels, which are computed together
     for (unsigned int i = 1; i <= maxLevel; ++i) {
-        // loop invariant:
-        // - previousImg, previousBounds, previousRowBytes describe the data ate the level before i
-        // - nextRenderWindow contains the renderWindow at the level before i
-        //
         ///Halve the smallest enclosing po2 rect as we need to render a minimum of the renderWindow
-        nextRenderWindow = downscalePowerOfTwoSmallestEnclosing(nextRenderWindow, 1);
+        const OfxRectI nextRenderWindow = Coords::downscalePowerOfTwoSmallestEnclosing(levels[i - 1].window, 1);
 #     ifdef DEBUG
         {
             // check that doing i times 1 level is the same as doing i levels
-            OfxRectI nrw = downscalePowerOfTwoSmallestEnclosing(renderWindowFullRes, i);
+            OfxRectI nrw = Coords::downscalePowerOfTwoSmallestEnclosing(renderWindow, i);
             assert(nrw.x1 == nextRenderWindow.x1 && nrw.x2 == nextRenderWindow.x2 && nrw.y1 == nextRenderWindow.y1 && nrw.y2 == nextRenderWindow.y2);
         }
 #     endif
-        assert(i - 1 >= 0);
 
-        ///Allocate a temporary image if necessary, or reuse the previously allocated buffer
         int nextRowBytes = (nextRenderWindow.x2 - nextRenderWindow.x1)  * nComponents * sizeof(PIX);
         mipmaps[i - 1].memSize = (nextRenderWindow.y2 - nextRenderWindow.y1) * nextRowBytes;
         mipmaps[i - 1].bounds = nextRenderWindow;
 
+        delete mipmaps[i - 1].data;
+        mipmaps[i - 1].data = NULL;
         mipmaps[i - 1].data = new ImageMemory(mipmaps[i - 1].memSize, instance);
-        tmpMemSize = newMemSize;
 
-        float* nextImg = (float*)tmpMem->lock();
+        levels[i].pixels = (PIX*)mipmaps[i - 1].data->lock();
+        levels[i].bounds = nextRenderWindow;
+        levels[i].rowBytes = nextRowBytes;
+        levels[i].window = nextRenderWindow;
+    }
 
-        halveWindow<PIX, nComponents>(nextRenderWindow, previousImg, previousBounds, previousRowBytes, nextImg, nextRenderWindow, nextRowBytes);
+    MipMapPyramidBuilder<PIX, nComponents> builder(levels);
+    builder.process();
+}
 
-        ///Switch for next pass
-        previousBounds = nextRenderWindow;
-        previousRowBytes = nextRowBytes;
-        previousImg = nextImg;
+template <typename PIX>
+static void
+ofxsBuildMipMapsForDepth(ImageEffect* instance,
+                         const OfxRectI & renderWindow,
+                         const void* srcPixelData,
+                         PixelComponentEnum srcPixelComponents,
+                         const OfxRectI & srcBounds,
+                         int srcRowBytes,
+                         unsigned int maxLevel,
+                         MipMapsVector & mipmaps)
+{
+    if (srcPixelComponents == ePixelComponentRGBA) {
+        ofxsBuildMipMapsForComponents<PIX, 4>(instance, renderWindow, (const PIX*)srcPixelData, srcBounds,
+                                              srcRowBytes, maxLevel, mipmaps);
+    } else if (srcPixelComponents == ePixelComponentRGB) {
+        ofxsBuildMipMapsForComponents<PIX, 3>(instance, renderWindow, (const PIX*)srcPixelData, srcBounds,
+                                              srcRowBytes, maxLevel, mipmaps);
+    }  else if (srcPixelComponents == ePixelComponentAlpha) {
+        ofxsBuildMipMapsForComponents<PIX, 1>(instance, renderWindow, (const PIX*)srcPixelData, srcBounds,
+                                              srcRowBytes, maxLevel, mipmaps);
     }
 }
 
@@ -286,28 +1106,337 @@ ofxsBuildMipMaps(ImageEffect* instance,
                  unsigned int maxLevel,
                  MipMapsVector & mipmaps)
 {
-    assert(srcPixelData && mipmaps->size() == maxLevel);
-    if ( !srcPixelData || (mipmaps->size() != maxLevel) ) {
+    assert(srcPixelData && mipmaps.size() == maxLevel);
+    if ( !srcPixelData || (mipmaps.size() != maxLevel) ) {
         throwSuiteStatusException(kOfxStatFailed);
     }
 
     // do the rendering
-    if ( srcPixelData && ( ( srcPixelDepth != eBitDepthFloat) ||
+    if ( srcPixelData && ( ( ( srcPixelDepth != eBitDepthUByte) &&
+                             ( srcPixelDepth != eBitDepthUShort) &&
+                             ( srcPixelDepth != eBitDepthHalf) &&
+                             ( srcPixelDepth != eBitDepthFloat) ) ||
                            ( ( srcPixelComponents != ePixelComponentRGBA) &&
                              ( srcPixelComponents != ePixelComponentRGB) &&
                              ( srcPixelComponents != ePixelComponentAlpha) ) ) ) {
         throwSuiteStatusException(kOfxStatErrFormat);
     }
 
-    if (dstPixelComponents == ePixelComponentRGBA) {
-        ofxsBuildMipMapsForComponents<float, 4>(instance, renderWindow, srcPixelData, srcBounds,
-                                                srcRowBytes, maxLevel, mipmaps);
-    } else if (dstPixelComponents == ePixelComponentRGB) {
-        ofxsBuildMipMapsForComponents<float, 3>(instance, renderWindow, srcPixelData, srcBounds,
-                                                srcRowBytes, maxLevel, mipmaps);
-    }  else if (dstPixelComponents == ePixelComponentAlpha) {
-        ofxsBuildMipMapsForComponents<float, 1>(instance, renderWindow, srcPixelData, srcBounds,
+    if (srcPixelDepth == eBitDepthUByte) {
+        ofxsBuildMipMapsForDepth<unsigned char>(instance, renderWindow, srcPixelData, srcPixelComponents, srcBounds,
                                                 srcRowBytes, maxLevel, mipmaps);
+    } else if (srcPixelDepth == eBitDepthUShort) {
+        ofxsBuildMipMapsForDepth<unsigned short>(instance, renderWindow, srcPixelData, srcPixelComponents, srcBounds,
+                                                 srcRowBytes, maxLevel, mipmaps);
+    } else if (srcPixelDepth == eBitDepthHalf) {
+        ofxsBuildMipMapsForDepth<MipMapHalf>(instance, renderWindow, srcPixelData, srcPixelComponents, srcBounds,
+                                             srcRowBytes, maxLevel, mipmaps);
+    } else if (srcPixelDepth == eBitDepthFloat) {
+        ofxsBuildMipMapsForDepth<float>(instance, renderWindow, srcPixelData, srcPixelComponents, srcBounds,
+                                        srcRowBytes, maxLevel, mipmaps);
+    }
+}
+
+// the key of a level in a MipMapCache
+struct MipMapCacheKey
+{
+    MipMapImageId id;
+    OfxRectI srcBounds;
+    OfxRectI renderWindow;
+    PixelComponentEnum components;
+    BitDepthEnum depth;
+    unsigned int level;
+
+    bool operator<(const MipMapCacheKey & other) const
+    {
+        if (level != other.level) {
+            return level < other.level;
+        }
+        if (id.time != other.id.time) {
+            return id.time < other.id.time;
+        }
+        if (id.view != other.id.view) {
+            return id.view < other.id.view;
+        }
+        if (id.clip != other.id.clip) {
+            return id.clip < other.id.clip;
+        }
+        if (id.plane != other.id.plane) {
+            return id.plane < other.id.plane;
+        }
+        if (components != other.components) {
+            return components < other.components;
+        }
+        if (depth != other.depth) {
+            return depth < other.depth;
+        }
+        const int a[8] = {
+            srcBounds.x1, srcBounds.y1, srcBounds.x2, srcBounds.y2,
+            renderWindow.x1, renderWindow.y1, renderWindow.x2, renderWindow.y2
+        };
+        const int b[8] = {
+            other.srcBounds.x1, other.srcBounds.y1, other.srcBounds.x2, other.srcBounds.y2,
+            other.renderWindow.x1, other.renderWindow.y1, other.renderWindow.x2, other.renderWindow.y2
+        };
+
+        return std::lexicographical_compare(a, a + 8, b, b + 8);
+    }
+};
+
+// a level in a MipMapCache, which owns its memory
+struct MipMapCacheEntry
+    : public CachedMipMap
+{
+    MipMapCacheKey key;
+    ImageMemory* memory;
+    std::size_t memSize;
+    int refCount; // the number of acquireLevel calls that were not released yet
+    std::list<MipMapCacheEntry*>::iterator lruPos;
+};
+
+struct MipMapCachePrivate
+{
+    typedef std::map<MipMapCacheKey, MipMapCacheEntry*> EntryMap;
+    typedef std::list<MipMapCacheEntry*> EntryList;
+
+    MultiThread::Mutex lock; // protects all the members below
+    std::size_t maxBytes;
+    std::size_t bytes;
+    EntryMap entries;
+    EntryList lru; // the most recently used first
+
+    explicit MipMapCachePrivate(std::size_t maxBytes_)
+        : lock()
+        , maxBytes(maxBytes_)
+        , bytes(0)
+        , entries()
+        , lru()
+    {
+    }
+
+    // mark an entry as the most recently used
+    void touch(MipMapCacheEntry* e)
+    {
+        lru.splice(lru.begin(), lru, e->lruPos);
+    }
+
+    // free an entry that is not acquired
+    void erase(EntryMap::iterator it)
+    {
+        MipMapCacheEntry* e = it->second;
+
+        assert(e->refCount == 0);
+        bytes -= e->memSize;
+        lru.erase(e->lruPos);
+        entries.erase(it);
+        delete e->memory;
+        delete e;
+    }
+
+    // evict the least recently used entries that are not acquired, until the cache fits in the budget
+    void evict()
+    {
+        EntryList::iterator it = lru.end();
+
+        while ( bytes > maxBytes && it != lru.begin() ) {
+            --it;
+            MipMapCacheEntry* e = *it;
+            if (e->refCount == 0) {
+                ++it; // the next entry stays valid
+                erase( entries.find(e->key) );
+            }
+        }
+    }
+};
+
+static int
+getPixelBytes(PixelComponentEnum pixelComponents,
+              BitDepthEnum bitDepth)
+{
+    const int nComponents = (pixelComponents == ePixelComponentRGBA) ? 4 : (pixelComponents == ePixelComponentRGB) ? 3 : 1;
+    const int componentBytes = (bitDepth == eBitDepthUByte) ? 1 : (bitDepth == eBitDepthFloat) ? 4 : 2;
+
+    return nComponents * componentBytes;
+}
+
+MipMapCache::MipMapCache(std::size_t maxBytes)
+    : _imp( new MipMapCachePrivate(maxBytes) )
+{
+}
+
+MipMapCache::~MipMapCache()
+{
+    for (MipMapCachePrivate::EntryMap::iterator it = _imp->entries.begin(); it != _imp->entries.end(); ++it) {
+        // all the levels should have been released. A level which is still acquired is leaked rather
+        // than freed, so that the pointer held by its user does not dangle.
+        assert(it->second->refCount == 0);
+        if (it->second->refCount == 0) {
+            delete it->second->memory;
+            delete it->second;
+        }
+    }
+}
+
+void
+MipMapCache::setMaxBytes(std::size_t maxBytes)
+{
+    MultiThread::AutoMutex l(_imp->lock);
+
+    _imp->maxBytes = maxBytes;
+    _imp->evict();
+}
+
+std::size_t
+MipMapCache::getMaxBytes() const
+{
+    MultiThread::AutoMutex l(_imp->lock);
+
+    return _imp->maxBytes;
+}
+
+std::size_t
+MipMapCache::getBytes() const
+{
+    MultiThread::AutoMutex l(_imp->lock);
+
+    return _imp->bytes;
+}
+
+const CachedMipMap*
+MipMapCache::acquireLevel(const MipMapImageId & id,
+                          const OfxRectI & renderWindow,
+                          const void* srcPixelData,
+                          PixelComponentEnum srcPixelComponents,
+                          BitDepthEnum srcPixelDepth,
+                          const OfxRectI & srcBounds,
+                          int srcRowBytes,
+                          unsigned int level)
+{
+    assert(level > 0);
+    if (level == 0) {
+        throwSuiteStatusException(kOfxStatErrValue);
+    }
+
+    MipMapCacheKey key;
+    key.id = id;
+    key.srcBounds = srcBounds;
+    key.renderWindow = renderWindow;
+    key.components = srcPixelComponents;
+    key.depth = srcPixelDepth;
+    key.level = level;
+
+    // look for the level, or else for the deepest cached level above it, which is acquired while we build from it
+    MipMapCacheEntry* parent = NULL;
+    {
+        MultiThread::AutoMutex l(_imp->lock);
+        MipMapCachePrivate::EntryMap::iterator it = _imp->entries.find(key);
+        if ( it != _imp->entries.end() ) {
+            ++it->second->refCount;
+            _imp->touch(it->second);
+
+            return it->second;
+        }
+        for (key.level = level - 1; key.level > 0; --key.level) {
+            it = _imp->entries.find(key);
+            if ( it != _imp->entries.end() ) {
+                parent = it->second;
+                ++parent->refCount;
+                _imp->touch(parent);
+                break;
+            }
+        }
+    }
+
+    // build the missing levels without holding the lock.
+    // They are allocated with no instance, because they may stay in the cache after the instance is destroyed.
+    const unsigned int parentLevel = parent ? parent->level : 0;
+    MipMapsVector mipmaps(level - parentLevel);
+    try {
+        if (parent) {
+            ofxsBuildMipMaps(NULL, parent->bounds, parent->pixelData, srcPixelComponents, srcPixelDepth,
+                             parent->bounds, parent->rowBytes, level - parentLevel, mipmaps);
+        } else {
+            if (!srcPixelData) {
+                throwSuiteStatusException(kOfxStatFailed);
+            }
+            ofxsBuildMipMaps(NULL, renderWindow, srcPixelData, srcPixelComponents, srcPixelDepth,
+                             srcBounds, srcRowBytes, level, mipmaps);
+        }
+    } catch (...) {
+        releaseLevel(parent);
+        throw;
+    }
+
+    // cache all the levels that were built
+    const int pixelBytes = getPixelBytes(srcPixelComponents, srcPixelDepth);
+    MipMapCacheEntry* result = NULL;
+    {
+        MultiThread::AutoMutex l(_imp->lock);
+        if (parent) {
+            --parent->refCount;
+        }
+        for (unsigned int i = parentLevel + 1; i <= level; ++i) {
+            MipMap & mipmap = mipmaps[i - parentLevel - 1];
+            key.level = i;
+            MipMapCachePrivate::EntryMap::iterator it = _imp->entries.find(key);
+            MipMapCacheEntry* e;
+            if ( it != _imp->entries.end() ) {
+                // another thread cached this level in the meantime: keep it, and free ours with mipmaps
+                e = it->second;
+                _imp->touch(e);
+            } else {
+                e = new MipMapCacheEntry;
+                e->pixelData = mipmap.data->lock();
+                e->bounds = mipmap.bounds;
+                e->rowBytes = (mipmap.bounds.x2 - mipmap.bounds.x1) * pixelBytes;
+                e->level = i;
+                e->key = key;
+                e->memory = mipmap.data;
+                mipmap.data = NULL;
+                e->memSize = mipmap.memSize;
+                e->refCount = 0;
+                _imp->lru.push_front(e);
+                e->lruPos = _imp->lru.begin();
+                _imp->entries[key] = e;
+                _imp->bytes += e->memSize;
+            }
+            if (i == level) {
+                ++e->refCount;
+                result = e;
+            }
+        }
+        _imp->evict();
+    }
+
+    return result;
+} // MipMapCache::acquireLevel
+
+void
+MipMapCache::releaseLevel(const CachedMipMap* mipmap)
+{
+    if (!mipmap) {
+        return;
+    }
+    MultiThread::AutoMutex l(_imp->lock);
+    MipMapCacheEntry* e = static_cast<MipMapCacheEntry*>( const_cast<CachedMipMap*>(mipmap) );
+
+    assert(e->refCount > 0);
+    --e->refCount;
+    _imp->evict();
+}
+
+void
+MipMapCache::clear()
+{
+    MultiThread::AutoMutex l(_imp->lock);
+
+    for (MipMapCachePrivate::EntryMap::iterator it = _imp->entries.begin(); it != _imp->entries.end(); ) {
+        MipMapCachePrivate::EntryMap::iterator next = it;
+        ++next;
+        if (it->second->refCount == 0) {
+            _imp->erase(it);
+        }
+        it = next;
     }
 }
 } // OFX
@@ -27,6 +27,7 @@
 
 #include <cmath>
 #include <cassert>
+#include <string>
 #include <vector>
 
 #include "ofxsImageEffect.h"
@@ -74,6 +75,7 @@ typedef std::vector<MipMap> MipMapsVector;
    @brief Given the original image, this function builds all mipmap levels
    up to maxLevel and stores them in the mipmaps vector, in decreasing LoD.
    The original image will not be stored in the mipmaps vector.
+   The image may be 8-bit, 16-bit, half or float, with 1, 3 or 4 components.
    @param mipmaps[out] The mipmaps vector should contains at least maxLevel
    entries
  **/
@@ -86,6 +88,104 @@ void ofxsBuildMipMaps(OFX::ImageEffect* instance,
                       int srcRowBytes,
                       unsigned int maxLevel,
                       MipMapsVector & mipmaps);
+
+/**
+   @brief The identity of a source image in a MipMapCache.
+   Images with the same identity and bounds must have the same pixels.
+ **/
+struct MipMapImageId
+{
+    std::string clip; //!< the clip name
+    double time;
+    int view;
+    std::string plane; //!< the plane name, empty for the color plane
+
+    MipMapImageId()
+        : clip()
+        , time(0.)
+        , view(0)
+        , plane()
+    {
+    }
+
+    MipMapImageId(const std::string & clip_,
+                  double time_,
+                  int view_ = 0,
+                  const std::string & plane_ = std::string())
+        : clip(clip_)
+        , time(time_)
+        , view(view_)
+        , plane(plane_)
+    {
+    }
+};
+
+/**
+   @brief A mipmap level held by a MipMapCache.
+   Its pixels stay valid until it is released.
+ **/
+struct CachedMipMap
+{
+    const void* pixelData;
+    OfxRectI bounds;
+    int rowBytes;
+    unsigned int level;
+};
+
+/**
+   @brief A thread-safe cache of mipmap levels, with LRU eviction under a byte budget.
+   Levels are keyed by the identity of the source image, its bounds and pixel format,
+   the render window at level 0, and the level. A level that is not cached is built
+   from the deepest cached level above it, or from the source image, and all the levels
+   built on the way are cached too.
+   The levels are not allocated on behalf of an image effect instance, so the cache may
+   outlive the instances that use it (e.g. it may be owned by the plugin factory).
+   All the acquired levels must be released before the cache is destroyed: the levels
+   which are still acquired are leaked.
+ **/
+struct MipMapCachePrivate;
+class MipMapCache
+{
+    auto_ptr<MipMapCachePrivate> _imp;
+
+public:
+    explicit MipMapCache(std::size_t maxBytes);
+
+    ~MipMapCache();
+
+    /// the byte budget: levels that are not acquired are evicted when the cache is larger
+    void setMaxBytes(std::size_t maxBytes);
+    std::size_t getMaxBytes() const;
+
+    /// the number of bytes currently held, including the acquired levels
+    std::size_t getBytes() const;
+
+    /**
+       @brief Return the given level of the pyramid of the source image, building it if it is not cached.
+       The level is never evicted before it is released with releaseLevel.
+       srcPixelData may be NULL if the level or one of the levels above it is known to be cached,
+       else an exception is thrown.
+       The image may be 8-bit, 16-bit, half or float, with 1, 3 or 4 components.
+     **/
+    const CachedMipMap* acquireLevel(const MipMapImageId & id,
+                                     const OfxRectI & renderWindow,
+                                     const void* srcPixelData,
+                                     OFX::PixelComponentEnum srcPixelComponents,
+                                     OFX::BitDepthEnum srcPixelDepth,
+                                     const OfxRectI & srcBounds,
+                                     int srcRowBytes,
+                                     unsigned int level);
+
+    /// release a level returned by acquireLevel
+    void releaseLevel(const CachedMipMap* mipmap);
+
+    /// evict all the levels that are not acquired
+    void clear();
+
+private:
+    MipMapCache(const MipMapCache &);
+    MipMapCache & operator=(const MipMapCache &);
+};
 } // OFX
 
 #endif // ifndef openfx_supportext_ofxsMipmap_h
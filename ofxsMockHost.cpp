@@ -0,0 +1,924 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/NatronGitHub/openfx-supportext>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * A minimal in-process OFX host, to run the supportext processors without a host application.
+ */
+
+#include "ofxsMockHost.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+#include "ofxMemory.h"
+#include "ofxMultiThread.h"
+#include "ofxProperty.h"
+#include "ofxsMultiThread.h"
+#include "ofxsThreadSuite.h"
+
+namespace OFX {
+namespace Private {
+extern OfxHost *gHost;
+extern OfxImageEffectSuiteV1 *gEffectSuite;
+extern OfxPropertySuiteV1 *gPropSuite;
+extern OfxMemorySuiteV1 *gMemorySuite;
+extern OfxMultiThreadSuiteV1 *gThreadSuite;
+extern OfxMultiThreadSuiteV1 *gPluginThreadSuite;
+}
+
+namespace MockHost {
+namespace {
+enum PropertyTypeEnum
+{
+    ePropertyTypePointer = 0,
+    ePropertyTypeString,
+    ePropertyTypeDouble,
+    ePropertyTypeInt
+};
+
+struct Property
+{
+    PropertyTypeEnum type;
+    std::vector<void*> pointers;
+    std::vector<std::string> strings;
+    std::vector<double> doubles;
+    std::vector<int> ints;
+
+    Property()
+        : type(ePropertyTypePointer)
+    {
+    }
+};
+
+// a property set. Properties are created on first set, and reading an unset property fails with kOfxStatErrUnknown.
+struct PropertySet
+{
+    std::map<std::string, Property> props;
+    void* data; // pixel memory owned by an image, released by clipReleaseImage()
+
+    PropertySet()
+        : props()
+        , data(NULL)
+    {
+    }
+
+    ~PropertySet()
+    {
+        std::free(data);
+    }
+};
+
+struct EffectInstance
+{
+    PropertySet props;
+    PropertySet paramSetProps; // the param set is empty
+};
+
+unsigned int gMaxThreads = 0;
+OfxMultiThreadSuiteV1 gMockThreadSuite;
+OfxPropertySuiteV1 gMockPropSuite;
+OfxImageEffectSuiteV1 gMockEffectSuite;
+OfxMemorySuiteV1 gMockMemorySuite;
+OfxHost gMockHost;
+PropertySet gHostProps;
+
+inline PropertySet*
+propertySet(OfxPropertySetHandle h)
+{
+    return reinterpret_cast<PropertySet*>(h);
+}
+
+inline OfxPropertySetHandle
+propertySetHandle(PropertySet* p)
+{
+    return reinterpret_cast<OfxPropertySetHandle>(p);
+}
+
+// get the property to write, and give it the right type
+Property*
+propertyForWrite(OfxPropertySetHandle h,
+                 const char* name,
+                 PropertyTypeEnum type)
+{
+    if (!h || !name) {
+        return NULL;
+    }
+    Property& p = propertySet(h)->props[name];
+    if (p.type != type) {
+        p = Property();
+        p.type = type;
+    }
+
+    return &p;
+}
+
+// get the property to read, and check its type
+OfxStatus
+propertyForRead(OfxPropertySetHandle h,
+                const char* name,
+                PropertyTypeEnum type,
+                const Property** prop)
+{
+    *prop = NULL;
+    if (!h || !name) {
+        return kOfxStatErrBadHandle;
+    }
+    const PropertySet* ps = propertySet(h);
+    std::map<std::string, Property>::const_iterator it = ps->props.find(name);
+    if ( it == ps->props.end() ) {
+        return kOfxStatErrUnknown;
+    }
+    if (it->second.type != type) {
+        return kOfxStatErrValue;
+    }
+    *prop = &it->second;
+
+    return kOfxStatOK;
+}
+
+template <class T>
+OfxStatus
+setValue(std::vector<T>& values,
+         int index,
+         const T& value)
+{
+    if (index < 0) {
+        return kOfxStatErrBadIndex;
+    }
+    if ( (size_t)index >= values.size() ) {
+        values.resize(index + 1);
+    }
+    values[index] = value;
+
+    return kOfxStatOK;
+}
+
+template <class T>
+OfxStatus
+getValue(const std::vector<T>& values,
+         int index,
+         T* value)
+{
+    if ( (index < 0) || ( (size_t)index >= values.size() ) ) {
+        return kOfxStatErrBadIndex;
+    }
+    *value = values[index];
+
+    return kOfxStatOK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// property suite
+
+OfxStatus
+propSetPointer(OfxPropertySetHandle properties,
+               const char *property,
+               int index,
+               void *value)
+{
+    Property* p = propertyForWrite(properties, property, ePropertyTypePointer);
+
+    return p ? setValue(p->pointers, index, value) : kOfxStatErrBadHandle;
+}
+
+OfxStatus
+propSetString(OfxPropertySetHandle properties,
+              const char *property,
+              int index,
+              const char *value)
+{
+    Property* p = propertyForWrite(properties, property, ePropertyTypeString);
+
+    return p ? setValue( p->strings, index, std::string(value ? value : "") ) : kOfxStatErrBadHandle;
+}
+
+OfxStatus
+propSetDouble(OfxPropertySetHandle properties,
+              const char *property,
+              int index,
+              double value)
+{
+    Property* p = propertyForWrite(properties, property, ePropertyTypeDouble);
+
+    return p ? setValue(p->doubles, index, value) : kOfxStatErrBadHandle;
+}
+
+OfxStatus
+propSetInt(OfxPropertySetHandle properties,
+           const char *property,
+           int index,
+           int value)
+{
+    Property* p = propertyForWrite(properties, property, ePropertyTypeInt);
+
+    return p ? setValue(p->ints, index, value) : kOfxStatErrBadHandle;
+}
+
+OfxStatus
+propSetPointerN(OfxPropertySetHandle properties,
+                const char *property,
+                int count,
+                void *const*value)
+{
+    for (int i = 0; i < count; ++i) {
+        OfxStatus stat = propSetPointer(properties, property, i, value[i]);
+        if (stat != kOfxStatOK) {
+            return stat;
+        }
+    }
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propSetStringN(OfxPropertySetHandle properties,
+               const char *property,
+               int count,
+               const char *const*value)
+{
+    for (int i = 0; i < count; ++i) {
+        OfxStatus stat = propSetString(properties, property, i, value[i]);
+        if (stat != kOfxStatOK) {
+            return stat;
+        }
+    }
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propSetDoubleN(OfxPropertySetHandle properties,
+               const char *property,
+               int count,
+               const double *value)
+{
+    for (int i = 0; i < count; ++i) {
+        OfxStatus stat = propSetDouble(properties, property, i, value[i]);
+        if (stat != kOfxStatOK) {
+            return stat;
+        }
+    }
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propSetIntN(OfxPropertySetHandle properties,
+            const char *property,
+            int count,
+            const int *value)
+{
+    for (int i = 0; i < count; ++i) {
+        OfxStatus stat = propSetInt(properties, property, i, value[i]);
+        if (stat != kOfxStatOK) {
+            return stat;
+        }
+    }
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propGetPointer(OfxPropertySetHandle properties,
+               const char *property,
+               int index,
+               void **value)
+{
+    const Property* p;
+    OfxStatus stat = propertyForRead(properties, property, ePropertyTypePointer, &p);
+
+    return (stat == kOfxStatOK) ? getValue(p->pointers, index, value) : stat;
+}
+
+OfxStatus
+propGetString(OfxPropertySetHandle properties,
+              const char *property,
+              int index,
+              char **value)
+{
+    const Property* p;
+    OfxStatus stat = propertyForRead(properties, property, ePropertyTypeString, &p);
+
+    if (stat != kOfxStatOK) {
+        return stat;
+    }
+    if ( (index < 0) || ( (size_t)index >= p->strings.size() ) ) {
+        return kOfxStatErrBadIndex;
+    }
+    // the string is owned by the property set, as in a real host
+    *value = const_cast<char*>( p->strings[index].c_str() );
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propGetDouble(OfxPropertySetHandle properties,
+              const char *property,
+              int index,
+              double *value)
+{
+    const Property* p;
+    OfxStatus stat = propertyForRead(properties, property, ePropertyTypeDouble, &p);
+
+    return (stat == kOfxStatOK) ? getValue(p->doubles, index, value) : stat;
+}
+
+OfxStatus
+propGetInt(OfxPropertySetHandle properties,
+           const char *property,
+           int index,
+           int *value)
+{
+    const Property* p;
+    OfxStatus stat = propertyForRead(properties, property, ePropertyTypeInt, &p);
+
+    return (stat == kOfxStatOK) ? getValue(p->ints, index, value) : stat;
+}
+
+OfxStatus
+propGetPointerN(OfxPropertySetHandle properties,
+                const char *property,
+                int count,
+                void **value)
+{
+    for (int i = 0; i < count; ++i) {
+        OfxStatus stat = propGetPointer(properties, property, i, &value[i]);
+        if (stat != kOfxStatOK) {
+            return stat;
+        }
+    }
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propGetStringN(OfxPropertySetHandle properties,
+               const char *property,
+               int count,
+               char **value)
+{
+    for (int i = 0; i < count; ++i) {
+        OfxStatus stat = propGetString(properties, property, i, &value[i]);
+        if (stat != kOfxStatOK) {
+            return stat;
+        }
+    }
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propGetDoubleN(OfxPropertySetHandle properties,
+               const char *property,
+               int count,
+               double *value)
+{
+    for (int i = 0; i < count; ++i) {
+        OfxStatus stat = propGetDouble(properties, property, i, &value[i]);
+        if (stat != kOfxStatOK) {
+            return stat;
+        }
+    }
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propGetIntN(OfxPropertySetHandle properties,
+            const char *property,
+            int count,
+            int *value)
+{
+    for (int i = 0; i < count; ++i) {
+        OfxStatus stat = propGetInt(properties, property, i, &value[i]);
+        if (stat != kOfxStatOK) {
+            return stat;
+        }
+    }
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propReset(OfxPropertySetHandle properties,
+          const char *property)
+{
+    if (!properties || !property) {
+        return kOfxStatErrBadHandle;
+    }
+    std::map<std::string, Property>& props = propertySet(properties)->props;
+    std::map<std::string, Property>::iterator it = props.find(property);
+    if ( it == props.end() ) {
+        return kOfxStatErrUnknown;
+    }
+    PropertyTypeEnum type = it->second.type;
+    it->second = Property();
+    it->second.type = type;
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propGetDimension(OfxPropertySetHandle properties,
+                 const char *property,
+                 int *count)
+{
+    if (!properties || !property) {
+        return kOfxStatErrBadHandle;
+    }
+    const std::map<std::string, Property>& props = propertySet(properties)->props;
+    std::map<std::string, Property>::const_iterator it = props.find(property);
+    if ( it == props.end() ) {
+        return kOfxStatErrUnknown;
+    }
+    const Property& p = it->second;
+    switch (p.type) {
+    case ePropertyTypePointer:
+        *count = (int)p.pointers.size();
+        break;
+    case ePropertyTypeString:
+        *count = (int)p.strings.size();
+        break;
+    case ePropertyTypeDouble:
+        *count = (int)p.doubles.size();
+        break;
+    case ePropertyTypeInt:
+        *count = (int)p.ints.size();
+        break;
+    }
+
+    return kOfxStatOK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// image effect suite
+
+OfxStatus
+getPropertySet(OfxImageEffectHandle imageEffect,
+               OfxPropertySetHandle *propHandle)
+{
+    if (!imageEffect) {
+        return kOfxStatErrBadHandle;
+    }
+    *propHandle = propertySetHandle( &reinterpret_cast<EffectInstance*>(imageEffect)->props );
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+getParamSet(OfxImageEffectHandle imageEffect,
+            OfxParamSetHandle *paramSet)
+{
+    if (!imageEffect) {
+        return kOfxStatErrBadHandle;
+    }
+    *paramSet = reinterpret_cast<OfxParamSetHandle>( &reinterpret_cast<EffectInstance*>(imageEffect)->paramSetProps );
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+clipDefine(OfxImageEffectHandle /*imageEffect*/,
+           const char * /*name*/,
+           OfxPropertySetHandle * /*propertySet*/)
+{
+    return kOfxStatErrUnsupported;
+}
+
+OfxStatus
+clipGetHandle(OfxImageEffectHandle /*imageEffect*/,
+              const char * /*name*/,
+              OfxImageClipHandle * /*clip*/,
+              OfxPropertySetHandle * /*propertySet*/)
+{
+    // the mock effect has no clips: images are created with createImage()
+    return kOfxStatErrUnknown;
+}
+
+OfxStatus
+clipGetPropertySet(OfxImageClipHandle /*clip*/,
+                   OfxPropertySetHandle * /*propHandle*/)
+{
+    return kOfxStatErrBadHandle;
+}
+
+OfxStatus
+clipGetImage(OfxImageClipHandle /*clip*/,
+             OfxTime /*time*/,
+             const OfxRectD * /*region*/,
+             OfxPropertySetHandle * /*imageHandle*/)
+{
+    return kOfxStatErrBadHandle;
+}
+
+OfxStatus
+clipReleaseImage(OfxPropertySetHandle imageHandle)
+{
+    if (!imageHandle) {
+        return kOfxStatErrBadHandle;
+    }
+    delete propertySet(imageHandle);
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+clipGetRegionOfDefinition(OfxImageClipHandle /*clip*/,
+                          OfxTime /*time*/,
+                          OfxRectD * /*bounds*/)
+{
+    return kOfxStatErrBadHandle;
+}
+
+int
+effectAbort(OfxImageEffectHandle /*imageEffect*/)
+{
+    return 0;
+}
+
+// image memory is a header followed by the data.
+// The header size keeps the data aligned for SIMD code.
+struct ImageMemoryHeader
+{
+    size_t nBytes;
+    int lockCount;
+};
+
+const size_t kImageMemoryHeaderSize = 64;
+
+OfxStatus
+imageMemoryAlloc(OfxImageEffectHandle /*instanceHandle*/,
+                 size_t nBytes,
+                 OfxImageMemoryHandle *memoryHandle)
+{
+    void* mem = std::malloc(kImageMemoryHeaderSize + nBytes);
+
+    if (!mem) {
+        *memoryHandle = NULL;
+
+        return kOfxStatErrMemory;
+    }
+    ImageMemoryHeader* header = (ImageMemoryHeader*)mem;
+    header->nBytes = nBytes;
+    header->lockCount = 0;
+    *memoryHandle = reinterpret_cast<OfxImageMemoryHandle>(mem);
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+imageMemoryFree(OfxImageMemoryHandle memoryHandle)
+{
+    if (!memoryHandle) {
+        return kOfxStatErrBadHandle;
+    }
+    std::free(memoryHandle);
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+imageMemoryLock(OfxImageMemoryHandle memoryHandle,
+                void **returnedPtr)
+{
+    if (!memoryHandle) {
+        return kOfxStatErrBadHandle;
+    }
+    ImageMemoryHeader* header = reinterpret_cast<ImageMemoryHeader*>(memoryHandle);
+    ++header->lockCount;
+    *returnedPtr = (char*)memoryHandle + kImageMemoryHeaderSize;
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+imageMemoryUnlock(OfxImageMemoryHandle memoryHandle)
+{
+    if (!memoryHandle) {
+        return kOfxStatErrBadHandle;
+    }
+    ImageMemoryHeader* header = reinterpret_cast<ImageMemoryHeader*>(memoryHandle);
+    if (header->lockCount > 0) {
+        --header->lockCount;
+    }
+
+    return kOfxStatOK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// memory suite
+
+OfxStatus
+memoryAlloc(void * /*handle*/,
+            size_t nBytes,
+            void **allocatedData)
+{
+    *allocatedData = std::malloc(nBytes);
+
+    return *allocatedData ? kOfxStatOK : kOfxStatErrMemory;
+}
+
+OfxStatus
+memoryFree(void *allocatedData)
+{
+    std::free(allocatedData);
+
+    return kOfxStatOK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// multithread suite: the plugin-side suite, with a limit on the number of CPUs
+
+OfxStatus
+multiThreadNumCPUs(unsigned int *nCPUs)
+{
+    OfxStatus stat = Private::gPluginThreadSuite->multiThreadNumCPUs(nCPUs);
+
+    if ( (stat == kOfxStatOK) && (gMaxThreads > 0) && (*nCPUs > gMaxThreads) ) {
+        *nCPUs = gMaxThreads;
+    }
+
+    return stat;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// host
+
+const void*
+fetchSuite(OfxPropertySetHandle /*host*/,
+           const char *suiteName,
+           int suiteVersion)
+{
+    if (suiteVersion != 1) {
+        return NULL;
+    }
+    if (std::strcmp(suiteName, kOfxPropertySuite) == 0) {
+        return &gMockPropSuite;
+    } else if (std::strcmp(suiteName, kOfxImageEffectSuite) == 0) {
+        return &gMockEffectSuite;
+    } else if (std::strcmp(suiteName, kOfxMemorySuite) == 0) {
+        return &gMockMemorySuite;
+    } else if (std::strcmp(suiteName, kOfxMultiThreadSuite) == 0) {
+        return &gMockThreadSuite;
+    }
+
+    return NULL;
+}
+
+// The effect created by createEffect()
+class MockEffect
+    : public OFX::ImageEffect
+{
+public:
+    MockEffect(OfxImageEffectHandle handle)
+        : OFX::ImageEffect(handle)
+    {
+    }
+
+    virtual void render(const OFX::RenderArguments & /*args*/)
+    {
+    }
+};
+
+const char*
+mapPixelComponentEnumToStr(OFX::PixelComponentEnum e)
+{
+    switch (e) {
+    case OFX::ePixelComponentRGBA:
+
+        return kOfxImageComponentRGBA;
+    case OFX::ePixelComponentRGB:
+
+        return kOfxImageComponentRGB;
+    case OFX::ePixelComponentAlpha:
+
+        return kOfxImageComponentAlpha;
+    default:
+        break;
+    }
+    throwSuiteStatusException(kOfxStatErrFormat);
+
+    return NULL;
+}
+
+const char*
+mapBitDepthEnumToStr(OFX::BitDepthEnum e)
+{
+    switch (e) {
+    case OFX::eBitDepthUByte:
+
+        return kOfxBitDepthByte;
+    case OFX::eBitDepthUShort:
+
+        return kOfxBitDepthShort;
+    case OFX::eBitDepthHalf:
+
+        return kOfxBitDepthHalf;
+    case OFX::eBitDepthFloat:
+
+        return kOfxBitDepthFloat;
+    default:
+        break;
+    }
+    throwSuiteStatusException(kOfxStatErrFormat);
+
+    return NULL;
+}
+
+const char*
+mapPreMultiplicationEnumToStr(OFX::PreMultiplicationEnum e)
+{
+    switch (e) {
+    case OFX::eImageOpaque:
+
+        return kOfxImageOpaque;
+    case OFX::eImagePreMultiplied:
+
+        return kOfxImagePreMultiplied;
+    case OFX::eImageUnPreMultiplied:
+
+        return kOfxImageUnPreMultiplied;
+    }
+
+    return kOfxImagePreMultiplied;
+}
+} // anonymous namespace
+
+void
+install()
+{
+    gMockPropSuite.propSetPointer = propSetPointer;
+    gMockPropSuite.propSetString = propSetString;
+    gMockPropSuite.propSetDouble = propSetDouble;
+    gMockPropSuite.propSetInt = propSetInt;
+    gMockPropSuite.propSetPointerN = propSetPointerN;
+    gMockPropSuite.propSetStringN = propSetStringN;
+    gMockPropSuite.propSetDoubleN = propSetDoubleN;
+    gMockPropSuite.propSetIntN = propSetIntN;
+    gMockPropSuite.propGetPointer = propGetPointer;
+    gMockPropSuite.propGetString = propGetString;
+    gMockPropSuite.propGetDouble = propGetDouble;
+    gMockPropSuite.propGetInt = propGetInt;
+    gMockPropSuite.propGetPointerN = propGetPointerN;
+    gMockPropSuite.propGetStringN = propGetStringN;
+    gMockPropSuite.propGetDoubleN = propGetDoubleN;
+    gMockPropSuite.propGetIntN = propGetIntN;
+    gMockPropSuite.propReset = propReset;
+    gMockPropSuite.propGetDimension = propGetDimension;
+
+    gMockEffectSuite.getPropertySet = getPropertySet;
+    gMockEffectSuite.getParamSet = getParamSet;
+    gMockEffectSuite.clipDefine = clipDefine;
+    gMockEffectSuite.clipGetHandle = clipGetHandle;
+    gMockEffectSuite.clipGetPropertySet = clipGetPropertySet;
+    gMockEffectSuite.clipGetImage = clipGetImage;
+    gMockEffectSuite.clipReleaseImage = clipReleaseImage;
+    gMockEffectSuite.clipGetRegionOfDefinition = clipGetRegionOfDefinition;
+    gMockEffectSuite.abort = effectAbort;
+    gMockEffectSuite.imageMemoryAlloc = imageMemoryAlloc;
+    gMockEffectSuite.imageMemoryFree = imageMemoryFree;
+    gMockEffectSuite.imageMemoryLock = imageMemoryLock;
+    gMockEffectSuite.imageMemoryUnlock = imageMemoryUnlock;
+
+    gMockMemorySuite.memoryAlloc = memoryAlloc;
+    gMockMemorySuite.memoryFree = memoryFree;
+
+    gMockThreadSuite = *Private::gPluginThreadSuite;
+    gMockThreadSuite.multiThreadNumCPUs = multiThreadNumCPUs;
+
+    propSetString(propertySetHandle(&gHostProps), kOfxPropName, 0, "org.openfx.supportext.MockHost");
+    propSetString(propertySetHandle(&gHostProps), kOfxPropLabel, 0, "MockHost");
+    gMockHost.host = propertySetHandle(&gHostProps);
+    gMockHost.fetchSuite = fetchSuite;
+
+    Private::gHost = &gMockHost;
+    Private::gPropSuite = &gMockPropSuite;
+    Private::gEffectSuite = &gMockEffectSuite;
+    Private::gMemorySuite = &gMockMemorySuite;
+    Private::gThreadSuite = &gMockThreadSuite;
+}
+
+void
+setMaxThreads(unsigned int maxThreads)
+{
+    gMaxThreads = maxThreads;
+}
+
+unsigned int
+getNumCPUs()
+{
+    unsigned int n = 1;
+
+    if (Private::gPluginThreadSuite->multiThreadNumCPUs(&n) != kOfxStatOK) {
+        return 1;
+    }
+
+    return n;
+}
+
+OFX::ImageEffect*
+createEffect()
+{
+    EffectInstance* instance = new EffectInstance;
+    OfxPropertySetHandle props = propertySetHandle(&instance->props);
+
+    propSetString(props, kOfxPropType, 0, kOfxTypeImageEffectInstance);
+    propSetString(props, kOfxImageEffectPropContext, 0, kOfxImageEffectContextFilter);
+    propSetInt(props, kOfxPropIsInteractive, 0, 0);
+    propSetDouble(props, kOfxImageEffectPropProjectSize, 0, 1920.);
+    propSetDouble(props, kOfxImageEffectPropProjectSize, 1, 1080.);
+    propSetDouble(props, kOfxImageEffectPropProjectOffset, 0, 0.);
+    propSetDouble(props, kOfxImageEffectPropProjectOffset, 1, 0.);
+    propSetDouble(props, kOfxImageEffectPropProjectExtent, 0, 1920.);
+    propSetDouble(props, kOfxImageEffectPropProjectExtent, 1, 1080.);
+    propSetDouble(props, kOfxImageEffectPropProjectPixelAspectRatio, 0, 1.);
+    propSetDouble(props, kOfxImageEffectInstancePropEffectDuration, 0, 1.);
+    propSetDouble(props, kOfxImageEffectPropFrameRate, 0, 24.);
+    try {
+        return new MockEffect( reinterpret_cast<OfxImageEffectHandle>(instance) );
+    } catch (...) {
+        delete instance;
+        throw;
+    }
+}
+
+void
+destroyEffect(OFX::ImageEffect* effect)
+{
+    if (!effect) {
+        return;
+    }
+    EffectInstance* instance = reinterpret_cast<EffectInstance*>( effect->getHandle() );
+    delete effect;
+    delete instance;
+}
+
+OFX::Image*
+createImage(const OfxRectI & bounds,
+            OFX::PixelComponentEnum pixelComponents,
+            OFX::BitDepthEnum bitDepth,
+            OFX::PreMultiplicationEnum premult)
+{
+    const char* components = mapPixelComponentEnumToStr(pixelComponents);
+    const char* depth = mapBitDepthEnumToStr(bitDepth);
+    const int nComps = (pixelComponents == OFX::ePixelComponentRGBA) ? 4 : (pixelComponents == OFX::ePixelComponentRGB) ? 3 : 1;
+    const int compBytes = (bitDepth == OFX::eBitDepthUByte) ? 1 : (bitDepth == OFX::eBitDepthFloat) ? 4 : 2;
+    const int width = (std::max)(bounds.x2 - bounds.x1, 0);
+    const int height = (std::max)(bounds.y2 - bounds.y1, 0);
+    const int rowBytes = width * nComps * compBytes;
+    PropertySet* ps = new PropertySet;
+
+    ps->data = std::malloc( (size_t)rowBytes * height + 1 );
+    if (!ps->data) {
+        delete ps;
+        throw std::bad_alloc();
+    }
+    OfxPropertySetHandle props = propertySetHandle(ps);
+    const int boundsValues[4] = { bounds.x1, bounds.y1, bounds.x2, bounds.y2 };
+    const double renderScale[2] = { 1., 1. };
+    propSetString(props, kOfxPropType, 0, kOfxTypeImage);
+    propSetPointer(props, kOfxImagePropData, 0, ps->data);
+    propSetIntN(props, kOfxImagePropBounds, 4, boundsValues);
+    propSetIntN(props, kOfxImagePropRegionOfDefinition, 4, boundsValues);
+    propSetInt(props, kOfxImagePropRowBytes, 0, rowBytes);
+    propSetString(props, kOfxImageEffectPropComponents, 0, components);
+    propSetString(props, kOfxImageEffectPropPixelDepth, 0, depth);
+    propSetString(props, kOfxImageEffectPropPreMultiplication, 0, mapPreMultiplicationEnumToStr(premult));
+    propSetDoubleN(props, kOfxImageEffectPropRenderScale, 2, renderScale);
+    propSetDouble(props, kOfxImagePropPixelAspectRatio, 0, 1.);
+    propSetString(props, kOfxImagePropField, 0, kOfxImageFieldNone);
+    propSetString(props, kOfxImagePropUniqueIdentifier, 0, "");
+    try {
+        // the image releases its property set (and thus its memory) with clipReleaseImage()
+        return new OFX::Image(props);
+    } catch (...) {
+        delete ps;
+        throw;
+    }
+}
+} // namespace MockHost
+} // namespace OFX
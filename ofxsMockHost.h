@@ -0,0 +1,60 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/NatronGitHub/openfx-supportext>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * A minimal in-process OFX host, to run the supportext processors without a host application
+ * (e.g. for benchmarks).
+ * It implements the property, image effect and memory suites, and uses the plugin-side
+ * multithread suite of ofxsThreadSuite.cpp.
+ */
+
+#ifndef openfx_supportext_ofxsMockHost_h
+#define openfx_supportext_ofxsMockHost_h
+
+#include "ofxsImageEffect.h"
+
+namespace OFX {
+namespace MockHost {
+// Install the mock suites in the Support library.
+// Call it once, before creating any effect or image. The plugin must not be loaded by a real host.
+void install();
+
+// Limit the number of threads reported by OFX::MultiThread::getNumCPUs() (0 means no limit).
+void setMaxThreads(unsigned int maxThreads);
+
+// the number of CPUs of the plugin-side multithread suite, regardless of setMaxThreads()
+unsigned int getNumCPUs();
+
+// Create an effect instance (in the filter context), which does nothing when rendered.
+// It can be passed to any OFX::PixelProcessor or OFX::ImageProcessor.
+OFX::ImageEffect* createEffect();
+
+// Destroy an effect created by createEffect().
+void destroyEffect(OFX::ImageEffect* effect);
+
+// Create an image with uninitialized pixels. Deleting the image releases its memory.
+OFX::Image* createImage(const OfxRectI & bounds,
+                        OFX::PixelComponentEnum pixelComponents,
+                        OFX::BitDepthEnum bitDepth,
+                        OFX::PreMultiplicationEnum premult = OFX::eImagePreMultiplied);
+} // namespace MockHost
+} // namespace OFX
+
+#endif // openfx_supportext_ofxsMockHost_h
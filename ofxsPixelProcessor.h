@@ -27,11 +27,24 @@
  */
 
 #include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
 #include <algorithm>
+#include <new>
+#include <typeinfo>
+#include <vector>
+#if __cplusplus > 199711L           // C++11
+#include <atomic>
+#else
+// use TinyThread 1.2 for portable C++11-like atomics and thread_local
+#include "tinythread.h"
+#endif
 
 #include "ofxsImageEffect.h"
 #include "ofxsMultiThread.h"
 #include "ofxsThreadSuite.h"
+#include "ofxsPixelProcessorStats.h"
 
 /** @file This file contains a useful base class that can be used to process images
 
@@ -165,6 +178,546 @@ getPixelAddress(const void* pixelData,
     return (void *) pix;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// direct access to the pixels of one row of an image
+//
+// A PixelRowSpan holds the address of row y of an image, the range [x1,x2) of valid pixels in that row,
+// and the boundary condition which gives the pixels outside of that range (and outside of the image rows):
+// 0 = black and transparent (Dirichlet), 1 = nearest valid pixel (Neumann), 2 = periodic, as in PixelProcessorFilterBase.
+// getSegment() splits the row into segments over which the pixel address is affine in x, so that inner loops
+// are pointer walks, with no per-pixel bounds checks:
+//
+//     PixelRowSpan<float> srcRow(srcImg, y, boundary);
+//     for (int x = procWindow.x1; x < procWindow.x2; ) {
+//         const float* srcPix;
+//         int srcStride;
+//         const int xEnd = srcRow.getSegment(x, procWindow.x2, &srcPix, &srcStride);
+//         for (; x < xEnd; ++x, srcPix += srcStride) {
+//             ... // srcPix is NULL (and srcStride is 0) if the segment is black and transparent
+//         }
+//     }
+template <class PIX>
+class PixelRowSpan
+{
+    const PIX* _row; // address of the pixel at _x1, or NULL if the whole row is black and transparent
+    int _x1;
+    int _x2;
+    int _stride; // number of PIX per pixel
+    int _boundary;
+
+public:
+    PixelRowSpan()
+        : _row(NULL)
+        , _x1(0)
+        , _x2(0)
+        , _stride(0)
+        , _boundary(0)
+    {
+    }
+
+    PixelRowSpan(const void* pixelData,
+                 const OfxRectI& bounds,
+                 int pixelBytes,
+                 int rowBytes,
+                 int y,
+                 int boundary = 0) //!< The border condition type { 0=zero |  1=dirichlet | 2=periodic }.
+        : _row(NULL)
+        , _x1(0)
+        , _x2(0)
+        , _stride(0)
+        , _boundary(0)
+    {
+        init(pixelData, bounds, pixelBytes, rowBytes, y, boundary);
+    }
+
+    // img may be NULL, in which case the row is black and transparent
+    PixelRowSpan(const OFX::Image* img,
+                 int y,
+                 int boundary = 0) //!< The border condition type { 0=zero |  1=dirichlet | 2=periodic }.
+        : _row(NULL)
+        , _x1(0)
+        , _x2(0)
+        , _stride(0)
+        , _boundary(0)
+    {
+        if (img) {
+            init(img->getPixelData(), img->getBounds(), img->getPixelBytes(), img->getRowBytes(), y, boundary);
+        }
+    }
+
+    void init(const void* pixelData,
+              const OfxRectI& bounds,
+              int pixelBytes,
+              int rowBytes,
+              int y,
+              int boundary)
+    {
+        _row = NULL;
+        _x1 = bounds.x1;
+        _x2 = bounds.x2;
+        _stride = pixelBytes / (int)sizeof(PIX);
+        _boundary = boundary;
+        if ( !pixelData || (_stride == 0) || (bounds.x2 <= bounds.x1) || (bounds.y2 <= bounds.y1) ) {
+            return;
+        }
+        if ( (y < bounds.y1) || (bounds.y2 <= y) ) {
+            if (boundary == 1) {
+                // Nearest/Neumann
+                y = (y < bounds.y1) ? bounds.y1 : (bounds.y2 - 1);
+            } else if (boundary == 2) {
+                // Repeat/Periodic
+                y = bounds.y1 + positiveModulo(y - bounds.y1, bounds.y2 - bounds.y1);
+            } else {
+                // Black/Dirichlet
+                return;
+            }
+        }
+        _row = (const PIX*)( (const char*)pixelData + (std::ptrdiff_t)(y - bounds.y1) * rowBytes );
+    }
+
+    /** @brief true if the whole row is black and transparent */
+    bool isBlack() const
+    {
+        return !_row;
+    }
+
+    /** @brief the range of valid pixels in the row */
+    int x1() const
+    {
+        return _x1;
+    }
+
+    int x2() const
+    {
+        return _x2;
+    }
+
+    /** @brief get the segment [x,xEnd') of [x,xEnd) over which the pixel at x+i is at pix + i * stride, and return xEnd'.
+        pix is NULL (and stride is 0) if the segment is black and transparent. */
+    int getSegment(int x,
+                   int xEnd,
+                   const PIX** pix,
+                   int* stride) const
+    {
+        assert(x < xEnd);
+        if (!_row) {
+            *pix = NULL;
+            *stride = 0;
+
+            return xEnd;
+        }
+        if ( (_x1 <= x) && (x < _x2) ) {
+            *pix = _row + (std::ptrdiff_t)(x - _x1) * _stride;
+            *stride = _stride;
+
+            return (std::min)(xEnd, _x2);
+        }
+        if (_boundary == 2) {
+            // Repeat/Periodic: contiguous until the end of the current period
+            int srcx = _x1 + positiveModulo(x - _x1, _x2 - _x1);
+            *pix = _row + (std::ptrdiff_t)(srcx - _x1) * _stride;
+            *stride = _stride;
+
+            return (std::min)(xEnd, x + (_x2 - srcx));
+        }
+        *stride = 0;
+        if (x < _x1) {
+            // Nearest/Neumann repeats the first pixel, else black
+            *pix = (_boundary == 1) ? _row : NULL;
+
+            return (std::min)(xEnd, _x1);
+        }
+        // Nearest/Neumann repeats the last pixel, else black
+        *pix = (_boundary == 1) ? ( _row + (std::ptrdiff_t)(_x2 - 1 - _x1) * _stride ) : NULL;
+
+        return xEnd;
+    }
+
+    /** @brief the address of pixel x, or NULL if it is black and transparent */
+    const PIX* getPixelAddress(int x) const
+    {
+        const PIX* pix;
+        int stride;
+
+        getSegment(x, x + 1, &pix, &stride);
+
+        return pix;
+    }
+
+private:
+    static int positiveModulo(int i,
+                              int n)
+    {
+        return (i % n + n) % n;
+    }
+};
+
+#if __cplusplus > 199711L           // C++11
+typedef std::atomic<int> PixelProcessorAtomicInt;
+#else
+typedef tthread::atomic<int> PixelProcessorAtomicInt;
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// distribution of the render window over the processing threads
+//
+// By default, the render window is split into horizontal bands of equal height, one per thread.
+// If a tile size is set, the render window is split into tiles, which are handed to the threads
+// through an atomic counter as soon as they are free: this gives better cache locality for kernels
+// that read the source around each destination pixel (e.g. rotations), and a better load balance
+// when the render window is tall and thin.
+// With work stealing, the render window is split into chunks of rows, and each thread gets a
+// queue holding a contiguous range of chunks. A thread takes chunks from the front of its own
+// queue, and when it is empty it steals chunks from the back of the other queues: this balances
+// processors whose per-pixel cost varies a lot over the image (e.g. adaptive motion blur).
+enum PixelProcessorSchedulingEnum
+{
+    ePixelProcessorSchedulingRows = 0, // one band of rows per thread (default)
+    ePixelProcessorSchedulingTiles,    // tiles handed to the threads through an atomic counter
+    ePixelProcessorSchedulingWorkStealing // per-thread queues of row chunks, with stealing
+};
+
+class PixelProcessorScheduler
+{
+    // the queue of row chunks of a thread, used for work stealing.
+    // Chunks are numbered, and the queue holds the chunks [begin,end).
+    struct ChunkQueue
+    {
+        MultiThread::Mutex lock;
+        int begin;
+        int end;
+
+        ChunkQueue()
+            : lock()
+            , begin(0)
+            , end(0)
+        {
+        }
+    };
+
+    PixelProcessorSchedulingEnum _scheduling; // the mode chosen with setTileSize() or setWorkStealing()
+    PixelProcessorSchedulingEnum _windowScheduling; // the mode used for the current window, see prepare()
+    OfxRectI _window;
+    int _tileWidth;
+    int _tileHeight;
+    int _nTilesX;
+    int _nTiles;
+    PixelProcessorAtomicInt _nextTile;
+    int _chunkHeight; // 0 means automatic
+    int _chunkRows; // actual chunk height for the current window
+    int _nChunks;
+    MultiThread::Mutex _queuesLock; // protects the creation of the queues
+    ChunkQueue* _queues;
+    unsigned int _nQueues;
+
+public:
+    PixelProcessorScheduler()
+        : _scheduling(ePixelProcessorSchedulingRows)
+        , _windowScheduling(ePixelProcessorSchedulingRows)
+        , _window()
+        , _tileWidth(0)
+        , _tileHeight(0)
+        , _nTilesX(0)
+        , _nTiles(0)
+        , _nextTile(0)
+        , _chunkHeight(0)
+        , _chunkRows(0)
+        , _nChunks(0)
+        , _queuesLock()
+        , _queues(NULL)
+        , _nQueues(0)
+    {
+        _window.x1 = _window.y1 = _window.x2 = _window.y2 = 0;
+    }
+
+    ~PixelProcessorScheduler()
+    {
+        delete [] _queues;
+    }
+
+    /** @brief set the tile size (in pixels), and use tiled scheduling.
+        A size of 0 restores the default scheduling (split in horizontal bands). */
+    void setTileSize(int tileWidth,
+                     int tileHeight)
+    {
+        if ( (tileWidth <= 0) || (tileHeight <= 0) ) {
+            _scheduling = ePixelProcessorSchedulingRows;
+            _tileWidth = _tileHeight = 0;
+        } else {
+            _scheduling = ePixelProcessorSchedulingTiles;
+            _tileWidth = tileWidth;
+            _tileHeight = tileHeight;
+        }
+    }
+
+    /** @brief use work stealing, with chunks of chunkHeight rows.
+        If chunkHeight is 0, the chunk height is chosen so that each thread initially gets 8 chunks. */
+    void setWorkStealing(int chunkHeight = 0)
+    {
+        _scheduling = ePixelProcessorSchedulingWorkStealing;
+        _chunkHeight = (std::max)(chunkHeight, 0);
+    }
+
+    PixelProcessorSchedulingEnum getScheduling() const
+    {
+        return _scheduling;
+    }
+
+    /** @brief called before any MP is done, to set the window to process */
+    void prepare(const OfxRectI& window)
+    {
+        prepare(window, _scheduling);
+    }
+
+    /** @brief same as above, but the window is processed with the given scheduling mode,
+        without changing the mode used by the next calls to prepare(window).
+        Tiled scheduling falls back to rows if no tile size was set. */
+    void prepare(const OfxRectI& window,
+                 PixelProcessorSchedulingEnum scheduling)
+    {
+        if ( (scheduling == ePixelProcessorSchedulingTiles) && ( (_tileWidth <= 0) || (_tileHeight <= 0) ) ) {
+            scheduling = ePixelProcessorSchedulingRows;
+        }
+        _windowScheduling = scheduling;
+        _window = window;
+        _nextTile = 0;
+        _nTilesX = _nTiles = 0;
+        _chunkRows = _nChunks = 0;
+        delete [] _queues;
+        _queues = NULL;
+        _nQueues = 0;
+        if (_windowScheduling == ePixelProcessorSchedulingTiles) {
+            _nTilesX = (window.x2 - window.x1 + _tileWidth - 1) / _tileWidth;
+            _nTiles = _nTilesX * ( (window.y2 - window.y1 + _tileHeight - 1) / _tileHeight );
+        }
+    }
+
+    /** @brief the number of threads worth launching to process the window, at most maxCPUs */
+    unsigned int getNumThreads(unsigned int maxCPUs) const
+    {
+        const int w = _window.x2 - _window.x1;
+        const int h = _window.y2 - _window.y1;
+        unsigned int nCPUs;
+
+        if (_windowScheduling == ePixelProcessorSchedulingTiles) {
+            // make sure there are at least 4096 pixels per CPU and at least 1 tile per CPU
+            nCPUs = (unsigned int)( ( (double)w * h ) / 4096 );
+            nCPUs = (std::min)(nCPUs, (unsigned int)_nTiles);
+        } else {
+            // make sure there are at least 4096 pixels per CPU and at least 1 line par CPU
+            nCPUs = (unsigned int)( (std::min)(w, 4096) * h ) / 4096;
+            if ( (_windowScheduling == ePixelProcessorSchedulingWorkStealing) && (_chunkHeight > 0) ) {
+                // and at least 1 chunk per CPU
+                nCPUs = (std::min)(nCPUs, (unsigned int)( (h + _chunkHeight - 1) / _chunkHeight ));
+            }
+        }
+
+        // make sure the number of CPUs is valid (and use at least 1 CPU)
+        return (std::max)( 1u, (std::min)(nCPUs, maxCPUs) );
+    }
+
+    /** @brief process the part of the window assigned to thread threadId, by calling
+        processor.multiThreadProcessImages() on each sub-window */
+    template <class PROCESSOR>
+    void multiThreadFunction(unsigned int threadId,
+                             unsigned int nThreads,
+                             PROCESSOR& processor,
+                             const OfxPointD& rs)
+    {
+        switch (_windowScheduling) {
+        case ePixelProcessorSchedulingRows: {
+            OfxRectI win = _window;
+
+            MultiThread::getThreadRange(threadId, nThreads, _window.y1, _window.y2, &win.y1, &win.y2);
+            if ( (win.y2 - win.y1) > 0 ) {
+                // and render that thread on each
+                processor.multiThreadProcessImages(win, rs);
+            }
+            break;
+        }
+        case ePixelProcessorSchedulingTiles: {
+            // take the next tile until there are none left
+            for (int tile = _nextTile++; tile < _nTiles; tile = _nextTile++) {
+                OfxRectI win;
+                win.x1 = _window.x1 + (tile % _nTilesX) * _tileWidth;
+                win.x2 = (std::min)(win.x1 + _tileWidth, _window.x2);
+                win.y1 = _window.y1 + (tile / _nTilesX) * _tileHeight;
+                win.y2 = (std::min)(win.y1 + _tileHeight, _window.y2);
+                processor.multiThreadProcessImages(win, rs);
+            }
+            break;
+        }
+        case ePixelProcessorSchedulingWorkStealing: {
+            createQueues(nThreads);
+            if (threadId >= _nQueues) {
+                break;
+            }
+            int chunk;
+            while ( takeChunk(threadId, &chunk) ) {
+                OfxRectI win = _window;
+                win.y1 = _window.y1 + chunk * _chunkRows;
+                win.y2 = (std::min)(win.y1 + _chunkRows, _window.y2);
+                processor.multiThreadProcessImages(win, rs);
+            }
+            break;
+        }
+        }
+    }
+
+private:
+    /** @brief create the chunk queues, the first time a thread gets there */
+    void createQueues(unsigned int nThreads)
+    {
+        MultiThread::AutoMutex l(_queuesLock);
+
+        if (_queues) {
+            return;
+        }
+        const int h = (std::max)(_window.y2 - _window.y1, 0);
+        _chunkRows = _chunkHeight;
+        if (_chunkRows <= 0) {
+            _chunkRows = (std::max)(1, h / (int)(nThreads * 8));
+        }
+        _nChunks = (h + _chunkRows - 1) / _chunkRows;
+        _nQueues = nThreads;
+        _queues = new ChunkQueue[nThreads];
+        for (unsigned int i = 0; i < nThreads; ++i) {
+            // each thread initially gets a contiguous range of chunks
+            MultiThread::getThreadRange(i, nThreads, 0, _nChunks, &_queues[i].begin, &_queues[i].end);
+        }
+    }
+
+    /** @brief take a chunk from the front of our own queue, or else steal one from the back of another queue.
+        Returns false when all queues are empty. */
+    bool takeChunk(unsigned int threadId,
+                   int* chunk)
+    {
+        {
+            ChunkQueue& q = _queues[threadId];
+            MultiThread::AutoMutex l(q.lock);
+            if (q.begin < q.end) {
+                *chunk = q.begin++;
+
+                return true;
+            }
+        }
+        for (unsigned int i = 1; i < _nQueues; ++i) {
+            ChunkQueue& q = _queues[(threadId + i) % _nQueues];
+            MultiThread::AutoMutex l(q.lock);
+            if (q.begin < q.end) {
+                *chunk = --q.end;
+
+                return true;
+            }
+        }
+
+        // chunks are never put back in a queue, so all the work is taken
+        return false;
+    }
+
+    PixelProcessorScheduler &operator= (const PixelProcessorScheduler &);
+    PixelProcessorScheduler(const PixelProcessorScheduler &);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// scratch memory for the processing threads
+//
+// A bump allocator, used by one thread at a time: memory is taken from large blocks, and is
+// only given back by reset(), which keeps the blocks for the next use. Once the arena has
+// grown to the size needed by a processor, allocations do not touch the global allocator.
+class ScratchArena
+{
+    struct Block
+    {
+        char* data;
+        size_t size;
+    };
+
+    std::vector<Block> _blocks; // the last block is the one being filled
+    size_t _used; // bytes used in the last block
+
+public:
+    enum
+    {
+        kMinBlockSize = 1 << 20,
+        kDefaultAlignment = 64 // a cache line, and enough for any SIMD type
+    };
+
+    ScratchArena()
+        : _blocks()
+        , _used(0)
+    {
+    }
+
+    ~ScratchArena()
+    {
+        for (size_t i = 0; i < _blocks.size(); ++i) {
+            std::free(_blocks[i].data);
+        }
+    }
+
+    /** @brief allocate size bytes, aligned on align bytes (align must be a power of two).
+        The memory is valid until the next call to reset(). */
+    void* alloc(size_t size,
+                size_t align = kDefaultAlignment)
+    {
+        assert( align > 0 && (align & (align - 1)) == 0 );
+        if ( !_blocks.empty() ) {
+            const Block& b = _blocks.back();
+            size_t offset = ( ( (size_t)b.data + _used + align - 1 ) & ~(align - 1) ) - (size_t)b.data;
+            if (offset + size <= b.size) {
+                _used = offset + size;
+
+                return b.data + offset;
+            }
+        }
+        // the current block is full: start a new one
+        Block b;
+        b.size = (std::max)( (size_t)kMinBlockSize, size + align );
+        b.data = (char*)std::malloc(b.size);
+        if (!b.data) {
+            throw std::bad_alloc();
+        }
+        _blocks.push_back(b);
+        size_t offset = ( ( (size_t)b.data + align - 1 ) & ~(align - 1) ) - (size_t)b.data;
+        _used = offset + size;
+
+        return b.data + offset;
+    }
+
+    /** @brief free all allocations at once.
+        If more than one block was used, they are replaced by a single block that can hold them all. */
+    void reset()
+    {
+        if (_blocks.size() > 1) {
+            Block b;
+            b.size = 0;
+            for (size_t i = 0; i < _blocks.size(); ++i) {
+                b.size += _blocks[i].size;
+                std::free(_blocks[i].data);
+            }
+            _blocks.clear();
+            b.data = (char*)std::malloc(b.size);
+            if (b.data) {
+                _blocks.push_back(b);
+            }
+        }
+        _used = 0;
+    }
+
+    /** @brief the arena of the calling thread, set while it runs PixelProcessor::multiThreadFunction() */
+    static ScratchArena*& current()
+    {
+        static thread_local ScratchArena* arena = NULL;
+
+        return arena;
+    }
+
+private:
+    ScratchArena &operator= (const ScratchArena &);
+    ScratchArena(const ScratchArena &);
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // base class to process images with
 class PixelProcessor
@@ -182,6 +735,12 @@ protected:
     int _dstRowBytes;
     OfxRectI _renderWindow;               /**< @brief render window to use */
     OfxPointD _renderScale;               /**< @brief render scale to use */
+    PixelProcessorScheduler _scheduler;   /**< @brief distributes the render window over the threads */
+
+private:
+    OFX::MultiThread::Mutex _scratchLock; /**< @brief protects _scratchArenas */
+    std::vector<ScratchArena*> _scratchArenas; /**< @brief scratch memory, one arena per thread index */
+    std::vector<double> _threadBusyTime; /**< @brief busy time of each thread, only filled when a stats sink is set */
 
 public:
     /** @brief ctor */
@@ -194,11 +753,22 @@ public:
         , _dstBitDepth(OFX::eBitDepthNone)
         , _dstPixelBytes(0)
         , _dstRowBytes(0)
+        , _scheduler()
+        , _scratchLock()
+        , _scratchArenas()
+        , _threadBusyTime()
     {
         _renderWindow.x1 = _renderWindow.y1 = _renderWindow.x2 = _renderWindow.y2 = 0;
         _renderScale.x = _renderScale.y = 1.;
     }
 
+    virtual ~PixelProcessor()
+    {
+        for (size_t i = 0; i < _scratchArenas.size(); ++i) {
+            delete _scratchArenas[i];
+        }
+    }
+
     /** @brief set the destination image */
     void setDstImg(OFX::Image *v)
     {
@@ -235,16 +805,35 @@ public:
         _renderScale = rs;
     }
 
+    /** @brief process the render window by tiles of tileWidth x tileHeight pixels, handed to the threads
+        as they become available, rather than by one band of rows per thread.
+        A size of 0 restores the default (one band of rows per thread). */
+    void setTileSize(int tileWidth,
+                     int tileHeight)
+    {
+        _scheduler.setTileSize(tileWidth, tileHeight);
+    }
+
+    /** @brief balance the load dynamically over the threads: the render window is split into chunks
+        of chunkHeight rows (0 means automatic), and threads which are done steal chunks from the others.
+        This is best for processors whose per-pixel cost varies a lot over the image. */
+    void setWorkStealing(int chunkHeight = 0)
+    {
+        _scheduler.setWorkStealing(chunkHeight);
+    }
+
     /** @brief overridden from OFX::MultiThread::Processor. This function is called once on each SMP thread by the base class */
     void multiThreadFunction(unsigned int threadId,
                              unsigned int nThreads)
     {
-        OfxRectI win = _renderWindow;
+        ScratchArenaSetter arena( getScratchArena(threadId) );
 
-        MultiThread::getThreadRange(threadId, nThreads, _renderWindow.y1, _renderWindow.y2, &win.y1, &win.y2);
-        if ( (win.y2 - win.y1) > 0 ) {
-            // and render that thread on each
-            multiThreadProcessImages(win, _renderScale);
+        if ( threadId < _threadBusyTime.size() ) {
+            double t = getPixelProcessorTime();
+            _scheduler.multiThreadFunction(threadId, nThreads, *this, _renderScale);
+            _threadBusyTime[threadId] += getPixelProcessorTime() - t;
+        } else {
+            _scheduler.multiThreadFunction(threadId, nThreads, *this, _renderScale);
         }
     }
 
@@ -276,23 +865,81 @@ public:
             return;
         }
 
+        // instrumentation is only done if a sink was set
+        PixelProcessorStatsSink* statsSink = getPixelProcessorStatsSink();
+        double t0 = statsSink ? getPixelProcessorTime() : 0.;
+
         // call the pre MP pass
         preProcess();
 
-        // make sure there are at least 4096 pixels per CPU and at least 1 line par CPU
-        unsigned int nCPUs = (unsigned int)( (std::min)(_renderWindow.x2 - _renderWindow.x1, 4096) *
-                                            (_renderWindow.y2 - _renderWindow.y1) ) / 4096;
-        // make sure the number of CPUs is valid (and use at least 1 CPU)
-        nCPUs = (std::max)( 1u, (std::min)( nCPUs, OFX::MultiThread::getNumCPUs() ) );
+        _scheduler.prepare(_renderWindow);
+        unsigned int nCPUs = _scheduler.getNumThreads( OFX::MultiThread::getNumCPUs() );
+        double t1 = 0.;
+        if (statsSink) {
+            _threadBusyTime.assign(nCPUs, 0.);
+            t1 = getPixelProcessorTime();
+        }
 
         // call the base multi threading code, should put a pre & post thread calls in too
         multiThread(nCPUs);
 
+        double t2 = statsSink ? getPixelProcessorTime() : 0.;
+
         // call the post MP pass
         postProcess();
+
+        resetScratch();
+
+        if (statsSink) {
+            PixelProcessorStats stats;
+            stats.name = getStatsName();
+            stats.preProcessTime = t1 - t0;
+            stats.processTime = t2 - t1;
+            stats.postProcessTime = getPixelProcessorTime() - t2;
+            stats.threadBusyTime.swap(_threadBusyTime);
+            stats.pixels = (double)(_renderWindow.x2 - _renderWindow.x1) * (_renderWindow.y2 - _renderWindow.y1);
+            stats.bytes = stats.pixels * getStatsBytesPerPixel();
+            statsSink->record(stats);
+        }
+    }
+
+    /** @brief the name under which the statistics of this processor are reported (see ofxsPixelProcessorStats.h).
+        Defaults to the (implementation-defined) name of the dynamic type. */
+    virtual std::string getStatsName() const
+    {
+        return typeid(*this).name();
+    }
+
+    /** @brief the number of bytes read and written per processed pixel, used for the throughput statistics */
+    virtual double getStatsBytesPerPixel() const
+    {
+        return _dstPixelBytes;
     }
 
 protected:
+    /** @brief allocate size bytes of scratch memory for the calling thread, aligned on align bytes.
+        This may only be called from multiThreadProcessImages(), and the memory is valid until the end of process().
+        Use this for row or tile buffers, rather than allocating on the hot path. */
+    void* allocScratch(size_t size,
+                       size_t align = ScratchArena::kDefaultAlignment)
+    {
+        ScratchArena* arena = ScratchArena::current();
+
+        assert(arena);
+        if (!arena) {
+            throwSuiteStatusException(kOfxStatFailed);
+        }
+
+        return arena->alloc(size, align);
+    }
+
+    /** @brief allocate an array of count elements of type T in scratch memory (see allocScratch()) */
+    template <class T>
+    T* allocScratchArray(size_t count)
+    {
+        return (T*)allocScratch( count * sizeof(T) );
+    }
+
     void* getDstPixelAddress(int x,
                              int y) const
     {
@@ -306,6 +953,130 @@ protected:
 
         return (void *) pix;
     }
+
+private:
+    // sets the scratch arena of the calling thread for its lifetime (processors may be nested)
+    class ScratchArenaSetter
+    {
+        ScratchArena* _previous;
+
+    public:
+        explicit ScratchArenaSetter(ScratchArena* arena)
+            : _previous( ScratchArena::current() )
+        {
+            ScratchArena::current() = arena;
+        }
+
+        ~ScratchArenaSetter()
+        {
+            ScratchArena::current() = _previous;
+        }
+    };
+
+    ScratchArena* getScratchArena(unsigned int threadId)
+    {
+        OFX::MultiThread::AutoMutex l(_scratchLock);
+
+        if ( threadId >= _scratchArenas.size() ) {
+            _scratchArenas.resize(threadId + 1, NULL);
+        }
+        if (!_scratchArenas[threadId]) {
+            _scratchArenas[threadId] = new ScratchArena;
+        }
+
+        return _scratchArenas[threadId];
+    }
+
+    void resetScratch()
+    {
+        OFX::MultiThread::AutoMutex l(_scratchLock);
+
+        for (size_t i = 0; i < _scratchArenas.size(); ++i) {
+            if (_scratchArenas[i]) {
+                _scratchArenas[i]->reset();
+            }
+        }
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// copies a window of an image to a buffer, filling the pixels outside of the image
+// according to the boundary condition. The rows are copied in parallel.
+class PixelWindowCopier
+    : public OFX::MultiThread::Processor
+{
+    const void* _srcPixelData;
+    OfxRectI _srcBounds;
+    int _pixelBytes;
+    int _srcRowBytes;
+    int _srcBoundary;
+    void* _dstPixelData;
+    OfxRectI _dstBounds; // the window to copy
+    int _dstRowBytes;
+
+public:
+    PixelWindowCopier(const void* srcPixelData,
+                      const OfxRectI& srcBounds,
+                      int pixelBytes,
+                      int srcRowBytes,
+                      int srcBoundary, //!< The border condition type { 0=zero |  1=dirichlet | 2=periodic }.
+                      void* dstPixelData,
+                      const OfxRectI& dstBounds,
+                      int dstRowBytes)
+        : _srcPixelData(srcPixelData)
+        , _srcBounds(srcBounds)
+        , _pixelBytes(pixelBytes)
+        , _srcRowBytes(srcRowBytes)
+        , _srcBoundary(srcBoundary)
+        , _dstPixelData(dstPixelData)
+        , _dstBounds(dstBounds)
+        , _dstRowBytes(dstRowBytes)
+    {
+    }
+
+    void process()
+    {
+        const int w = _dstBounds.x2 - _dstBounds.x1;
+        const int h = _dstBounds.y2 - _dstBounds.y1;
+
+        if ( (w <= 0) || (h <= 0) ) {
+            return;
+        }
+        // make sure there are at least 4096 pixels per CPU and at least 1 line par CPU
+        unsigned int nCPUs = (unsigned int)( (std::min)(w, 4096) * h ) / 4096;
+        nCPUs = (std::max)( 1u, (std::min)( nCPUs, OFX::MultiThread::getNumCPUs() ) );
+        multiThread(nCPUs);
+    }
+
+    void multiThreadFunction(unsigned int threadId,
+                             unsigned int nThreads)
+    {
+        int y1, y2;
+
+        MultiThread::getThreadRange(threadId, nThreads, _dstBounds.y1, _dstBounds.y2, &y1, &y2);
+        for (int y = y1; y < y2; ++y) {
+            const PixelRowSpan<unsigned char> srcRow(_srcPixelData, _srcBounds, _pixelBytes, _srcRowBytes, y, _srcBoundary);
+            unsigned char* dstPix = (unsigned char*)_dstPixelData + (std::ptrdiff_t)(y - _dstBounds.y1) * _dstRowBytes;
+            for (int x = _dstBounds.x1; x < _dstBounds.x2; ) {
+                const unsigned char* srcPix;
+                int srcStride;
+                const int xEnd = srcRow.getSegment(x, _dstBounds.x2, &srcPix, &srcStride);
+                const int n = xEnd - x;
+                if (!srcPix) {
+                    std::memset(dstPix, 0, (size_t)n * _pixelBytes);
+                } else if (srcStride == _pixelBytes) {
+                    std::memcpy(dstPix, srcPix, (size_t)n * _pixelBytes);
+                } else {
+                    // repeated pixel
+                    for (int i = 0; i < n; ++i) {
+                        std::memcpy(dstPix + (size_t)i * _pixelBytes, srcPix, _pixelBytes);
+                    }
+                }
+                dstPix += (size_t)n * _pixelBytes;
+                x = xEnd;
+            }
+        }
+    }
 };
 
 
@@ -330,6 +1101,15 @@ protected:
     double _mix;
     bool _maskInvert;
 
+private:
+    int _srcHaloBorder; // 0 means no halo
+    OFX::ImageMemory* _srcHaloMem;
+    // the src image, while the src is replaced by the halo
+    const void *_srcHaloSavedPixelData;
+    OfxRectI _srcHaloSavedBounds;
+    int _srcHaloSavedRowBytes;
+    int _srcHaloSavedBoundary;
+
 public:
     /** @brief no arg ctor */
     PixelProcessorFilterBase(OFX::ImageEffect &instance)
@@ -349,9 +1129,20 @@ public:
         , _doMasking(false)
         , _mix(1.)
         , _maskInvert(false)
+        , _srcHaloBorder(0)
+        , _srcHaloMem(NULL)
+        , _srcHaloSavedPixelData(NULL)
+        , _srcHaloSavedBounds()
+        , _srcHaloSavedRowBytes(0)
+        , _srcHaloSavedBoundary(0)
     {
     }
 
+    virtual ~PixelProcessorFilterBase()
+    {
+        delete _srcHaloMem;
+    }
+
     /** @brief set the src image */
     void setSrcImg(const OFX::Image *v,
                    int srcBoundary = 0) //!< The border condition type { 0=zero |  1=dirichlet | 2=periodic }.
@@ -411,7 +1202,49 @@ public:
         _mix = mix;
     }
 
+    /** @brief process from a padded copy (a "halo" view) of the src image, covering the render window
+        extended by border pixels on each side, with the boundary conditions already applied.
+        The halo is built in parallel at the start of process(), and is shared by all threads.
+        While processing, the src image is the halo: kernels that read at most border pixels away from
+        the render window may use getSrcPixelAddressUnchecked() and need no boundary condition.
+        A border of 0 (the default) disables the halo. */
+    void setSrcHalo(int border)
+    {
+        _srcHaloBorder = (std::max)(border, 0);
+    }
+
+    /** @brief called to process everything */
+    virtual void process(void)
+    {
+        if ( (_srcHaloBorder <= 0) || !_srcPixelData || (_srcPixelBytes == 0) ||
+             (_renderWindow.x1 >= _renderWindow.x2) || (_renderWindow.y1 >= _renderWindow.y2) ) {
+            PixelProcessor::process();
+
+            return;
+        }
+        beginSrcHalo();
+        try {
+            PixelProcessor::process();
+        } catch (...) {
+            endSrcHalo();
+            throw;
+        }
+        endSrcHalo();
+    }
+
+    virtual double getStatsBytesPerPixel() const
+    {
+        return PixelProcessor::getStatsBytesPerPixel() + _srcPixelBytes;
+    }
+
 protected:
+    /** @brief the row y of the src image, with the src boundary conditions */
+    template <class PIX>
+    PixelRowSpan<PIX> getSrcRowSpan(int y) const
+    {
+        return PixelRowSpan<PIX>(_srcPixelData, _srcBounds, _srcPixelBytes, _srcRowBytes, y, _srcBoundary);
+    }
+
     const void* getSrcPixelAddress(int x,
                                    int y) const
     {
@@ -453,11 +1286,70 @@ protected:
         return (void *) pix;
     }
 
+    /** @brief the address of the src pixel at (x,y), which must be within the src bounds.
+        This is always the case within the halo (see setSrcHalo()). */
+    const void* getSrcPixelAddressUnchecked(int x,
+                                            int y) const
+    {
+        assert(_srcPixelData && _srcBounds.x1 <= x && x < _srcBounds.x2 && _srcBounds.y1 <= y && y < _srcBounds.y2);
+
+        return (const char*)_srcPixelData + (std::ptrdiff_t)(y - _srcBounds.y1) * _srcRowBytes + (std::ptrdiff_t)(x - _srcBounds.x1) * _srcPixelBytes;
+    }
+
     static int positive_modulo(int i,
                                int n)
     {
         return (i % n + n) % n;
     }
+
+private:
+    // build the halo, and make it the src image
+    void beginSrcHalo()
+    {
+        OfxRectI haloBounds;
+        haloBounds.x1 = _renderWindow.x1 - _srcHaloBorder;
+        haloBounds.x2 = _renderWindow.x2 + _srcHaloBorder;
+        haloBounds.y1 = _renderWindow.y1 - _srcHaloBorder;
+        haloBounds.y2 = _renderWindow.y2 + _srcHaloBorder;
+        const int haloRowBytes = (haloBounds.x2 - haloBounds.x1) * _srcPixelBytes;
+
+        delete _srcHaloMem;
+        _srcHaloMem = NULL;
+        _srcHaloMem = new OFX::ImageMemory( (size_t)haloRowBytes * (haloBounds.y2 - haloBounds.y1), &_effect );
+        void* haloPixelData = _srcHaloMem->lock();
+        if (!haloPixelData) {
+            delete _srcHaloMem;
+            _srcHaloMem = NULL;
+            throwSuiteStatusException(kOfxStatErrMemory);
+        }
+
+        PixelWindowCopier copier(_srcPixelData, _srcBounds, _srcPixelBytes, _srcRowBytes, _srcBoundary,
+                                 haloPixelData, haloBounds, haloRowBytes);
+        copier.process();
+
+        _srcHaloSavedPixelData = _srcPixelData;
+        _srcHaloSavedBounds = _srcBounds;
+        _srcHaloSavedRowBytes = _srcRowBytes;
+        _srcHaloSavedBoundary = _srcBoundary;
+        _srcPixelData = haloPixelData;
+        _srcBounds = haloBounds;
+        _srcRowBytes = haloRowBytes;
+        _srcBoundary = 0; // the boundary conditions are in the halo
+    }
+
+    // restore the src image, and free the halo
+    void endSrcHalo()
+    {
+        _srcPixelData = _srcHaloSavedPixelData;
+        _srcBounds = _srcHaloSavedBounds;
+        _srcRowBytes = _srcHaloSavedRowBytes;
+        _srcBoundary = _srcHaloSavedBoundary;
+        if (_srcHaloMem) {
+            _srcHaloMem->unlock();
+            delete _srcHaloMem;
+            _srcHaloMem = NULL;
+        }
+    }
 };
 };
 #endif // ifndef openfx_supportext_ofxsPixelProcessor_h
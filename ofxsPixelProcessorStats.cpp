@@ -0,0 +1,176 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/NatronGitHub/openfx-supportext>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Timing and throughput instrumentation for OFX::PixelProcessor.
+ */
+
+#include "ofxsPixelProcessorStats.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace OFX {
+PixelProcessorStatsRegistry::Entry::Entry()
+    : count(0)
+    , preProcessTime(0.)
+    , processTime(0.)
+    , postProcessTime(0.)
+    , threadBusyTime(0.)
+    , maxThreads(0)
+    , pixels(0.)
+    , bytes(0.)
+    , maxImbalance(0.)
+    , sumImbalance(0.)
+{
+}
+
+PixelProcessorStatsRegistry::PixelProcessorStatsRegistry()
+    : _lock(0)
+    , _entries()
+{
+}
+
+PixelProcessorStatsRegistry::~PixelProcessorStatsRegistry()
+{
+    if (getPixelProcessorStatsSink() == this) {
+        setPixelProcessorStatsSink(NULL);
+    }
+}
+
+PixelProcessorStatsRegistry&
+PixelProcessorStatsRegistry::instance()
+{
+    static PixelProcessorStatsRegistry registry;
+
+    return registry;
+}
+
+void
+PixelProcessorStatsRegistry::record(const PixelProcessorStats& stats)
+{
+    double busy = 0.;
+
+    for (size_t i = 0; i < stats.threadBusyTime.size(); ++i) {
+        busy += stats.threadBusyTime[i];
+    }
+    const double imbalance = stats.getImbalance();
+
+    MultiThread::AutoMutex l(_lock);
+    Entry& e = _entries[stats.name];
+    ++e.count;
+    e.preProcessTime += stats.preProcessTime;
+    e.processTime += stats.processTime;
+    e.postProcessTime += stats.postProcessTime;
+    e.threadBusyTime += busy;
+    e.maxThreads = (std::max)(e.maxThreads, (unsigned int)stats.threadBusyTime.size());
+    e.pixels += stats.pixels;
+    e.bytes += stats.bytes;
+    e.maxImbalance = (std::max)(e.maxImbalance, imbalance);
+    e.sumImbalance += imbalance;
+}
+
+void
+PixelProcessorStatsRegistry::clear()
+{
+    MultiThread::AutoMutex l(_lock);
+
+    _entries.clear();
+}
+
+std::map<std::string, PixelProcessorStatsRegistry::Entry>
+PixelProcessorStatsRegistry::getEntries() const
+{
+    MultiThread::AutoMutex l(_lock);
+
+    return _entries;
+}
+
+// escape a string for JSON
+static std::string
+jsonString(const std::string& s)
+{
+    std::string ret = "\"";
+
+    for (size_t i = 0; i < s.size(); ++i) {
+        const char c = s[i];
+        if ( (c == '"') || (c == '\\') ) {
+            ret += '\\';
+            ret += c;
+        } else if ( (unsigned char)c < 0x20 ) {
+            char buf[8];
+            std::sprintf(buf, "\\u%04x", (unsigned int)(unsigned char)c);
+            ret += buf;
+        } else {
+            ret += c;
+        }
+    }
+    ret += '"';
+
+    return ret;
+}
+
+std::string
+PixelProcessorStatsRegistry::toJSON() const
+{
+    std::map<std::string, Entry> entries = getEntries();
+    std::ostringstream os;
+
+    os.precision(9);
+    os << "{\n  \"processors\": [";
+    for (std::map<std::string, Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+        const Entry& e = it->second;
+        const double total = e.preProcessTime + e.processTime + e.postProcessTime;
+        os << (it == entries.begin() ? "\n" : ",\n");
+        os << "    {\n";
+        os << "      \"name\": " << jsonString(it->first) << ",\n";
+        os << "      \"count\": " << e.count << ",\n";
+        os << "      \"preProcessTime\": " << e.preProcessTime << ",\n";
+        os << "      \"processTime\": " << e.processTime << ",\n";
+        os << "      \"postProcessTime\": " << e.postProcessTime << ",\n";
+        os << "      \"threadBusyTime\": " << e.threadBusyTime << ",\n";
+        os << "      \"maxThreads\": " << e.maxThreads << ",\n";
+        os << "      \"pixels\": " << e.pixels << ",\n";
+        os << "      \"bytes\": " << e.bytes << ",\n";
+        os << "      \"pixelsPerSecond\": " << (total > 0. ? e.pixels / total : 0.) << ",\n";
+        os << "      \"bytesPerSecond\": " << (total > 0. ? e.bytes / total : 0.) << ",\n";
+        os << "      \"meanImbalance\": " << (e.count > 0 ? e.sumImbalance / e.count : 0.) << ",\n";
+        os << "      \"maxImbalance\": " << e.maxImbalance << "\n";
+        os << "    }";
+    }
+    os << (entries.empty() ? "]\n}\n" : "\n  ]\n}\n");
+
+    return os.str();
+}
+
+bool
+PixelProcessorStatsRegistry::writeJSON(const std::string& filename) const
+{
+    std::ofstream ofs( filename.c_str() );
+
+    if (!ofs) {
+        return false;
+    }
+    ofs << toJSON();
+
+    return ofs.good();
+}
+} // namespace OFX
@@ -0,0 +1,190 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/NatronGitHub/openfx-supportext>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Timing and throughput instrumentation for OFX::PixelProcessor.
+ */
+
+#ifndef openfx_supportext_ofxsPixelProcessorStats_h
+#define openfx_supportext_ofxsPixelProcessorStats_h
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#if __cplusplus > 199711L           // C++11
+#include <chrono>
+#elif defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include "ofxsMultiThread.h"
+
+namespace OFX {
+// the statistics of one call to PixelProcessor::process()
+struct PixelProcessorStats
+{
+    std::string name; // the processor type
+    double preProcessTime; // wall time of preProcess(), in seconds
+    double processTime; // wall time of the parallel region, in seconds
+    double postProcessTime; // wall time of postProcess(), in seconds
+    std::vector<double> threadBusyTime; // time spent processing by each thread, in seconds
+    double pixels; // number of pixels processed
+    double bytes; // number of bytes read and written
+
+    PixelProcessorStats()
+        : name()
+        , preProcessTime(0.)
+        , processTime(0.)
+        , postProcessTime(0.)
+        , threadBusyTime()
+        , pixels(0.)
+        , bytes(0.)
+    {
+    }
+
+    /** @brief the load imbalance between threads: the maximum busy time divided by the mean busy time.
+        1 means perfect balance. */
+    double getImbalance() const
+    {
+        double sum = 0.;
+        double max = 0.;
+
+        for (size_t i = 0; i < threadBusyTime.size(); ++i) {
+            sum += threadBusyTime[i];
+            max = (std::max)(max, threadBusyTime[i]);
+        }
+
+        return (sum > 0.) ? ( max * threadBusyTime.size() / sum ) : 1.;
+    }
+};
+
+// receives the statistics of the processors
+class PixelProcessorStatsSink
+{
+public:
+    virtual ~PixelProcessorStatsSink() {}
+
+    /** @brief called by PixelProcessor::process() after postProcess(), from the thread that called process().
+        Several processors may call this at the same time. */
+    virtual void record(const PixelProcessorStats& stats) = 0;
+};
+
+inline PixelProcessorStatsSink*&
+pixelProcessorStatsSinkRef()
+{
+    static PixelProcessorStatsSink* sink = NULL;
+
+    return sink;
+}
+
+/** @brief the sink that processors report to, or NULL if instrumentation is disabled (the default) */
+inline PixelProcessorStatsSink*
+getPixelProcessorStatsSink()
+{
+    return pixelProcessorStatsSinkRef();
+}
+
+/** @brief set the sink that processors report to. NULL disables instrumentation.
+    The sink must stay valid until it is replaced, and should be set before any processing is done. */
+inline void
+setPixelProcessorStatsSink(PixelProcessorStatsSink* sink)
+{
+    pixelProcessorStatsSinkRef() = sink;
+}
+
+/** @brief wall clock time, in seconds */
+inline double
+getPixelProcessorTime()
+{
+#if __cplusplus > 199711L           // C++11
+    return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+#elif defined(_WIN32)
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+#endif
+}
+
+// A sink that accumulates the statistics of each processor type for the whole process,
+// and can dump them as JSON (implemented in ofxsPixelProcessorStats.cpp).
+// Typical use, e.g. from PluginFactory::load() and unload():
+//
+//     OFX::setPixelProcessorStatsSink( &OFX::PixelProcessorStatsRegistry::instance() );
+//     ...
+//     OFX::PixelProcessorStatsRegistry::instance().writeJSON("/tmp/stats.json");
+class PixelProcessorStatsRegistry
+    : public PixelProcessorStatsSink
+{
+public:
+    // the accumulated statistics of a processor type
+    struct Entry
+    {
+        unsigned int count; // number of calls to process()
+        double preProcessTime;
+        double processTime;
+        double postProcessTime;
+        double threadBusyTime; // summed over all threads
+        unsigned int maxThreads;
+        double pixels;
+        double bytes;
+        double maxImbalance;
+        double sumImbalance;
+
+        Entry();
+    };
+
+    PixelProcessorStatsRegistry();
+
+    virtual ~PixelProcessorStatsRegistry();
+
+    /** @brief the registry of the process */
+    static PixelProcessorStatsRegistry& instance();
+
+    virtual void record(const PixelProcessorStats& stats);
+
+    void clear();
+
+    std::map<std::string, Entry> getEntries() const;
+
+    std::string toJSON() const;
+
+    /** @brief write toJSON() to a file. Returns false on failure. */
+    bool writeJSON(const std::string& filename) const;
+
+private:
+    PixelProcessorStatsRegistry &operator= (const PixelProcessorStatsRegistry &);
+    PixelProcessorStatsRegistry(const PixelProcessorStatsRegistry &);
+
+    mutable MultiThread::Mutex _lock; // protects _entries
+    std::map<std::string, Entry> _entries;
+};
+} // namespace OFX
+
+#endif // openfx_supportext_ofxsPixelProcessorStats_h
@@ -0,0 +1,116 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/NatronGitHub/openfx-supportext>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * OFX processor base class for the color transforms which work on packed float RGB or RGBA rows
+ * (3D Luts, chains of color transforms).
+ */
+
+#ifndef openfx_supportext_ofxsRGBRowTransformProcessor_h
+#define openfx_supportext_ofxsRGBRowTransformProcessor_h
+
+#include <cassert>
+#include <cstddef>
+
+#include "ofxsImageEffect.h"
+#include "ofxsPixelProcessor.h"
+
+namespace OFX {
+// base class for a processor which transforms the RGB or RGBA pixels of the src image row by row,
+// with a transform that works on packed float pixels (e.g. a 3D Lut or a chain of color transforms).
+// TRANSFORM is the derived class, which must define:
+//
+//     void apply(const float* src, float* dst, int n, int nComponents) const;
+//
+// apply() transforms n pixels, and must accept src == dst. Float rows which are within the src image are
+// transformed directly into the dst image. Otherwise, the row is converted to float in [0, 1] (with the
+// boundary conditions of the src), transformed in place, and written back (clamped for integer images).
+template <class PIX, int nComponents, int maxValue, class TRANSFORM>
+class RGBRowTransformProcessor
+    : public PixelProcessorFilterBase
+{
+public:
+    RGBRowTransformProcessor(OFX::ImageEffect &instance)
+        : PixelProcessorFilterBase(instance)
+    {
+    }
+
+private:
+    void multiThreadProcessImages(const OfxRectI& procWindow,
+                                  const OfxPointD& rs)
+    {
+        unused(rs);
+        assert(nComponents == 3 || nComponents == 4);
+        assert(_dstBounds.x1 <= procWindow.x1 && procWindow.x2 <= _dstBounds.x2 && _dstBounds.y1 <= procWindow.y1 && procWindow.y2 <= _dstBounds.y2);
+        const TRANSFORM& transform = static_cast<const TRANSFORM&>(*this);
+        const int width = procWindow.x2 - procWindow.x1;
+        // the row in float, if it cannot be transformed in place
+        float* row = NULL;
+
+        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
+            if ( _effect.abort() ) {
+                break;
+            }
+
+            PIX *dstPix = (PIX *) getDstPixelAddress(procWindow.x1, y);
+            assert(dstPix);
+            if (!dstPix) {
+                // coverity[dead_error_line]
+                continue;
+            }
+
+            const PixelRowSpan<PIX> srcRow = getSrcRowSpan<PIX>(y);
+            const PIX *srcPix;
+            int srcStride;
+            if ( (maxValue == 1) && (srcRow.getSegment(procWindow.x1, procWindow.x2, &srcPix, &srcStride) == procWindow.x2) &&
+                 srcPix && (srcStride == nComponents) ) {
+                // float pixels, all within the src image
+                transform.apply( (const float*)srcPix, (float*)dstPix, width, nComponents );
+                continue;
+            }
+
+            if (!row) {
+                row = allocScratchArray<float>( (size_t)width * nComponents );
+            }
+            float* rowPix = row;
+            for (int x = procWindow.x1; x < procWindow.x2; ) {
+                const int xEnd = srcRow.getSegment(x, procWindow.x2, &srcPix, &srcStride);
+                for (; x < xEnd; ++x, srcPix += srcStride, rowPix += nComponents) {
+                    for (int c = 0; c < nComponents; ++c) {
+                        // no src pixel here: black and transparent
+                        rowPix[c] = srcPix ? ( (maxValue == 1) ? (float)srcPix[c] : srcPix[c] * (1.f / maxValue) ) : 0.f;
+                    }
+                }
+            }
+            transform.apply(row, row, width, nComponents);
+            for (int i = 0; i < width * nComponents; ++i) {
+                if (maxValue == 1) {
+                    dstPix[i] = (PIX)row[i];
+                } else {
+                    const float v = row[i];
+                    dstPix[i] = (PIX)( ( v <= 0.f ) ? 0.f : ( v >= 1.f ) ? (float)maxValue : (v * maxValue + 0.5f) );
+                }
+            }
+        }
+    } // multiThreadProcessImages
+};
+} // namespace OFX
+
+#endif // ifndef openfx_supportext_ofxsRGBRowTransformProcessor_h
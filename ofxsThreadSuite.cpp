@@ -25,6 +25,8 @@
  * This suite counts the number of running threads lauched by this suite only, and reports the number of free slots in multiThreadNumCPUs.
  *
  * The number of free slots is shared between all plugins of a multibundle.
+ *
+ * The threads are taken from a pool of persistent workers, which is shared by all calls to multiThread.
  */
 
 //#define DEBUG_STDOUT // output debug messages to stdout
@@ -33,8 +35,9 @@
 #include "ofxsMultiThread.h"
 
 #include <cassert>
+#include <algorithm>
 #include <vector>
-#include <map>
+#include <deque>
 #ifdef DEBUG_STDOUT
 #include <iostream>
 #define DBG(x) (x)
@@ -45,12 +48,14 @@
 #if __cplusplus > 199711L           // C++11
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 // use our version of fast_mutex.h, which has bug fixes
 //#include "fast_mutex.h"
 
 using std::thread;
 using std::mutex;
 using std::recursive_mutex;
+using std::condition_variable;
 namespace this_thread = std::this_thread;
 
 // TODO: replace with our own implementation using std::atomic_flag
@@ -70,6 +75,7 @@ using tthread::thread;
 using tthread::mutex;
 //using tthread::fast_mutex;
 using tthread::recursive_mutex;
+using tthread::condition_variable;
 using tthread::lock_guard;
 namespace this_thread = tthread::this_thread;
 #endif
@@ -78,8 +84,8 @@ namespace this_thread = tthread::this_thread;
 #include "ofxMultiThread.h"
 #include "ofxsImageEffect.h"
 
-using std::map;
 using std::vector;
+using std::deque;
 #ifdef DEBUG_STDOUT
 using std::cout;
 using std::endl;
@@ -98,33 +104,297 @@ const unsigned nprocs = thread::hardware_concurrency();
 mutex occupancyLock; // protects occupancy
 unsigned occupancy = 0;
 
-mutex threadIndexesLock; // protects threadIndexes
-map<thread::id, unsigned int> threadIndexes;
+// index of the slice run by the current thread, or kNoThreadIndex if it is not running a slice.
+// This is thread-local, so that multiThreadIndex() and multiThreadIsSpawnedThread(), which may be
+// called from inner loops, do not need any lock.
+const unsigned int kNoThreadIndex = ~0u;
+thread_local unsigned int currentThreadIndex = kNoThreadIndex;
+
+// if true, multiThread() may be called from a spawned thread (see OFX::ofxsThreadSuiteSetNested())
+bool nestedParallelism = true;
 
 
-struct ThreadArgs
+// A call to multiThread(), shared by the workers that run its slices.
+// All fields except the function arguments are protected by the pool lock.
+struct ThreadBatch
 {
     OfxThreadFunctionV1* func;
-    unsigned int threadIndex;
     unsigned int threadMax;
     void *customArg;
-    OfxStatus ret;
+    vector<OfxStatus> ret; // return status of each slice
+    unsigned int next; // index of the next slice to run
+    unsigned int runners; // number of workers still working on this batch
 };
 
 void
-threadFunction(void *_args)
+runSlice(ThreadBatch* batch,
+         unsigned int threadIndex)
 {
-    ThreadArgs* args = (ThreadArgs*)_args;
-    assert(args->threadIndex < args->threadMax);
+    assert(threadIndex < batch->threadMax);
+    assert(currentThreadIndex == kNoThreadIndex);
+    currentThreadIndex = threadIndex;
 
-    args->ret = kOfxStatOK;
+    OfxStatus ret = kOfxStatOK;
     try {
-        args->func(args->threadIndex, args->threadMax, args->customArg);
+        batch->func(threadIndex, batch->threadMax, batch->customArg);
     } catch (const std::bad_alloc&) {
-        args->ret = kOfxStatErrMemory;
+        ret = kOfxStatErrMemory;
     } catch (...) {
-        args->ret = kOfxStatFailed;
+        ret = kOfxStatFailed;
+    }
+    batch->ret[threadIndex] = ret;
+
+    currentThreadIndex = kNoThreadIndex;
+}
+
+void workerFunction(void *_pool);
+
+// A pool of long-lived worker threads.
+// Creating and joining one thread per slice on each multiThread() call is expensive
+// when many short processing passes are issued (e.g. one per PixelProcessor::process()),
+// so the workers are created once (lazily, up to nprocs) and reused across calls.
+// The workers are joined by shutdown(), which is called by OFX::ofxsThreadSuiteShutdown() from the
+// unload action of the plugin. They cannot be joined from a static destructor: on Windows, static
+// destructors run under the loader lock when the binary is unloaded, and exiting threads need that lock.
+class WorkerPool
+{
+public:
+    WorkerPool()
+        : _lock()
+        , _workAvailable()
+        , _batchFinished()
+        , _queue()
+        , _workers()
+        , _stop(false)
+    {
+    }
+
+    ~WorkerPool()
+    {
+        // the workers must have been joined by shutdown()
+        assert( _workers.empty() );
+    }
+
+    // stop and join all the workers. No multiThread() call may be in progress.
+    // The pool may be used again afterwards: the workers are launched again when needed.
+    void shutdown()
+    {
+        vector<thread*> workers;
+        {
+            lock_guard<mutex> guard(_lock);
+            assert( _queue.empty() );
+            _stop = true;
+            _workAvailable.notify_all();
+            workers.swap(_workers);
+        }
+        for (vector<thread*>::iterator it = workers.begin(); it != workers.end(); ++it) {
+            (*it)->join();
+            delete *it;
+        }
+        lock_guard<mutex> guard(_lock);
+        _stop = false;
+    }
+
+    // run all the slices of batch, using at most nRunners workers at the same time,
+    // and return when all slices are done.
+    // returns false if no worker could be launched.
+    bool run(ThreadBatch* batch,
+             unsigned int nRunners)
+    {
+        assert(nRunners > 0);
+        lock_guard<mutex> guard(_lock);
+        // launch the missing workers
+        try {
+            while (_workers.size() < nRunners && _workers.size() < nprocs) {
+                _workers.push_back(NULL);
+                _workers.back() = new thread(workerFunction, this);
+            }
+        } catch (...) {
+            // could not launch a new thread, do with the ones we have
+            if ( !_workers.empty() && (_workers.back() == NULL) ) {
+                _workers.pop_back();
+            }
+            if ( _workers.empty() ) {
+                return false;
+            }
+        }
+
+        batch->next = 0;
+        batch->runners = nRunners;
+        for (unsigned int i = 0; i < nRunners; ++i) {
+            _queue.push_back(batch);
+        }
+        _workAvailable.notify_all();
+
+        while (batch->runners > 0) {
+            _batchFinished.wait(guard);
+        }
+
+        return true;
+    }
+
+    // run all the slices of batch from a thread which is already running a slice (nested call),
+    // using the calling thread and at most nRunners-1 workers at the same time.
+    // The calling thread runs slices too, and does not wait for the workers that did not pick up the
+    // batch, so that this completes even if all the workers are busy (e.g. waiting on nested calls themselves).
+    void runNested(ThreadBatch* batch,
+                   unsigned int nRunners)
+    {
+        assert(nRunners > 0);
+        {
+            lock_guard<mutex> guard(_lock);
+            // launch the missing workers, if possible
+            try {
+                while (_workers.size() < nRunners - 1 && _workers.size() < nprocs) {
+                    _workers.push_back(NULL);
+                    _workers.back() = new thread(workerFunction, this);
+                }
+            } catch (...) {
+                if ( !_workers.empty() && (_workers.back() == NULL) ) {
+                    _workers.pop_back();
+                }
+            }
+
+            batch->next = 0;
+            batch->runners = nRunners;
+            for (unsigned int i = 1; i < nRunners; ++i) {
+                _queue.push_back(batch);
+            }
+            if (nRunners > 1) {
+                _workAvailable.notify_all();
+            }
+        }
+
+        // the calling thread is one of the runners
+        const unsigned int outerThreadIndex = currentThreadIndex;
+        currentThreadIndex = kNoThreadIndex;
+        runBatch(batch);
+        currentThreadIndex = outerThreadIndex;
+
+        lock_guard<mutex> guard(_lock);
+        // all slices are taken: withdraw the runners that were not picked up by a worker
+        for (deque<ThreadBatch*>::iterator it = _queue.begin(); it != _queue.end(); ) {
+            if (*it == batch) {
+                it = _queue.erase(it);
+                --batch->runners;
+            } else {
+                ++it;
+            }
+        }
+        // and wait for the workers that are still running a slice of this batch
+        while (batch->runners > 0) {
+            _batchFinished.wait(guard);
+        }
+    }
+
+    // the main loop of each worker thread
+    void work()
+    {
+        for (;;) {
+            ThreadBatch* batch = NULL;
+            {
+                lock_guard<mutex> guard(_lock);
+                while ( !_stop && _queue.empty() ) {
+                    _workAvailable.wait(guard);
+                }
+                if ( _queue.empty() ) {
+                    // the pool is being destroyed
+                    return;
+                }
+                batch = _queue.front();
+                _queue.pop_front();
+            }
+
+            runBatch(batch);
+        }
+    }
+
+private:
+    // run slices from batch until there are none left, then leave the batch
+    void runBatch(ThreadBatch* batch)
+    {
+        for (;;) {
+            unsigned int threadIndex;
+            {
+                lock_guard<mutex> guard(_lock);
+                if (batch->next >= batch->threadMax) {
+                    // the batch may be destroyed by the caller as soon as runners reaches 0
+                    --batch->runners;
+                    if (batch->runners == 0) {
+                        _batchFinished.notify_all();
+                    }
+
+                    return;
+                }
+                threadIndex = batch->next;
+                ++batch->next;
+            }
+            runSlice(batch, threadIndex);
+        }
+    }
+
+    WorkerPool &operator= (const WorkerPool &);
+    WorkerPool(const WorkerPool &);
+
+    mutex _lock; // protects all members below, and the ThreadBatch being run
+    condition_variable _workAvailable; // signaled when _queue is not empty or _stop is set
+    condition_variable _batchFinished; // signaled when a batch has no more runners
+    deque<ThreadBatch*> _queue; // one entry per runner, each worker picks one and runs slices until the batch is exhausted
+    vector<thread*> _workers;
+    bool _stop;
+};
+
+// The pool is never destroyed: if the plugin did not call OFX::ofxsThreadSuiteShutdown(), its workers
+// are still waiting on the pool at exit, and destroying the pool would be undefined behavior.
+WorkerPool& workerPool = *new WorkerPool;
+
+void
+workerFunction(void *_pool)
+{
+    WorkerPool* pool = (WorkerPool*)_pool;
+
+    pool->work();
+}
+
+// multiThread() called from a thread which is already running a slice.
+// The calling thread already counts in the occupancy, so it may use the free slots plus itself.
+OfxStatus
+multiThreadNested(OfxThreadFunctionV1 func,
+                  unsigned int nThreads,
+                  void *customArg)
+{
+    unsigned int nRunners;
+    {
+        lock_guard<mutex> guard(occupancyLock);
+        const unsigned int freeSlots = occupancy >= nprocs ? 0 : (nprocs - occupancy);
+        nRunners = (std::min)(nThreads, freeSlots + 1);
+        occupancy += nRunners - 1;
     }
+
+    ThreadBatch batch;
+    batch.func = func;
+    batch.threadMax = nThreads;
+    batch.customArg = customArg;
+    batch.ret.assign(nThreads, kOfxStatFailed);
+    batch.next = 0;
+    batch.runners = 0;
+
+    workerPool.runNested(&batch, nRunners);
+
+    {
+        lock_guard<mutex> guard(occupancyLock);
+        occupancy -= nRunners - 1;
+    }
+
+    // check the return status of each slice, return the first error found
+    for (unsigned int i = 0; i < nThreads; ++i) {
+        OfxStatus stat = batch.ret[i];
+        if (stat != kOfxStatOK) {
+            return stat;
+        }
+    }
+
+    return kOfxStatOK;
 }
 
 /**@brief Function to spawn SMP threads
@@ -144,6 +414,7 @@ threadFunction(void *_args)
  be limitted to the number of CPUs returned by multiThreadNumCPUs.
 
  This function cannot be called recursively.
+ (this implementation allows it, unless OFX::ofxsThreadSuiteSetNested(false) was called)
 
  @returns
  - ::kOfxStatOK, the function func has executed and returned sucessfully
@@ -152,6 +423,10 @@ threadFunction(void *_args)
 
  */
 // Note that the thread indexes are from 0 to nThreads-1.
+// The slices are run by the workers of workerPool: each of the (at most maxConcurrentThread) workers
+// assigned to this call runs slices until there are none left.
+// A call from a spawned thread runs its slices on that thread and on the idle workers, if any
+// (nested parallelism), or returns kOfxStatErrExists if nested parallelism is disabled.
 // http://openfx.sourceforge.net/Documentation/1.3/ofxProgrammingReference.html#OfxMultiThreadSuiteV1_multiThread
 OfxStatus multiThread(OfxThreadFunctionV1 func,
                       unsigned int nThreads,
@@ -161,12 +436,13 @@ OfxStatus multiThread(OfxThreadFunctionV1 func,
         return kOfxStatFailed;
     }
 
-    // check if this is a spawned thread, if yes return kOfxStatErrExists
-    {
-        lock_guard<mutex> guard(threadIndexesLock);
-        if ( threadIndexes.find( this_thread::get_id() ) != threadIndexes.end() ) {
+    // check if this is a spawned thread, if yes return kOfxStatErrExists or run a nested batch
+    if (currentThreadIndex != kNoThreadIndex) {
+        if (!nestedParallelism) {
             return kOfxStatErrExists;
         }
+
+        return multiThreadNested(func, nThreads, customArg);
     }
 
     unsigned int maxConcurrentThread;
@@ -202,70 +478,36 @@ OfxStatus multiThread(OfxThreadFunctionV1 func,
     }
 
     // at most maxConcurrentThread should be running at the same time
-    vector<thread*> threads(nThreads, NULL);
-    vector<thread::id> threadIDs(nThreads);
-    vector<ThreadArgs> threadArgs(nThreads);
-    for (unsigned int i = 0; i < nThreads; ++i) {
-        threadArgs[i].func = func;
-        threadArgs[i].threadIndex = i;
-        threadArgs[i].threadMax = nThreads;
-        threadArgs[i].customArg = customArg;
-        threadArgs[i].ret = kOfxStatFailed;
-    }
-    unsigned int i = 0; // index of next thread to launch
-    unsigned int running = 0; // number of running threads
-    unsigned int j = 0; // index of first running thread. all threads before this one are finished running
-    while (j < nThreads) {
-        // have no more than maxConcurrentThread threads launched at the same time
-        int threadsStarted = 0;
-        {
-            lock_guard<mutex> guard(threadIndexesLock);
-
-            while (i < nThreads && running < maxConcurrentThread) {
-                threads[i] = new thread(threadFunction, &threadArgs[i]);
-                threadIDs[i] = threads[i]->get_id();
-                assert( threadIndexes.find(threadIDs[i]) == threadIndexes.end() );
-                threadIndexes[threadIDs[i]] = threadArgs[i].threadIndex;
-                ++i;
-                ++running;
-                ++threadsStarted;
-            }
-        }
+    const unsigned int nRunners = (std::min)(nThreads, maxConcurrentThread);
+    ThreadBatch batch;
+    batch.func = func;
+    batch.threadMax = nThreads;
+    batch.customArg = customArg;
+    batch.ret.assign(nThreads, kOfxStatFailed);
+    batch.next = 0;
+    batch.runners = 0;
+
+    ///We are about to run nRunners threads
+    {
+        lock_guard<mutex> guard(occupancyLock);
+        occupancy += nRunners;
+    }
 
-        ///We just started threadsStarted threads
-        {
-            lock_guard<mutex> guard(occupancyLock);
-            occupancy += threadsStarted;
-        }
+    bool launched = workerPool.run(&batch, nRunners);
 
-        // now we've got at most maxConcurrentThread running. wait for each thread and launch a new one
-        threads[j]->join();
-        assert( !threads[j]->joinable() );
-        {
-            lock_guard<mutex> guard(threadIndexesLock);
-            map<thread::id, unsigned int>::iterator it = threadIndexes.find(threadIDs[j]);
-            assert( it != threadIndexes.end() );
-            if ( it != threadIndexes.end() ) {
-                threadIndexes.erase(it);
-            }
-        }
-        delete threads[j];
-        threads[j] = NULL;
-        threadIDs[j] = thread::id();
-        ++j;
-        --running;
+    // The threads are idle again
+    {
+        lock_guard<mutex> guard(occupancyLock);
+        occupancy -= nRunners;
+    }
 
-        // We just stopped 1 thread
-        {
-            lock_guard<mutex> guard(occupancyLock);
-            --occupancy;
-        }
+    if (!launched) {
+        return kOfxStatFailed;
     }
-    assert(running == 0);
 
     // check the return status of each thread, return the first error found
     for (unsigned int i = 0; i < nThreads; ++i) {
-        OfxStatus stat = threadArgs[i].ret;
+        OfxStatus stat = batch.ret[i];
         if (stat != kOfxStatOK) {
             return stat;
         }
@@ -314,13 +556,8 @@ OfxStatus multiThreadIndex(unsigned int *threadIndex)
         return kOfxStatFailed;
     }
 
-    lock_guard<mutex> guard(threadIndexesLock);
-    map<thread::id, unsigned int>::const_iterator it = threadIndexes.find( this_thread::get_id() );
-    if ( it != threadIndexes.end() ) {
-        *threadIndex = it->second;
-    } else {
-        *threadIndex = 0;
-    }
+    const unsigned int index = currentThreadIndex;
+    *threadIndex = (index == kNoThreadIndex) ? 0 : index;
 
     return kOfxStatOK;
 }
@@ -334,8 +571,7 @@ OfxStatus multiThreadIndex(unsigned int *threadIndex)
 // http://openfx.sourceforge.net/Documentation/1.3/ofxProgrammingReference.html#OfxMultiThreadSuiteV1_multiThreadIsSpawnedThread
 int multiThreadIsSpawnedThread(void)
 {
-    lock_guard<mutex> guard(threadIndexesLock);
-    return threadIndexes.find( this_thread::get_id() ) != threadIndexes.end();
+    return currentThreadIndex != kNoThreadIndex;
 }
 
 /** @brief Create a mutex
@@ -613,6 +849,16 @@ void ofxsThreadSuiteCheck()
     }
 }
 
+void ofxsThreadSuiteSetNested(bool nested)
+{
+    nestedParallelism = nested;
+}
+
+void ofxsThreadSuiteShutdown()
+{
+    workerPool.shutdown();
+}
+
 } // namespace OFX
 
 
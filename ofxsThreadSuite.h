@@ -39,6 +39,20 @@ namespace OFX {
     // call from PluginFactory::load() to fix the multithread suite on some hosts that do not implement it.
     // (load() is the second argument of mDeclarePluginFactory() )
     void ofxsThreadSuiteCheck();
+
+    // Enable or disable nested parallelism in the plugin-side suite (enabled by default).
+    // If enabled, multiThread() called from a spawned thread runs its slices on that thread and on
+    // the idle threads of the pool. If disabled, it returns kOfxStatErrExists, as required by the
+    // OFX specification, and the caller has to process serially.
+    // Call it from PluginFactory::load(), before any processing is done.
+    void ofxsThreadSuiteSetNested(bool nested);
+
+    // Stop and join the worker threads of the plugin-side suite, which are launched by the first
+    // multiThread() call and reused by the next ones.
+    // Call it from PluginFactory::unload(), when no processing is in progress.
+    // The workers are not stopped by a static destructor, which would deadlock on Windows when the
+    // plugin binary is unloaded. They are launched again if multiThread() is called afterwards.
+    void ofxsThreadSuiteShutdown();
 }
 
 #endif // openfx_supportext_ofxsThreadSuite_h
@@ -28,6 +28,7 @@
 #include <algorithm>
 
 #include "ofxsProcessing.H"
+#include "ofxsPixelProcessor.h"
 #include "ofxsMatrix2D.h"
 #include "ofxsFilter.h"
 #include "ofxsMaskMix.h"
@@ -55,6 +56,7 @@ protected:
     bool _domask;
     double _mix;
     bool _maskInvert;
+    OFX::PixelProcessorScheduler _scheduler; // distributes the render window over the threads
 
 public:
 
@@ -70,6 +72,7 @@ public:
         , _domask(false)
         , _mix(1.0)
         , _maskInvert(false)
+        , _scheduler()
     {
     }
 
@@ -113,6 +116,57 @@ public:
         _motionblur = motionblur;
         _mix = mix;
     }
+
+    /** @brief process the render window by tiles of tileWidth x tileHeight pixels rather than by
+        one band of rows per thread (see OFX::PixelProcessorScheduler).
+        With rotations, tiles keep the source footprint of each thread small. */
+    void setTileSize(int tileWidth,
+                     int tileHeight)
+    {
+        _scheduler.setTileSize(tileWidth, tileHeight);
+    }
+
+    /** @brief balance the load dynamically over the threads, using chunks of chunkHeight rows
+        (0 means automatic). This is the default with motion blur (see process()). */
+    void setWorkStealing(int chunkHeight = 0)
+    {
+        _scheduler.setWorkStealing(chunkHeight);
+    }
+
+    /** @brief overridden from OFX::ImageProcessor, called to process everything.
+        The scheduler is prepared here rather than in preProcess(), so that derived classes
+        may override preProcess() without calling this class' version. */
+    virtual void process() OVERRIDE
+    {
+        if ( !_dstImg || (_renderWindow.x1 >= _renderWindow.x2) || (_renderWindow.y1 >= _renderWindow.y2) ) {
+            return;
+        }
+
+        // call the pre MP pass
+        preProcess();
+
+        // the cost of adaptive motion blur varies a lot over the image: unless another scheduling mode
+        // was chosen, balance the load dynamically for this render only
+        OFX::PixelProcessorSchedulingEnum scheduling = _scheduler.getScheduling();
+        if ( (_motionblur != 0.) && (scheduling == OFX::ePixelProcessorSchedulingRows) ) {
+            scheduling = OFX::ePixelProcessorSchedulingWorkStealing;
+        }
+        _scheduler.prepare(_renderWindow, scheduling);
+        unsigned int nCPUs = _scheduler.getNumThreads( OFX::MultiThread::getNumCPUs() );
+
+        // call the base multi threading code
+        multiThread(nCPUs);
+
+        // call the post MP pass
+        postProcess();
+    }
+
+    /** @brief overridden from OFX::ImageProcessor. This function is called once on each SMP thread by the base class */
+    virtual void multiThreadFunction(unsigned int threadId,
+                                     unsigned int nThreads) OVERRIDE
+    {
+        _scheduler.multiThreadFunction(threadId, nThreads, *this, _renderScale);
+    }
 };
 
 
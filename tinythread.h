@@ -468,7 +468,7 @@ class condition_variable {
       _wait();
       aMutex.mMutex->lock();
 #else
-      pthread_cond_wait(&mHandle, &aMutex.mHandle);
+      pthread_cond_wait(&mHandle, &aMutex.mMutex->mHandle);
 #endif
     }
 
@@ -704,7 +704,7 @@ struct atomic {
       (void)order;
 #ifdef _TTHREAD_HAS_ATOMIC_BUILTINS_
       // FIXME: Use something more suitable here
-      __sync_lock_test_and_set(&mValue, desired);
+      (void)__sync_lock_test_and_set(&mValue, desired);
 #else
       lock_guard<mutex> guard(mLock);
       mValue = desired;